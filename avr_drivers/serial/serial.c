@@ -9,23 +9,30 @@
 #define SERIAL_BAUD                (9600)
 #define SERIAL_MYUBRR              (SERIAL_FOSC/16/SERIAL_BAUD-1)
 
-typedef enum
+#if (SERIAL_TX_BUFF_SIZE > 256) || (SERIAL_TX_BUFF_SIZE & (SERIAL_TX_BUFF_SIZE - 1))
+#error "SERIAL_TX_BUFF_SIZE must be a power of two not greater than 256."
+#endif
+#define SERIAL_TX_BUFF_MASK        (SERIAL_TX_BUFF_SIZE - 1)
+
+#define SERIAL_TX_INTERRUPT_ENABLE()    (UCSR0B |=  (1 << UDRIE0))
+#define SERIAL_TX_INTERRUPT_DISABLE()   (UCSR0B &= ~(1 << UDRIE0))
+
+typedef struct
 {
-    SERIAL_STATE_IDLE,
-    SERIAL_STATE_TX,
-    SERIAL_STATE_RX
-} serial_state_e;
+    uint8_t               buff[SERIAL_TX_BUFF_SIZE];
+    uint8_t               head;     /* < Written only by the producer (main loop). */
+    uint8_t               tail;     /* < Written only by the UDRE ISR (and by DROP_OLDEST with the ISR masked). */
+    serial_overflow_t     overflow;
+} serial_tx_ring_t;
 
 typedef struct
 {
-    uint8_t               len;
-    const uint8_t         *p_tx_buff;
-    serial_state_e        state;
     serial_rx_char_cb     rx_cb;
     serial_tx_complete_cb tx_cb;
 } serial_descriptor_t;
 
 static volatile serial_descriptor_t m_desc;
+static volatile serial_tx_ring_t    m_tx = {.overflow = SERIAL_TX_OVERFLOW_DEFAULT};
 
 #if defined(__AVR_ATmega2560__)
 ISR(USART0_RX_vect)
@@ -33,35 +40,94 @@ ISR(USART0_RX_vect)
 ISR(USART_RX_vect)
 #endif
 {
-    m_desc.state = SERIAL_STATE_RX;
     uint8_t ch = UDR0;
     if (m_desc.rx_cb)
     {
         m_desc.rx_cb(ch);
     }
-    m_desc.state = SERIAL_STATE_IDLE;
 }
 
 #if defined(__AVR_ATmega2560__)
-ISR(USART0_TX_vect)
+ISR(USART0_UDRE_vect)
 #elif defined(__AVR_ATmega328P__)
-ISR(USART_TX_vect)
+ISR(USART_UDRE_vect)
 #endif
 {
-    if (--m_desc.len)
+    uint8_t tail = m_tx.tail;
+    if (tail != m_tx.head)
     {
-        UDR0 = *m_desc.p_tx_buff++;
+        UDR0      = m_tx.buff[tail];
+        m_tx.tail = (tail + 1) & SERIAL_TX_BUFF_MASK;
     }
     else
     {
+        SERIAL_TX_INTERRUPT_DISABLE();
         if (m_desc.tx_cb)
         {
             m_desc.tx_cb();
         }
-        m_desc.state = SERIAL_STATE_IDLE;
     }
 }
 
+/*****************************************************************************/
+/*                         Static function                                   */
+/*****************************************************************************/
+static bool tx_push(uint8_t byte, serial_overflow_t overflow)
+{
+    uint8_t head = m_tx.head;
+    uint8_t next = (head + 1) & SERIAL_TX_BUFF_MASK;
+
+    if (next == m_tx.tail)
+    {
+        switch (overflow)
+        {
+            case SERIAL_OVERFLOW_DROP_OLDEST:
+                /* The ISR owns the tail, so keep it away while we move it. */
+                SERIAL_TX_INTERRUPT_DISABLE();
+                if (next == m_tx.tail)
+                {
+                    m_tx.tail = (m_tx.tail + 1) & SERIAL_TX_BUFF_MASK;
+                }
+                break;
+            case SERIAL_OVERFLOW_BLOCK:
+                /* Buffer is full, so UDRIE is set and the ISR drains it. */
+                while (next == m_tx.tail);
+                break;
+            case SERIAL_OVERFLOW_DROP_NEWEST:
+            default:
+                return false;
+        }
+    }
+
+    m_tx.buff[head] = byte;
+    m_tx.head       = next;
+    SERIAL_TX_INTERRUPT_ENABLE();
+    return true;
+}
+
+static error_t tx_enqueue(const uint8_t *data, uint16_t length, serial_overflow_t overflow)
+{
+    if (!data)        return ERROR_NULL_PTR;
+    if (length == 0)  return ERROR_DATA_LENGTH;
+
+    /* Drop the whole message rather than its tail, so no line comes out half-written.
+     * Only the ISR moves the tail meanwhile, which can only free more space. */
+    if (overflow == SERIAL_OVERFLOW_DROP_NEWEST &&
+        length > ((m_tx.tail - m_tx.head - 1) & SERIAL_TX_BUFF_MASK))
+    {
+        return ERROR_NO_MEM;
+    }
+
+    for (uint16_t i = 0; i < length; ++i)
+    {
+        if (!tx_push(data[i], overflow))
+        {
+            return ERROR_NO_MEM;
+        }
+    }
+    return ERROR_SUCCESS;
+}
+
 /* Pablic API */
 void serial_init(void)
 {
@@ -69,58 +135,44 @@ void serial_init(void)
     /** Set baud rate */
     UBRR0H = (unsigned char)(ubrr>>8);
     UBRR0L = (unsigned char)ubrr;
-    /** Enable receiver and transmitter */
-    UCSR0B = (1<<RXEN0) | (1<<TXEN0) | (1<<RXCIE0) | (1<<TXCIE0);
+    /** Enable receiver and transmitter, UDRIE is enabled on demand */
+    UCSR0B = (1<<RXEN0) | (1<<TXEN0) | (1<<RXCIE0);
     /** Set frame format: 8data, 1stop bit */
     UCSR0C = (1<<UCSZ01) | (1<<UCSZ00);
 }
 
 error_t serial_send_byte_block(uint8_t byte)
 {
-    while (!serial_ready());
-
-    m_desc.len       = 1;
-    m_desc.p_tx_buff = NULL;
-    m_desc.state     = SERIAL_STATE_TX;
-
-    UDR0 = byte;
+    tx_push(byte, SERIAL_OVERFLOW_BLOCK);
     return ERROR_SUCCESS;
 }
 
-error_t serial_send_block(const uint8_t *data, uint8_t length)
+error_t serial_send_block(const uint8_t *data, uint16_t length)
 {
-    if (!data)        return ERROR_NULL_PTR;
-    if (length == 0)  return ERROR_DATA_LENGTH;
-
-    while (!serial_ready()){};
-
-    m_desc.len       = length;
-    m_desc.p_tx_buff = data + 1;
-    m_desc.state     = SERIAL_STATE_TX;
-    UDR0 = data[0];
+    error_t err = tx_enqueue(data, length, SERIAL_OVERFLOW_BLOCK);
+    if (err != ERROR_SUCCESS)
+    {
+        return err;
+    }
 
     while (!serial_ready()){};
 
     return ERROR_SUCCESS;
 }
 
-error_t serial_send_no_block(const uint8_t *data, uint8_t length)
+error_t serial_send_no_block(const uint8_t *data, uint16_t length)
 {
-    if (!data)        return ERROR_NULL_PTR;
-    if (length == 0)  return ERROR_DATA_LENGTH;
-    if (!serial_ready()) return ERROR_BUSY;
-
-    m_desc.len       = length;
-    m_desc.p_tx_buff = data + 1;
-    m_desc.state     = SERIAL_STATE_TX;
-
-    UDR0 = data[0];
-    return ERROR_SUCCESS;
+    return tx_enqueue(data, length, m_tx.overflow);
 }
 
 bool serial_ready(void)
 {
-    return m_desc.state == SERIAL_STATE_IDLE;
+    return m_tx.head == m_tx.tail;
+}
+
+void serial_set_overflow_policy(serial_overflow_t overflow)
+{
+    m_tx.overflow = overflow;
 }
 
 void serial_set_tx_complete_cb(serial_tx_complete_cb cb)
@@ -5,14 +5,37 @@
 #include <avr/io.h>
 #include "error.h"
 
+/* TX ring size in bytes, must be a power of two (at most 256). */
+#ifndef SERIAL_TX_BUFF_SIZE
+#define SERIAL_TX_BUFF_SIZE         (128)
+#endif
+
+/* What serial_send_no_block() does when the TX ring is full. */
+typedef enum
+{
+    SERIAL_OVERFLOW_DROP_NEWEST,    /* < Discard the bytes that do not fit.         */
+    SERIAL_OVERFLOW_DROP_OLDEST,    /* < Overwrite the oldest pending bytes.        */
+    SERIAL_OVERFLOW_BLOCK           /* < Wait for the ISR to free space.            */
+} serial_overflow_t;
+
+#ifndef SERIAL_TX_OVERFLOW_DEFAULT
+#define SERIAL_TX_OVERFLOW_DEFAULT  (SERIAL_OVERFLOW_DROP_NEWEST)
+#endif
+
+/* Called from the UDRE interrupt when the TX ring has drained. The last byte
+ * is still being shifted out of the UART at that point. */
 typedef void (*serial_tx_complete_cb)(void);
 typedef void (*serial_rx_char_cb)(uint8_t ch);
 
 void serial_init(void);
 error_t serial_send_byte_block(uint8_t byte);
-error_t serial_send_block(const uint8_t *data, uint8_t length);
-error_t serial_send_no_block(const uint8_t *data, uint8_t length);
+error_t serial_send_block(const uint8_t *data, uint16_t length);
+/* Copies data into the TX ring and returns immediately. Must not be called
+ * from interrupt context. Returns ERROR_NO_MEM if bytes were dropped, with
+ * SERIAL_OVERFLOW_DROP_NEWEST that is always the whole message. */
+error_t serial_send_no_block(const uint8_t *data, uint16_t length);
 bool serial_ready(void);
+void serial_set_overflow_policy(serial_overflow_t overflow);
 void serial_set_tx_complete_cb(serial_tx_complete_cb cb);
 void serial_set_rx_cb(serial_rx_char_cb cb);
 
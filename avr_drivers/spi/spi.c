@@ -12,90 +12,262 @@
 #define DP_SCK      (5)
 #define DP_SS       (2)
 
-typedef enum
-{
-    SPI_IDLE,
-    SPI_MASTER_TX
-} spi_state_t;
+#define SPI_DUMMY_BYTE  (0xFF)
+
+#if   SPI_CLOCK_DIV == 2
+#define SPI_SPCR_CLOCK  (0)
+#define SPI_SPSR_CLOCK  (1 << SPI2X)
+#elif SPI_CLOCK_DIV == 4
+#define SPI_SPCR_CLOCK  (0)
+#define SPI_SPSR_CLOCK  (0)
+#elif SPI_CLOCK_DIV == 8
+#define SPI_SPCR_CLOCK  (1 << SPR0)
+#define SPI_SPSR_CLOCK  (1 << SPI2X)
+#elif SPI_CLOCK_DIV == 16
+#define SPI_SPCR_CLOCK  (1 << SPR0)
+#define SPI_SPSR_CLOCK  (0)
+#elif SPI_CLOCK_DIV == 32
+#define SPI_SPCR_CLOCK  (1 << SPR1)
+#define SPI_SPSR_CLOCK  (1 << SPI2X)
+#elif SPI_CLOCK_DIV == 64
+#define SPI_SPCR_CLOCK  (1 << SPR1)
+#define SPI_SPSR_CLOCK  (0)
+#elif SPI_CLOCK_DIV == 128
+#define SPI_SPCR_CLOCK  ((1 << SPR1)|(1 << SPR0))
+#define SPI_SPSR_CLOCK  (0)
+#else
+#error "SPI_CLOCK_DIV must be 2, 4, 8, 16, 32, 64 or 128."
+#endif
+
+#define SPI_INTERRUPT_ENABLE()      (SPCR |=  (1 << SPIE))
+#define SPI_INTERRUPT_DISABLE()     (SPCR &= ~(1 << SPIE))
 
 typedef struct
 {
-    uint8_t     *rx_buff;
-    uint8_t     *tx_buff;
-    uint8_t     len;
-    spi_state_t state;
-    spi_cb      cb;
-} spi_descriptor_t;
+    spi_transaction_t   *p_head;    /* < Transaction on the bus, NULL when idle. */
+    spi_transaction_t   *p_tail;
+    const uint8_t       *p_tx;      /* < Next byte to send of p_head. */
+    uint8_t             *p_rx;      /* < Next byte to receive of p_head. */
+    uint8_t             left;       /* < Bytes of p_head still on the wire or to send. */
+} spi_queue_t;
 
-static volatile spi_descriptor_t desc;
+static volatile spi_queue_t g_queue;
 
-ISR(SPI_STC_vect)
+/* Legacy spi_master_send() keeps its own transaction, one at a time. */
+static spi_transaction_t    g_legacy;
+static volatile spi_cb      g_legacy_cb;
+
+/*****************************************************************************/
+/*                         Static function                                   */
+/*****************************************************************************/
+static void transaction_start(spi_transaction_t *p_transaction)
+{
+    if (p_transaction->p_cs_port)
+    {
+        *p_transaction->p_cs_port &= ~(1 << p_transaction->cs_pin);
+    }
+
+    g_queue.p_tx = p_transaction->p_tx;
+    g_queue.p_rx = p_transaction->p_rx;
+    g_queue.left = p_transaction->len;
+    SPDR = g_queue.p_tx ? *g_queue.p_tx++ : SPI_DUMMY_BYTE;
+}
+
+#if defined(SPI_POLLED_ENABLE)
+static inline uint8_t poll_byte(uint8_t out)
+{
+    SPDR = out;
+    while (!(SPSR & (1 << SPIF)));
+    return SPDR;
+}
+
+/* Clocks a whole transaction by polling SPIF, the bus must be idle.
+ * Works on local copies, so the volatile queue is not touched per byte. */
+static void transaction_poll(spi_transaction_t *p_transaction)
 {
-    if (desc.rx_buff)
+    const uint8_t *p_tx = p_transaction->p_tx;
+    uint8_t       *p_rx = p_transaction->p_rx;
+    uint8_t       len   = p_transaction->len;
+
+    SPI_INTERRUPT_DISABLE();
+    if (p_transaction->p_cs_port)
     {
-        *desc.rx_buff++ = SPDR;
+        *p_transaction->p_cs_port &= ~(1 << p_transaction->cs_pin);
     }
-    if (--desc.len)
+
+    /* Two bytes per pass, a register access is a single pass. */
+    if (p_tx && p_rx)
     {
-        SPDR = *desc.tx_buff++;
+        for (; len >= 2; len -= 2)
+        {
+            *p_rx++ = poll_byte(*p_tx++);
+            *p_rx++ = poll_byte(*p_tx++);
+        }
+        if (len)
+        {
+            *p_rx = poll_byte(*p_tx);
+        }
     }
     else
     {
-        if (desc.cb)
+        for (; len; --len)
         {
-            desc.cb();
+            uint8_t byte = poll_byte(p_tx ? *p_tx++ : SPI_DUMMY_BYTE);
+            if (p_rx)
+            {
+                *p_rx++ = byte;
+            }
         }
-        desc.state = SPI_IDLE;
+    }
+
+    if (p_transaction->p_cs_port)
+    {
+        *p_transaction->p_cs_port |= (1 << p_transaction->cs_pin);
+    }
+    SPI_INTERRUPT_ENABLE();
+}
+#endif /* SPI_POLLED_ENABLE */
+
+static void legacy_complete(spi_transaction_t *p_transaction)
+{
+    if (g_legacy_cb)
+    {
+        g_legacy_cb();
     }
 }
 
+ISR(SPI_STC_vect)
+{
+    uint8_t byte = SPDR;
+    if (g_queue.p_rx)
+    {
+        *g_queue.p_rx++ = byte;
+    }
+
+    if (--g_queue.left)
+    {
+        SPDR = g_queue.p_tx ? *g_queue.p_tx++ : SPI_DUMMY_BYTE;
+        return;
+    }
+
+    /* Transaction is over, chain the next one without leaving the ISR. */
+    spi_transaction_t *p_done = g_queue.p_head;
+    if (p_done->p_cs_port)
+    {
+        *p_done->p_cs_port |= (1 << p_done->cs_pin);
+    }
+
+    g_queue.p_head = p_done->p_next;
+    if (g_queue.p_head == NULL)
+    {
+        g_queue.p_tail = NULL;
+    }
+    p_done->p_next = NULL;
+
+    if (g_queue.p_head)
+    {
+        transaction_start(g_queue.p_head);
+    }
+
+    if (p_done->cb)
+    {
+        p_done->cb(p_done);
+    }
+}
+
+/*****************************************************************************/
+/*                         Pablic API                                        */
+/*****************************************************************************/
 void spi_master_init(void)
 {
     /* Set MOSI and SCK output, all others input */
     DDR_SPI |= (1 << DP_MOSI)|(1 << DP_SCK) |(1 << DP_SS);
-    /* Enable SPI, enable interrupt, Master, set clock rate fck/16 */
-    SPCR = (1 << SPE)|(1 << SPIE)|(1 << MSTR)|(1 << SPR0);
+    /* Enable SPI, enable interrupt, Master, set clock rate fck/SPI_CLOCK_DIV */
+    SPCR = (1 << SPE)|(1 << SPIE)|(1 << MSTR)|SPI_SPCR_CLOCK;
+    SPSR = SPI_SPSR_CLOCK;
 }
 
-uint8_t spi_master_rw(uint8_t value)
+error_t spi_transaction_push(spi_transaction_t *p_transaction)
 {
-    uint8_t retval;
-    while (desc.state != SPI_IDLE);
-    desc.tx_buff = NULL;
-    desc.rx_buff = &retval;
-    desc.len     = 1;
-    desc.state   = SPI_MASTER_TX;
-    SPDR = value;
-    while (desc.state != SPI_IDLE);
-    return retval;
+    if (!p_transaction)          return ERROR_NULL_PTR;
+    if (p_transaction->len == 0) return ERROR_DATA_LENGTH;
+
+    p_transaction->p_next = NULL;
+
+    uint8_t sreg = SREG;
+    cli();
+#if defined(SPI_POLLED_ENABLE)
+    if (!g_queue.p_head && p_transaction->len <= SPI_POLLED_MAX_LEN)
+    {
+        /* Shorter than the ISR overhead it would cost, a few us with interrupts off. */
+        transaction_poll(p_transaction);
+        SREG = sreg;
+        if (p_transaction->cb)
+        {
+            p_transaction->cb(p_transaction);
+        }
+        return ERROR_SUCCESS;
+    }
+#endif /* SPI_POLLED_ENABLE */
+    if (g_queue.p_tail)
+    {
+        g_queue.p_tail->p_next = p_transaction;
+        g_queue.p_tail         = p_transaction;
+    }
+    else
+    {
+        g_queue.p_head = p_transaction;
+        g_queue.p_tail = p_transaction;
+        transaction_start(p_transaction);
+    }
+    SREG = sreg;
+
+    return ERROR_SUCCESS;
 }
 
-void spi_master_send_block(uint8_t *tx_buff, uint8_t *rx_buff, uint8_t len)
+bool spi_transaction_busy(spi_transaction_t *p_transaction)
 {
-    while (desc.state != SPI_IDLE);
+    uint8_t sreg = SREG;
+    cli();
+    bool busy = (g_queue.p_head == p_transaction) || (p_transaction->p_next != NULL) ||
+                (g_queue.p_tail == p_transaction);
+    SREG = sreg;
+    return busy;
+}
 
-    desc.tx_buff = tx_buff + 1;
-    desc.rx_buff = rx_buff;
-    desc.len     = len;
-    desc.cb      = NULL;
-    desc.state   = SPI_MASTER_TX;
-    SPDR = tx_buff[0];
+uint8_t spi_master_rw(uint8_t value)
+{
+    spi_transaction_t transaction = {.p_tx = &value,
+                                     .p_rx = &value,
+                                     .len  = 1};
+    spi_transaction_push(&transaction);
+    while (spi_transaction_busy(&transaction));
+    return value;
+}
 
-    while(desc.state != SPI_IDLE);
+void spi_master_send_block(uint8_t *tx_buff, uint8_t *rx_buff, uint8_t len)
+{
+    spi_transaction_t transaction = {.p_tx = tx_buff,
+                                     .p_rx = rx_buff,
+                                     .len  = len};
+    if (spi_transaction_push(&transaction) == ERROR_SUCCESS)
+    {
+        while (spi_transaction_busy(&transaction));
+    }
 }
 
 void spi_master_send(uint8_t *tx_buff, uint8_t *rx_buff, uint8_t len, spi_cb cb)
 {
-    while (desc.state != SPI_IDLE);
-    desc.tx_buff = tx_buff + 1;
-    desc.rx_buff = rx_buff;
-    desc.len     = len;
-    desc.cb      = cb;
-    desc.state   = SPI_MASTER_TX;
-    SPDR = tx_buff[0];
+    while (spi_transaction_busy(&g_legacy));
+    g_legacy_cb   = cb;
+    g_legacy.p_tx = tx_buff;
+    g_legacy.p_rx = rx_buff;
+    g_legacy.len  = len;
+    g_legacy.cb   = legacy_complete;
+    spi_transaction_push(&g_legacy);
 }
 
 uint8_t spi_is_ready(void)
 {
-    return desc.state == SPI_IDLE;
+    return g_queue.p_head == NULL;
 }
@@ -1,5 +1,8 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include "twi.h"
 #include "led_dbg.h"
 
@@ -7,142 +10,226 @@
 #define TWI_WRITE             (0 << 0)
 
 #define TWI_START_CONDITION() (TWCR = (1 << TWINT) | (1 << TWIE) | (1 << TWEN) | (1 << TWSTA))
-#define TWI_RESTART_CONDITION() TWI_START_CONDITION
+#define TWI_RESTART_CONDITION() TWI_START_CONDITION()
 #define TWI_STOP_CONDITION()  (TWCR = (1 << TWINT) | (1 << TWIE) |(1 << TWEN) | (1 << TWSTO))
+/* Master sends STOP and then START for the next transaction. */
+#define TWI_STOP_START_CONDITION() (TWCR = (1 << TWINT) | (1 << TWIE) |(1 << TWEN) | (1 << TWSTO) | (1 << TWSTA))
+#define TWI_CONTINUE()        (TWCR = (1 << TWINT) | (1 << TWIE) | (1 << TWEN))
+#define TWI_CONTINUE_ACK()    (TWCR = (1 << TWINT) | (1 << TWIE) | (1 << TWEN) | (1 << TWEA))
 
-typedef enum
-{
-    TWI_STATUS_OK,
-    TWI_START_TRANSMITTED      = 0x08,
-    TWI_R_START_TRANSMITTED    = 0x10,
-    TWI_SLA_W_TRANSMITTED_ACK  = 0x18,
-    TWI_SLA_W_TRANSMITTED_NACK = 0x20,
-    TWI_DATA_TRANSMITTED_ACK   = 0x28,
-    TWI_DATA_TRANSMITTED_NACK  = 0x30,
-    TWI_ARBITRATION_LOST       = 0x38,
-    TWI_SLA_R_TRANSMITTED_ACK  = 0x40,
-    TWI_SLA_R_TRANSMITTED_NACK = 0x48,
-    TWI_DATA_RECEIVED_ACK      = 0x50,
-    TWI_DATA_RECEIVED_NACK     = 0x58
-} twi_status_t;
-
-typedef enum
-{
-    TWI_STATE_IDLE,
-    TWI_STATE_TX,
-    TWI_STATE_RX
-} twi_state_t;
+typedef struct
+{
+    twi_transaction_t   *p_head;        /* < Transaction on the bus, NULL when idle. */
+    twi_transaction_t   *p_tail;
+    uint8_t             segment;        /* < Index of the current segment of p_head. */
+    uint8_t             *p_buff;        /* < Next byte of the current segment. */
+    bool                progmem;        /* < Current segment is read from flash. */
+    uint16_t            len;            /* < Bytes left in the current segment. */
+    bool                finishing;      /* < A callback runs, the bus is released after it returns. */
+} twi_queue_t;
 
 typedef struct
 {
-    twi_state_t     state;
-    uint8_t         *buff;
-    uint16_t        len;
-    uint8_t         slave_addr;
-    twi_tx_callback tx_cb;
-    twi_rx_callback rx_cb;
-    uint8_t         is_initialized;
+    twi_tx_callback     tx_cb;
+    twi_rx_callback     rx_cb;
+    uint8_t             is_initialized;
+    twi_segment_t       segment;
+    twi_transaction_t   transaction;
 } twi_descriptor_t;
 
 /*****************************************************************************/
 /*                         Static global vars                                */
 /*****************************************************************************/
-static volatile twi_descriptor_t m_desc = {.is_initialized = ERROR_INVALID_STATE};
+static volatile twi_queue_t g_queue;
+static twi_descriptor_t     m_desc = {.is_initialized = ERROR_INVALID_STATE};
 /*****************************************************************************/
 /*                         Static function                                   */
 /*****************************************************************************/
-static void error_handler(uint8_t status)
+static const twi_segment_t* segment_get(void)
 {
-    switch (m_desc.state)
+    return &g_queue.p_head->p_segments[g_queue.segment];
+}
+
+static void segment_load(void)
+{
+    const twi_segment_t *p_segment = segment_get();
+    g_queue.p_buff  = p_segment->p_buff;
+    g_queue.progmem = (p_segment->dir == TWI_SEGMENT_WRITE_P);
+    g_queue.len    = p_segment->len;
+}
+
+static uint8_t write_byte_next(void)
+{
+    g_queue.len--;
+    return g_queue.progmem ? pgm_read_byte(g_queue.p_buff++) : *g_queue.p_buff++;
+}
+
+/* Reports the finished transaction, then releases the bus and starts the next one.
+ * The callback runs first, so a transaction it pushes goes out with the same STOP-START
+ * instead of a START written over the pending STOP. */
+static void transaction_finish(uint8_t status)
+{
+    twi_transaction_t *p_done = g_queue.p_head;
+
+    g_queue.p_head = p_done->p_next;
+    p_done->p_next = NULL;
+    if (!g_queue.p_head)
     {
-        case TWI_STATE_TX:
-            if (m_desc.tx_cb)
-                m_desc.tx_cb(status);
-            break;
-        case TWI_STATE_RX:
-            if (m_desc.rx_cb)
-                m_desc.rx_cb(status);
-            break;
+        g_queue.p_tail = NULL;
+    }
+
+    if (p_done->cb)
+    {
+        g_queue.finishing = true;
+        p_done->cb(p_done, status);
+        g_queue.finishing = false;
+    }
+
+    if (g_queue.p_head)
+    {
+        g_queue.segment = 0;
+        segment_load();
+        TWI_STOP_START_CONDITION();
+    }
+    else
+    {
+        TWI_STOP_CONDITION();
+    }
+}
+
+static uint8_t status_map(uint8_t twsr)
+{
+    switch (twsr)
+    {
+        case TWI_SLA_W_TRANSMITTED_NACK:
+        case TWI_DATA_TRANSMITTED_NACK:
+        case TWI_ARBITRATION_LOST:
+        case TWI_SLA_R_TRANSMITTED_NACK:
+            return twsr;
+        case 0x00:
+            return TWI_STATUS_BUS_ERROR;
         default:
-            break;
+            return TWI_STATUS_UNEXPECTED;
+    }
+}
+
+/* Current segment is done, either keep writing in the same frame,
+ * restart for the next segment or finish the transaction. */
+static void segment_next(void)
+{
+    twi_segment_dir_t dir = segment_get()->dir;
+
+    if (++g_queue.segment >= g_queue.p_head->segments_num)
+    {
+        transaction_finish(TWI_STATUS_OK);
+        return;
+    }
+
+    segment_load();
+    if (dir != TWI_SEGMENT_READ && segment_get()->dir != TWI_SEGMENT_READ)
+    {
+        TWDR = write_byte_next();
+        TWI_CONTINUE();
+    }
+    else
+    {
+        TWI_RESTART_CONDITION();
+    }
+}
+
+static void read_ack_set(void)
+{
+    /* NACK the last byte of the segment, so the slave releases SDA. */
+    if (g_queue.len > 1)
+    {
+        TWI_CONTINUE_ACK();
+    }
+    else
+    {
+        TWI_CONTINUE();
+    }
+}
+
+static void legacy_complete(twi_transaction_t *p_transaction, uint8_t status)
+{
+    if (m_desc.segment.dir == TWI_SEGMENT_WRITE)
+    {
+        if (m_desc.tx_cb)
+        {
+            m_desc.tx_cb(status);
+        }
     }
+    else if (m_desc.rx_cb)
+    {
+        m_desc.rx_cb(status);
+    }
+}
+
+static error_t legacy_start(uint8_t addr, twi_segment_dir_t dir, void* p_data, uint16_t len)
+{
+    if (twi_transaction_busy(&m_desc.transaction))
+    {
+        return ERROR_BUSY;
+    }
+
+    m_desc.segment.dir                 = dir;
+    m_desc.segment.p_buff              = p_data;
+    m_desc.segment.len                 = len;
+    m_desc.transaction.slave_addr      = addr;
+    m_desc.transaction.p_segments      = &m_desc.segment;
+    m_desc.transaction.segments_num    = 1;
+    m_desc.transaction.cb              = legacy_complete;
+    return twi_transaction_push(&m_desc.transaction);
 }
 
 ISR(TWI_vect)
 {
-    switch (TWSR)
+    uint8_t status = TWSR & 0xF8;
+    switch (status)
     {
         case TWI_START_TRANSMITTED:
         case TWI_R_START_TRANSMITTED:
         { 
-            TWDR = (m_desc.slave_addr) | ((m_desc.state == TWI_STATE_TX) ? TWI_WRITE : TWI_READ);
-            TWCR = (1 << TWINT) | (1 << TWIE) | (1 << TWEN);
+            TWDR = (g_queue.p_head->slave_addr) | ((segment_get()->dir == TWI_SEGMENT_READ) ? TWI_READ : TWI_WRITE);
+            TWI_CONTINUE();
             break;
         }
         case TWI_SLA_W_TRANSMITTED_ACK:
-        {
-            if (m_desc.len)
-            {
-                TWDR = *m_desc.buff++;
-                m_desc.len--;
-                TWCR = (1 << TWINT) | (1 << TWIE) | (1 << TWEN);
-            }
-            else
-            {
-                error_handler(TWSR);
-                m_desc.state = TWI_STATE_IDLE;
-            }
-            break;
-        }
         case TWI_DATA_TRANSMITTED_ACK:
         {
-            if (m_desc.len)
+            if (g_queue.len)
             {
-                TWDR = *m_desc.buff++;
-                m_desc.len--;
-                TWCR = (1 << TWINT) | (1 << TWIE) | (1 << TWEN);
+                TWDR = write_byte_next();
+                TWI_CONTINUE();
             }
             else
             {
-                if (m_desc.tx_cb)
-                {
-                    m_desc.tx_cb(TWSR);
-                }
-                TWI_STOP_CONDITION();
-                m_desc.state = TWI_STATE_IDLE;
+                segment_next();
             }
             break;
         }
         case TWI_SLA_R_TRANSMITTED_ACK:
         {
-            TWCR = (1 << TWINT) | (1 << TWIE) | (1 << TWEN) | ((m_desc.len == 1) ? (0 << TWEA) : (1 << TWEA));
+            read_ack_set();
             break;
         }
         case TWI_DATA_RECEIVED_ACK:
         {
-            m_desc.buff[0] = TWDR;
-            m_desc.buff++;
-            m_desc.len--;
-            TWCR = (1 << TWINT) | (1 << TWIE) | (1 << TWEN) | ((m_desc.len == 1) ? (0 << TWEA) : (1 << TWEA));
+            *g_queue.p_buff++ = TWDR;
+            g_queue.len--;
+            read_ack_set();
             break;
         }
         case TWI_DATA_RECEIVED_NACK:
         {
-            m_desc.buff[0] = TWDR;
-            m_desc.len--;
-            if (m_desc.rx_cb)
-            {
-                m_desc.rx_cb(TWI_STATE_RX);
-            }
-            m_desc.state = TWI_STATE_IDLE;
-            TWI_STOP_CONDITION();
+            *g_queue.p_buff++ = TWDR;
+            g_queue.len--;
+            segment_next();
             break;
         }
         default:
         {
-            error_handler(TWSR);
-            m_desc.state = TWI_STATE_IDLE;
-            TWI_STOP_CONDITION();
+            transaction_finish(status_map(status));
             break;
         }
     }
@@ -156,7 +243,9 @@ void twi_init(twi_scl_t f_scl, twi_tx_callback tx_cb, twi_rx_callback rx_cb)
 {
     m_desc.tx_cb = tx_cb;
     m_desc.rx_cb = rx_cb;
-    TWBR = ((F_CPU/f_scl) - 16) / (2*(TWSR & 0x03));
+    /* SCL = F_CPU / (16 + 2 * TWBR * prescaler), prescaler is 1. */
+    TWSR = 0;
+    TWBR = ((F_CPU / (f_scl * 1000UL)) - 16) / 2;
     TWCR = (1 << TWEN) |                                        /* < Enable module           */
            (1 << TWIE) |                                        /* < Interrupt Enable        */
            (0 << TWEA);                                         /* < Disable acknowledge Bit */
@@ -168,28 +257,70 @@ uint8_t twi_initialized(void)
     return m_desc.is_initialized;
 }
 
-void twi_send(uint8_t addr, const void* p_data, uint16_t len)
+error_t twi_transaction_push(twi_transaction_t *p_transaction)
 {
-    while(m_desc.state != TWI_STATE_IDLE);
-    m_desc.slave_addr = addr;
-    m_desc.buff       = (uint8_t*)p_data;
-    m_desc.len        = len;
-    m_desc.state      = TWI_STATE_TX;
-    TWI_START_CONDITION();
-}
+    if (!p_transaction || !p_transaction->p_segments) return ERROR_NULL_PTR;
+    if (p_transaction->segments_num == 0)             return ERROR_DATA_LENGTH;
+    for (uint8_t i = 0; i < p_transaction->segments_num; ++i)
+    {
+        if (p_transaction->p_segments[i].len == 0)    return ERROR_DATA_LENGTH;
+    }
 
-#if 0
-void twi_read(uint8_t addr, void* p_data, uint16_t len)
-{
-    if (TWI_STATE_IDLE != m_desc.state)
+    p_transaction->p_next = NULL;
+
+    /* The STOP of the previous transaction may still be on the bus, a START must not be
+     * written over it. Wait with interrupts enabled, then check again locked in case
+     * TWI_vect issued another STOP meanwhile. */
+    uint8_t sreg = SREG;
+    for (;;)
     {
-        return ERROR_BUSY;
+        while (TWCR & (1 << TWSTO));
+        cli();
+        if (!(TWCR & (1 << TWSTO)))
+        {
+            break;
+        }
+        SREG = sreg;
+    }
+
+    if (g_queue.p_tail)
+    {
+        g_queue.p_tail->p_next = p_transaction;
+        g_queue.p_tail         = p_transaction;
+    }
+    else
+    {
+        g_queue.p_head  = p_transaction;
+        g_queue.p_tail  = p_transaction;
+        /* From a callback, transaction_finish() starts it right after the STOP. */
+        if (!g_queue.finishing)
+        {
+            g_queue.segment = 0;
+            segment_load();
+            TWI_START_CONDITION();
+        }
     }
-    m_desc.slave_addr = addr;
-    m_desc.buff       = p_data;
-    m_desc.len        = len;
-    m_desc.state      = TWI_STATE_RX;
-    TWI_START_CONDITION();
+    SREG = sreg;
+
     return ERROR_SUCCESS;
 }
-#endif
\ No newline at end of file
+
+uint8_t twi_transaction_busy(twi_transaction_t *p_transaction)
+{
+    uint8_t sreg = SREG;
+    cli();
+    bool busy = (g_queue.p_head == p_transaction) || (p_transaction->p_next != NULL) ||
+                (g_queue.p_tail == p_transaction);
+    SREG = sreg;
+    return busy;
+}
+
+error_t twi_send(uint8_t addr, const void* p_data, uint16_t len)
+{
+    return legacy_start(addr, TWI_SEGMENT_WRITE, (void*)p_data, len);
+}
+
+error_t twi_read(uint8_t addr, void* p_data, uint16_t len)
+{
+    return legacy_start(addr, TWI_SEGMENT_READ, p_data, len);
+}
@@ -1,6 +1,7 @@
 #ifndef TWI_H__
 #define TWI_H__
 
+#include <stdint.h>
 #include "error.h"
 
 typedef enum
@@ -10,11 +11,73 @@ typedef enum
     TWI_SCL_400KHZ = 400
 } twi_scl_t;
 
+/* Status passed to the callbacks, TWI_STATUS_OK or the TWSR code that failed.
+ * TWSR codes are multiples of 8, so the driver's own codes sit below 8. */
+typedef enum
+{
+    TWI_STATUS_OK,
+    TWI_STATUS_BUS_ERROR       = 0x01,              /* < Illegal START/STOP, TWSR reads 0x00. */
+    TWI_STATUS_UNEXPECTED      = 0x02,              /* < TWSR code the master should never see. */
+    TWI_START_TRANSMITTED      = 0x08,
+    TWI_R_START_TRANSMITTED    = 0x10,
+    TWI_SLA_W_TRANSMITTED_ACK  = 0x18,
+    TWI_SLA_W_TRANSMITTED_NACK = 0x20,
+    TWI_DATA_TRANSMITTED_ACK   = 0x28,
+    TWI_DATA_TRANSMITTED_NACK  = 0x30,
+    TWI_ARBITRATION_LOST       = 0x38,
+    TWI_SLA_R_TRANSMITTED_ACK  = 0x40,
+    TWI_SLA_R_TRANSMITTED_NACK = 0x48,
+    TWI_DATA_RECEIVED_ACK      = 0x50,
+    TWI_DATA_RECEIVED_NACK     = 0x58
+} twi_status_t;
+
+typedef enum
+{
+    TWI_SEGMENT_WRITE,
+    TWI_SEGMENT_READ,
+    TWI_SEGMENT_WRITE_P                             /* < Write, p_buff points to PROGMEM. */
+} twi_segment_dir_t;
+
+/* Consecutive write segments, from RAM or PROGMEM, go out back to back in one frame, any other
+ * segment boundary issues a repeated start. */
+typedef struct
+{
+    twi_segment_dir_t   dir;
+    uint8_t             *p_buff;
+    uint16_t            len;                        /* < Must not be 0. */
+} twi_segment_t;
+
+struct twi_transaction_s;
+typedef void (*twi_transaction_cb_t)(struct twi_transaction_s *p_transaction, uint8_t status);
+
+/* START, segments, STOP. The structure, segments and buffers belong to the
+ * driver from twi_transaction_push() until the callback is called. */
+typedef struct twi_transaction_s
+{
+    uint8_t                     slave_addr;         /* < 8-bit address, R/W bit is added by the driver. */
+    const twi_segment_t         *p_segments;
+    uint8_t                     segments_num;
+    twi_transaction_cb_t        cb;                 /* < Called from TWI_vect just before STOP. */
+    void                        *p_context;
+    struct twi_transaction_s    *p_next;            /* < Only for internal usage. */
+} twi_transaction_t;
+
 typedef void (*twi_tx_callback)(uint8_t status);
 typedef void (*twi_rx_callback)(uint8_t status);
 
 void    twi_init(twi_scl_t f_scl, twi_tx_callback tx_cb, twi_rx_callback rx_cb);
 uint8_t twi_initialized(void);
-void twi_send(uint8_t addr, const void* p_data, uint16_t len);
-// void twi_read(uint8_t addr, void* p_data, uint16_t len);
+
+/* Queues a transaction, starts it at once if the bus is idle.
+ * Safe to call from interrupt context, including transaction callbacks.
+ * Right after a STOP it waits for the STOP to leave the bus, a few us, with
+ * interrupts left as the caller had them. */
+error_t twi_transaction_push(twi_transaction_t *p_transaction);
+/* True while the transaction is queued or on the bus. */
+uint8_t twi_transaction_busy(twi_transaction_t *p_transaction);
+
+/* Single buffer helpers reporting to the twi_init() callbacks.
+ * Return ERROR_BUSY while the previous helper transfer is pending. */
+error_t twi_send(uint8_t addr, const void* p_data, uint16_t len);
+error_t twi_read(uint8_t addr, void* p_data, uint16_t len);
 #endif /* TWI_H__ */
@@ -16,6 +16,27 @@
 ********************************************************************/
 #define APP_TIMER_STOP             ((uint32_t)(-1))
 
+/* Timer backends, selected at compile time with APP_TIMER_BACKEND.
+ * LIST  - sorted linked list, O(n) add/remove, smallest RAM footprint.
+ * WHEEL - hierarchical timing wheel, O(1) add/remove and per-tick expiry. */
+#define APP_TIMER_BACKEND_LIST     (0)
+#define APP_TIMER_BACKEND_WHEEL    (1)
+
+#ifndef APP_TIMER_BACKEND
+#define APP_TIMER_BACKEND          APP_TIMER_BACKEND_LIST
+#endif
+
+#if APP_TIMER_BACKEND == APP_TIMER_BACKEND_WHEEL
+/* Each level has 2^APP_TIMER_WHEEL_BITS slots, one pointer per slot.
+ * Default 3 x 32 slots covers 32.7 s directly, longer timers are re-cascaded. */
+#ifndef APP_TIMER_WHEEL_BITS
+#define APP_TIMER_WHEEL_BITS       (5)
+#endif
+#ifndef APP_TIMER_WHEEL_LEVELS
+#define APP_TIMER_WHEEL_LEVELS     (3)
+#endif
+#endif /* APP_TIMER_BACKEND == APP_TIMER_BACKEND_WHEEL */
+
 /********************************************************************
 * @brief      Function type for the timeout callback.
 *
@@ -34,6 +55,9 @@ typedef struct app_timer_s
     app_timer_callback_t            cb;         /* Callback function for a call when the timer is triggered. */
     void                            *p_context; /* Pointer to the data. */
     struct app_timer_s              *p_next;    /* Pointer to next timer in linked list. Only for internal usage. */
+#if APP_TIMER_BACKEND == APP_TIMER_BACKEND_WHEEL
+    struct app_timer_s              **pp_prev;  /* Link that points to this timer, NULL if not added. Only for internal usage. */
+#endif /* APP_TIMER_BACKEND == APP_TIMER_BACKEND_WHEEL */
 } app_timer_t;
 
 /********************************************************************
@@ -47,6 +71,21 @@ typedef struct app_timer_s
 ********************************************************************/
 void app_timer_init(void);
 
+/********************************************************************
+* @brief      Prepares a timer structure before its first app_timer_add().
+*
+* @param[in]  p_timer           Pointer to a allocated timer.
+* @param[in]  cb                Timeout callback.
+* @param[in]  p_context         Passed to the callback.
+*
+* @returns    void.
+*
+* @note The wheel backend reads the internal links to tell whether the
+* timer is already added. Timers with static storage start zeroed, any
+* other timer (stack, heap, reused memory) must go through this first.
+********************************************************************/
+void app_timer_create(app_timer_t *p_timer, app_timer_callback_t cb, void *p_context);
+
 /********************************************************************
 * @brief      Adds a timer into the list of timers.
 *
@@ -57,7 +96,8 @@ void app_timer_init(void);
 * @returns    E_SUCCESS         Timer was added.
 *
 * @note The structure parameters must not be changed after
-* the structure has been added.
+* the structure has been added. The timer must be static or prepared
+* with app_timer_create(), see there.
 ********************************************************************/
 error_t app_timer_add(app_timer_t *p_timer, uint32_t time_ms);
 
@@ -12,6 +12,200 @@
 #include "error.h"
 #include "timer_timestamp.h"
 
+/********************************************************************
+*                       Function macro defines                      *
+********************************************************************/
+#if APP_TIMER_BACKEND == APP_TIMER_BACKEND_WHEEL
+#define WHEEL_SLOT_NUM          (1U << APP_TIMER_WHEEL_BITS)
+#define WHEEL_SLOT_MASK         (WHEEL_SLOT_NUM - 1)
+#define WHEEL_LEVEL_SHIFT(_l)   ((_l) * APP_TIMER_WHEEL_BITS)
+#define WHEEL_RANGE             (1UL << WHEEL_LEVEL_SHIFT(APP_TIMER_WHEEL_LEVELS))
+
+/********************************************************************
+*                             Typedefs                              *
+********************************************************************/
+/* Timer context structure. */
+typedef struct
+{
+    uint32_t    now;        /* Next tick to be processed. */
+    uint16_t    count;      /* Number of added timers. */
+    app_timer_t *slots[APP_TIMER_WHEEL_LEVELS][WHEEL_SLOT_NUM];
+} timer_desc_t;
+
+/********************************************************************
+*                  Static global data declarations                  *
+********************************************************************/
+/* Timer context declaration. */
+static timer_desc_t g_app_timer_desc;
+
+/********************************************************************
+*                     Functions implementations                     *
+********************************************************************/
+static void timer_link(app_timer_t **pp_head, app_timer_t *p_timer)
+{
+    p_timer->p_next = *pp_head;
+    if (p_timer->p_next != NULL)
+    {
+        p_timer->p_next->pp_prev = &p_timer->p_next;
+    }
+    p_timer->pp_prev = pp_head;
+    *pp_head = p_timer;
+}
+
+static void timer_unlink(app_timer_t *p_timer)
+{
+    *p_timer->pp_prev = p_timer->p_next;
+    if (p_timer->p_next != NULL)
+    {
+        p_timer->p_next->pp_prev = p_timer->pp_prev;
+    }
+    p_timer->pp_prev = NULL;
+}
+
+/* Moves a whole slot list into pp_head, so it can be walked while
+ * callbacks add and remove timers. */
+static void slot_detach(app_timer_t **pp_slot, app_timer_t **pp_head)
+{
+    *pp_head = *pp_slot;
+    *pp_slot = NULL;
+    if (*pp_head != NULL)
+    {
+        (*pp_head)->pp_prev = pp_head;
+    }
+}
+
+static void wheel_insert(app_timer_t *p_timer)
+{
+    uint32_t expires = p_timer->timestamp;
+    int32_t  delta   = (int32_t)(expires - g_app_timer_desc.now);
+
+    if (delta < 0)
+    {
+        /* Already due, fire on the next processed tick. */
+        expires = g_app_timer_desc.now;
+        delta   = 0;
+    }
+    else if ((uint32_t)delta >= WHEEL_RANGE)
+    {
+        /* Park in the last reachable slot, it is re-cascaded from there. */
+        expires = g_app_timer_desc.now + WHEEL_RANGE - 1;
+        delta   = WHEEL_RANGE - 1;
+    }
+
+    uint8_t level = 0;
+    while ((uint32_t)delta >= (1UL << WHEEL_LEVEL_SHIFT(level + 1)))
+    {
+        level++;
+    }
+
+    uint8_t slot = (expires >> WHEEL_LEVEL_SHIFT(level)) & WHEEL_SLOT_MASK;
+    timer_link(&g_app_timer_desc.slots[level][slot], p_timer);
+}
+
+static void wheel_cascade(uint32_t tick)
+{
+    for (uint8_t level = APP_TIMER_WHEEL_LEVELS - 1; level > 0; --level)
+    {
+        if (tick & ((1UL << WHEEL_LEVEL_SHIFT(level)) - 1))
+        {
+            continue;
+        }
+
+        uint8_t     slot = (tick >> WHEEL_LEVEL_SHIFT(level)) & WHEEL_SLOT_MASK;
+        app_timer_t *p_list;
+        slot_detach(&g_app_timer_desc.slots[level][slot], &p_list);
+
+        while (p_list != NULL)
+        {
+            app_timer_t *p_timer = p_list;
+            timer_unlink(p_timer);
+            wheel_insert(p_timer);
+        }
+    }
+}
+
+void app_timer_process(void)
+{
+    uint32_t timestamp_now = timer_timestamp_ms_get();
+
+    while (((int32_t)(timestamp_now - g_app_timer_desc.now)) >= 0)
+    {
+        if (g_app_timer_desc.count == 0)
+        {
+            /* Nothing to expire or cascade, skip the idle ticks. */
+            g_app_timer_desc.now = timestamp_now + 1;
+            return;
+        }
+
+        uint32_t tick = g_app_timer_desc.now;
+        wheel_cascade(tick);
+
+        app_timer_t *p_expired;
+        slot_detach(&g_app_timer_desc.slots[0][tick & WHEEL_SLOT_MASK], &p_expired);
+        g_app_timer_desc.now = tick + 1;
+
+        while (p_expired != NULL)
+        {
+            app_timer_t *p_timer = p_expired;
+            timer_unlink(p_timer);
+            g_app_timer_desc.count--;
+
+            uint32_t next_timeout_ms = APP_TIMER_STOP;
+
+            if (p_timer->cb != NULL)
+            {
+                next_timeout_ms = p_timer->cb(p_timer->p_context);
+            }
+
+            if (next_timeout_ms != APP_TIMER_STOP)
+            {
+                app_timer_add(p_timer, next_timeout_ms);
+            }
+        }
+    }
+}
+
+/********************************************************************
+*                                 Api                               *
+********************************************************************/
+void app_timer_init(void)
+{
+    memset(&g_app_timer_desc, 0, sizeof(g_app_timer_desc));
+    timer_timestamp_init();
+    g_app_timer_desc.now = timer_timestamp_ms_get();
+}
+
+error_t app_timer_add(app_timer_t *p_timer, uint32_t time_ms)
+{
+    if (p_timer->pp_prev != NULL)
+    {
+        app_timer_remove(p_timer);
+    }
+
+    p_timer->timestamp = timer_timestamp_ms_get() + time_ms;
+    wheel_insert(p_timer);
+    g_app_timer_desc.count++;
+
+    return ERROR_SUCCESS;
+}
+
+void app_timer_remove(app_timer_t *p_timer)
+{
+    if (p_timer->pp_prev != NULL)
+    {
+        timer_unlink(p_timer);
+        g_app_timer_desc.count--;
+    }
+}
+
+void app_timer_reschedule(app_timer_t *p_timer, uint32_t time_ms)
+{
+    app_timer_remove(p_timer);
+    app_timer_add(p_timer, time_ms);
+}
+
+#else /* APP_TIMER_BACKEND == APP_TIMER_BACKEND_WHEEL */
+
 /********************************************************************
 *                             Typedefs                              *
 ********************************************************************/
@@ -131,4 +325,12 @@ void app_timer_reschedule(app_timer_t *p_timer, uint32_t time_ms)
 {
     app_timer_remove(p_timer);
     app_timer_add(p_timer, time_ms);
-}
\ No newline at end of file
+}
+#endif /* APP_TIMER_BACKEND == APP_TIMER_BACKEND_WHEEL */
+
+void app_timer_create(app_timer_t *p_timer, app_timer_callback_t cb, void *p_context)
+{
+    memset(p_timer, 0, sizeof(*p_timer));
+    p_timer->cb        = cb;
+    p_timer->p_context = p_context;
+}
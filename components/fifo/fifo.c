@@ -75,3 +75,50 @@ void* fifo_pop(fifo_t *p_fifo)
 #endif /* FIFO_DEBUG_ENABLE */
     return p_item;
 }
+
+uint8_t fifo_spsc_push(fifo_spsc_t *p_fifo, const uint8_t *p_data, uint8_t len)
+{
+	uint8_t head = p_fifo->head;
+	uint8_t free = p_fifo->mask + 1 - (uint8_t)(head - p_fifo->tail);
+	if (len > free)
+	{
+		len = free;
+	}
+
+	/* Copy as at most two spans: up to the end of the buffer, then from the start. */
+	uint8_t offset = head & p_fifo->mask;
+	uint8_t first  = p_fifo->mask + 1 - offset;
+	if (first > len)
+	{
+		first = len;
+	}
+	memcpy(p_fifo->p_buff + offset, p_data, first);
+	memcpy(p_fifo->p_buff, p_data + first, len - first);
+
+	FIFO_SPSC_BARRIER();
+	p_fifo->head = head + len;
+	return len;
+}
+
+uint8_t fifo_spsc_pop(fifo_spsc_t *p_fifo, uint8_t *p_data, uint8_t len)
+{
+	uint8_t tail  = p_fifo->tail;
+	uint8_t count = (uint8_t)(p_fifo->head - tail);
+	if (len > count)
+	{
+		len = count;
+	}
+
+	uint8_t offset = tail & p_fifo->mask;
+	uint8_t first  = p_fifo->mask + 1 - offset;
+	if (first > len)
+	{
+		first = len;
+	}
+	memcpy(p_data, p_fifo->p_buff + offset, first);
+	memcpy(p_data + first, p_fifo->p_buff, len - first);
+
+	FIFO_SPSC_BARRIER();
+	p_fifo->tail = tail + len;
+	return len;
+}
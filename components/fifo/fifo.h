@@ -2,6 +2,7 @@
 #define FIFO_H__
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define FIFO_DEBUG_ENABLE
 #define FIFO_STATUS_BASE                                            (40)
@@ -34,7 +35,72 @@ typedef struct
         .p_tail     = NULL,                                         \
         .p_mem_pool = m_##_name##_mem_pool};
 
+/* Single-producer/single-consumer byte ring. One side may run in an ISR and
+ * the other in the main loop without cli(): head is written only by the
+ * producer, tail only by the consumer, and both are single-byte stores.
+ * Indices run freely and are masked on access, so all _size bytes are usable.
+ * _size must be a power of two not greater than 128. */
+typedef struct
+{
+    uint8_t          *p_buff;
+    uint8_t          mask;
+    volatile uint8_t head;
+    volatile uint8_t tail;
+} fifo_spsc_t;
+
+#define FIFO_SPSC_INSTANCE_CREATE(_name, _size)                     \
+    typedef char m_##_name##_size_check                             \
+        [(((_size) & ((_size) - 1)) || (_size) > 128) ? -1 : 1];    \
+    static uint8_t m_##_name##_buff[_size];                         \
+    static fifo_spsc_t _name = {                                    \
+        .p_buff     = m_##_name##_buff,                             \
+        .mask       = (_size) - 1,                                  \
+        .head       = 0,                                            \
+        .tail       = 0};
+
+/* Keeps buffer accesses on the right side of the index update. */
+#define FIFO_SPSC_BARRIER()         __asm__ __volatile__ ("" ::: "memory")
+
 fifo_status_t fifo_push(fifo_t *p_fifo, const void *p_elem);
 void*         fifo_pop(fifo_t *p_fifo);
 
+uint8_t       fifo_spsc_push(fifo_spsc_t *p_fifo, const uint8_t *p_data, uint8_t len);
+uint8_t       fifo_spsc_pop(fifo_spsc_t *p_fifo, uint8_t *p_data, uint8_t len);
+
+static inline uint8_t fifo_spsc_count(const fifo_spsc_t *p_fifo)
+{
+    return (uint8_t)(p_fifo->head - p_fifo->tail);
+}
+
+static inline uint8_t fifo_spsc_free(const fifo_spsc_t *p_fifo)
+{
+    return (uint8_t)(p_fifo->mask + 1 - fifo_spsc_count(p_fifo));
+}
+
+static inline bool fifo_spsc_put(fifo_spsc_t *p_fifo, uint8_t byte)
+{
+    uint8_t head = p_fifo->head;
+    if ((uint8_t)(head - p_fifo->tail) > p_fifo->mask)
+    {
+        return false;
+    }
+    p_fifo->p_buff[head & p_fifo->mask] = byte;
+    FIFO_SPSC_BARRIER();
+    p_fifo->head = head + 1;
+    return true;
+}
+
+static inline bool fifo_spsc_get(fifo_spsc_t *p_fifo, uint8_t *p_byte)
+{
+    uint8_t tail = p_fifo->tail;
+    if (tail == p_fifo->head)
+    {
+        return false;
+    }
+    *p_byte = p_fifo->p_buff[tail & p_fifo->mask];
+    FIFO_SPSC_BARRIER();
+    p_fifo->tail = tail + 1;
+    return true;
+}
+
 #endif /* FIFO_H__ */
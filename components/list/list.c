@@ -11,29 +11,68 @@ typedef enum
 /*******************************************************************/
 /*                       Static function                           */
 /*******************************************************************/
-static inline list_node_t* mem_alloc(list_t *p_list)
+static inline uint8_t node_size(list_t *p_list)
 {
-	uint8_t el_struct_size = p_list->element_size + sizeof(list_node_t);
+	return p_list->element_size + sizeof(list_node_t);
+}
 
-	for (uint8_t *p_item = (uint8_t*)p_list->p_mem_pool;
-		 p_item < ((uint8_t*)p_list->p_mem_pool + p_list->element_max_num * el_struct_size);
-		 p_item += el_struct_size)
+static inline list_node_t* mem_alloc(list_t *p_list)
+{
+	list_node_t *p_elem = p_list->p_free;
+	if (p_elem)
 	{
-		list_node_t *p_elem = (list_node_t*)p_item;
-		if (LIST_STATE_FREE == p_elem->state)
-		{
-			p_elem->state = LIST_STATE_COMMITED;
-			return p_elem;
-		}
+		p_list->p_free = p_elem->p_next;
+	}
+	else if (p_list->pool_used < p_list->element_max_num)
+	{
+		/* Free list is empty, take the next never used node. */
+		p_elem = (list_node_t*)((uint8_t*)p_list->p_mem_pool + p_list->pool_used * node_size(p_list));
+		p_list->pool_used++;
+	}
+	else
+	{
+		return NULL;
 	}
-	return NULL;
+
+	p_elem->state = LIST_STATE_COMMITED;
+	return p_elem;
 }
 
-static inline void mem_free(list_node_t *p_remove)
+static inline void mem_free(list_t *p_list, list_node_t *p_remove)
 {
 	p_remove->state  = LIST_STATE_FREE;
-	p_remove->p_next = NULL;
+	p_remove->p_next = p_list->p_free;
+	p_list->p_free   = p_remove;
 }
+
+static inline void node_unlink(list_t *p_list, list_node_t *p_node, list_node_t *p_prev)
+{
+	list_node_t *p_next = p_node->p_next;
+
+	if (p_prev)
+	{
+		p_prev->p_next = p_next;
+	}
+	else
+	{
+		p_list->p_head = p_next;
+	}
+
+	if (NULL == p_next)
+	{
+		p_list->p_tail = p_prev;
+	}
+#ifdef LIST_DOUBLY_LINKED_ENABLE
+	else
+	{
+		p_next->p_prev = p_prev;
+	}
+#endif /* LIST_DOUBLY_LINKED_ENABLE */
+
+	mem_free(p_list, p_node);
+	p_list->size--;
+}
+
 /*******************************************************************/
 /*                       Public api                                */
 /*******************************************************************/
@@ -44,12 +83,7 @@ void* list_front(list_t *p_list)
 
 void* list_back(list_t *p_list)
 {
-	list_node_t *p_last = NULL;
-	FOREACH(p_list, p_iter)
-	{
-		p_last = p_iter;
-	}
-    return p_last;
+	return (p_list->p_tail) ? p_list->p_tail->data : NULL;
 }
 
 error_t list_push_front(list_t *p_list, void *p_data)
@@ -63,6 +97,17 @@ error_t list_push_front(list_t *p_list, void *p_data)
 
 	memcpy(p_new->data, p_data, p_list->element_size);
 	p_new->p_next      = p_list->p_head;
+#ifdef LIST_DOUBLY_LINKED_ENABLE
+	p_new->p_prev      = NULL;
+	if (p_list->p_head)
+	{
+		p_list->p_head->p_prev = p_new;
+	}
+#endif /* LIST_DOUBLY_LINKED_ENABLE */
+	if (NULL == p_list->p_tail)
+	{
+		p_list->p_tail = p_new;
+	}
 	p_list->p_head     = p_new;
 	p_list->size++;
 	return ERROR_SUCCESS;
@@ -78,21 +123,46 @@ error_t list_push_back(list_t *p_list, void *p_data)
 		return ERROR_NO_MEM;
 
 	memcpy(p_new->data, p_data, p_list->element_size);
+	p_new->p_next = NULL;
+#ifdef LIST_DOUBLY_LINKED_ENABLE
+	p_new->p_prev = p_list->p_tail;
+#endif /* LIST_DOUBLY_LINKED_ENABLE */
 
-	list_node_t *p_last = NULL;
-	FOREACH(p_list, p_iter)
-	{
-		p_last = p_iter;
-	}
-
-	if (p_last)
+	if (p_list->p_tail)
 	{
-		p_last->p_next = p_new;
+		p_list->p_tail->p_next = p_new;
 	}
 	else
 	{
 		p_list->p_head = p_new;
 	}
+	p_list->p_tail = p_new;
+	p_list->size++;
+	return ERROR_SUCCESS;
+}
+
+error_t list_insert_after(list_t *p_list, list_node_t *p_pos, void *p_data)
+{
+	if (NULL == p_list || NULL == p_data)
+		return ERROR_INVALID_PARAM;
+
+	if (NULL == p_pos)
+		return list_push_front(p_list, p_data);
+
+	if (p_pos == p_list->p_tail)
+		return list_push_back(p_list, p_data);
+
+	list_node_t *p_new = mem_alloc(p_list);
+	if (NULL == p_new)
+		return ERROR_NO_MEM;
+
+	memcpy(p_new->data, p_data, p_list->element_size);
+	p_new->p_next = p_pos->p_next;
+#ifdef LIST_DOUBLY_LINKED_ENABLE
+	p_new->p_prev = p_pos;
+	p_pos->p_next->p_prev = p_new;
+#endif /* LIST_DOUBLY_LINKED_ENABLE */
+	p_pos->p_next = p_new;
 	p_list->size++;
 	return ERROR_SUCCESS;
 }
@@ -105,10 +175,7 @@ error_t list_pop_front(list_t *p_list)
 	if (NULL == p_list->p_head)
 		return ERROR_SUCCESS;
 
-	list_node_t *p_remove = p_list->p_head;
-	p_list->p_head        = p_list->p_head->p_next;
-	mem_free(p_remove);
-	p_list->size--;
+	node_unlink(p_list, p_list->p_head, NULL);
 	return ERROR_SUCCESS;
 }
 
@@ -122,25 +189,20 @@ error_t list_pop_back(list_t *p_list)
 		return ERROR_SUCCESS;
 	}
 
-	list_node_t *p_entry = p_list->p_head;
+#ifdef LIST_DOUBLY_LINKED_ENABLE
+	node_unlink(p_list, p_list->p_tail, p_list->p_tail->p_prev);
+#else /* LIST_DOUBLY_LINKED_ENABLE */
 	list_node_t *p_prev  = NULL;
-
-	while (p_entry->p_next)
-	{
-		p_prev  = p_entry;
-		p_entry = p_entry->p_next;
-	}
-
-	if (NULL != p_prev)
-	{
-		p_prev->p_next = NULL;
-	}
-	else
+	FOREACH(p_list, p_iter)
 	{
-		p_list->p_head = NULL;
+		if (p_iter->p_next == p_list->p_tail)
+		{
+			p_prev = p_iter;
+			break;
+		}
 	}
-	mem_free(p_entry);
-	p_list->size--;
+	node_unlink(p_list, p_list->p_tail, p_prev);
+#endif /* LIST_DOUBLY_LINKED_ENABLE */
 	return ERROR_SUCCESS;
 }
 
@@ -158,16 +220,7 @@ error_t list_remove_if(list_t *p_list, void *p_remove, predicate_func_t predicat
 	{
 		if (predicate(p_entry->data, p_remove))
 		{
-			if (p_prev)
-			{
-				p_prev->p_next = p_entry->p_next;
-			}
-			else
-			{
-				p_list->p_head = p_entry->p_next;
-			}
-			mem_free(p_entry);
-			p_list->size--;
+			node_unlink(p_list, p_entry, p_prev);
 			return ERROR_SUCCESS;
 		}
 		p_prev  = p_entry;
@@ -183,32 +236,43 @@ error_t list_remove(list_t *p_list, void *p_remove)
 		return ERROR_INVALID_PARAM;
 	}
 
-	list_node_t  *p_entry = p_list->p_head;
+#ifdef LIST_DOUBLY_LINKED_ENABLE
+	list_node_t *p_node     = p_remove;
+	uint8_t     *p_pool     = (uint8_t*)p_list->p_mem_pool;
+	uint8_t     *p_pool_end = p_pool + p_list->pool_used * node_size(p_list);
+
+	if ((uint8_t*)p_node < p_pool || (uint8_t*)p_node >= p_pool_end ||
+	    LIST_STATE_COMMITED != p_node->state)
+	{
+		return ERROR_NOT_FOUND;
+	}
+
+	node_unlink(p_list, p_node, p_node->p_prev);
+	return ERROR_SUCCESS;
+#else /* LIST_DOUBLY_LINKED_ENABLE */
+	list_node_t *p_entry = p_list->p_head;
 	list_node_t *p_prev  = NULL;
 
 	while (p_entry)
 	{
 		if (p_entry == p_remove)
 		{
-			if (p_prev)
-			{
-				p_prev->p_next = p_entry->p_next;
-			}
-			else
-			{
-				p_list->p_head = p_entry->p_next;
-			}
-			mem_free(p_entry);
-			p_list->size--;
+			node_unlink(p_list, p_entry, p_prev);
 			return ERROR_SUCCESS;
 		}
 		p_prev  = p_entry;
 		p_entry = p_entry->p_next;
 	}
 	return ERROR_NOT_FOUND;
+#endif /* LIST_DOUBLY_LINKED_ENABLE */
 }
 
 void* list_item_data_get(list_node_t *p_item)
 {
 	return (void*)p_item->data;
-}
\ No newline at end of file
+}
+
+list_node_t* list_item_node_get(void *p_data)
+{
+	return (list_node_t*)((uint8_t*)p_data - offsetof(list_node_t, data));
+}
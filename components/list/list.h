@@ -6,10 +6,17 @@
 #include <stddef.h>
 #include "error.h"
 
+/* Costs one pointer per node and makes list_pop_back() and list_remove() O(1).
+ * Comment out to fall back to a singly linked list. */
+#define LIST_DOUBLY_LINKED_ENABLE
+
 typedef struct list_node_t
 {
     uint8_t            state;
     struct list_node_t *p_next;
+#ifdef LIST_DOUBLY_LINKED_ENABLE
+    struct list_node_t *p_prev;
+#endif /* LIST_DOUBLY_LINKED_ENABLE */
     uint8_t            data[];
 } list_node_t;
 
@@ -18,7 +25,10 @@ typedef struct
     uint8_t     element_size;
     uint8_t     element_max_num;
     uint8_t     size;
+    uint8_t     pool_used;  /* < Nodes ever handed out from the pool, the rest were never touched. */
     list_node_t *p_head;
+    list_node_t *p_tail;
+    list_node_t *p_free;    /* < Released nodes, linked through p_next. */
     list_node_t *p_mem_pool;
 } list_t;
 
@@ -30,20 +40,30 @@ typedef bool (*predicate_func_t)(void *p_iter, void *p_remove);
         .element_size    = _el_size,                                                        \
         .element_max_num = _el_max_num,                                                     \
         .p_head          = NULL,                                                            \
+        .p_tail          = NULL,                                                            \
+        .p_free          = NULL,                                                            \
         .p_mem_pool      = (list_node_t*)&(_list_name##_mem_pool)};
 
 #define FOREACH(_list, _iter)                                                   \
 for (list_node_t *_iter = (_list)->p_head; _iter != NULL; _iter = _iter->p_next)
 
+/* Same as FOREACH, but _iter may be removed from the list inside the loop. */
+#define FOREACH_SAFE(_list, _iter, _next)                                       \
+for (list_node_t *_iter = (_list)->p_head, *_next = _iter ? _iter->p_next : NULL; \
+     _iter != NULL;                                                             \
+     _iter = _next, _next = _iter ? _iter->p_next : NULL)
+
 void* list_front(list_t *p_list);
 void* list_back(list_t *p_list);
 
 error_t list_push_front(list_t *p_list, void *p_data);
 error_t list_push_back(list_t *p_list, void *p_data);
+error_t list_insert_after(list_t *p_list, list_node_t *p_pos, void *p_data);
 error_t list_pop_front(list_t *p_list);
 error_t list_pop_back(list_t *p_list);
 error_t list_remove_if(list_t *p_list, void *p_remove, predicate_func_t predicate);
 error_t list_remove(list_t *p_list, void *p_remove);
 void*   list_item_data_get(list_node_t *p_item);
+list_node_t* list_item_node_get(void *p_data);
 
 #endif /* FIFO_H__ */
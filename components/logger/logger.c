@@ -41,7 +41,11 @@ void logger_serial_print(uint8_t log_level, const char * format, ...)
 
         if (size > 0)
         {
-            serial_send_block((uint8_t*)log_buf, size + LOG_ERROR_DESC_SIZE);
+            if (size >= (int)(sizeof(log_buf) - LOG_ERROR_DESC_SIZE))
+            {
+                size = sizeof(log_buf) - LOG_ERROR_DESC_SIZE - 1;
+            }
+            serial_send_no_block((uint8_t*)log_buf, size + LOG_ERROR_DESC_SIZE);
         }
     }
 }
@@ -55,5 +59,5 @@ void logger_serial_print_arr(uint8_t log_level, const char *p_str, uint8_t *p_da
         size += sprintf((char *)log_buf + size, "%02X ", p_data[i]);
     }
     size += sprintf((char *)log_buf + size, "\r\n");
-    serial_send_block(log_buf, size);
+    serial_send_no_block(log_buf, size);
 }
\ No newline at end of file
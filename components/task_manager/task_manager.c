@@ -1,93 +1,383 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include "task_manager.h"
 #include "assert.h"
 #include "list.h"
+#include "timer_timestamp.h"
 
-#define TIMER_INTERRUPT_ENABLE() 		(TIMSK0  = (1 << OCIE0A))
-#define TIMER_INTERRUPT_DISABLE()		(TIMSK0  = 0)
+#if defined(TASK_MANAGER_TICKLESS)
+/* Timer1 runs free at F_CPU/64, 4 us per tick for 16 MHz. */
+#define TICKS_PER_MS					(F_CPU / 64 / 1000)
+#define MS_TO_TICKS(_ms)				((uint32_t)(_ms) * TICKS_PER_MS)
+/* Deadlines closer than this are treated as due, arming the compare match would race. */
+#define TICKS_ARM_MARGIN				(4)
+
+#define COMPARE_INTERRUPT_ENABLE()		(TIMSK1 |=  (1 << OCIE1A))
+#define COMPARE_INTERRUPT_DISABLE()		(TIMSK1 &= ~(1 << OCIE1A))
+#endif /* TASK_MANAGER_TICKLESS */
+
+/* Task list and ready queue are also changed by the timebase tick and by task_create() from an ISR. */
+#define TASK_LOCK()						uint8_t _sreg = SREG; cli()
+#define TASK_UNLOCK()					SREG = _sreg
+
+#if defined(TASK_MANAGER_STAT_ENABLE)
+#define STAT_ISR_INC()					(g_isr_cnt++)
+#else /* TASK_MANAGER_STAT_ENABLE */
+#define STAT_ISR_INC()
+#endif /* TASK_MANAGER_STAT_ENABLE */
 
 typedef enum
 {
 	TASK_STATE_IDLE,
-	TASK_STATE_RUN,
+	TASK_STATE_RUN,					/* < Task is in the ready queue. */
 } task_state_t;
 
-typedef struct
+typedef struct task_s
 {
-	task_state_t state;
-	task_func_t  cb;
-	void         *p_param;
-	uint16_t     delay;
-	uint16_t     period;
+#if defined(TASK_MANAGER_TICKLESS)
+	uint32_t        deadline;		/* < Absolute Timer1 tick to run at. */
+#else /* TASK_MANAGER_TICKLESS */
+	uint16_t        delay;
+#endif /* TASK_MANAGER_TICKLESS */
+	task_state_t    state;
+	task_priority_t priority;
+	struct task_s   *p_ready_next;
+	task_func_t     cb;
+	void            *p_param;
+	uint16_t        period;
 } task_t;
 
+typedef struct
+{
+	task_t *p_head;
+	task_t *p_tail;
+} ready_queue_t;
+
 /***********************************************************/
 /*                    Static global vars                   */
 /***********************************************************/
 LIST_INSTANCE(task_list, sizeof(task_t), TASK_MANAGER_MAX_TASK_NUM);
 
+static ready_queue_t    g_ready[TASK_PRIORITY_NUM];
+static volatile uint8_t g_ready_mask;	/* < Bit N is set while g_ready[N] is not empty. */
+
+/* Index of the lowest set bit of a nibble, i.e. the highest ready priority. */
+static const uint8_t g_nibble_lsb[16] = {0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0};
+
+#if defined(TASK_MANAGER_TICKLESS)
+static volatile uint16_t g_overflow_cnt;
+#endif /* TASK_MANAGER_TICKLESS */
+
+#if defined(TASK_MANAGER_STAT_ENABLE)
+static volatile uint32_t g_isr_cnt;
+#endif /* TASK_MANAGER_STAT_ENABLE */
+
 /***********************************************************/
 /*                    Privat function                      */
 /***********************************************************/
-ISR(TIMER0_COMPA_vect)
-{
-    FOREACH(&task_list, p_iter)
-    {
-    	task_t* p_task = list_item_data_get(p_iter);
-    	if (p_task->delay == 0)
-    	{
-    		p_task->state = TASK_STATE_RUN;
-    	}
-    	else
-    	{
-    		p_task->delay--;
-    	}
-    }
+static void ready_push(task_t *p_task)
+{
+	ready_queue_t *p_queue = &g_ready[p_task->priority];
+
+	p_task->state        = TASK_STATE_RUN;
+	p_task->p_ready_next = NULL;
+	if (p_queue->p_tail)
+	{
+		p_queue->p_tail->p_ready_next = p_task;
+	}
+	else
+	{
+		p_queue->p_head = p_task;
+	}
+	p_queue->p_tail = p_task;
+	g_ready_mask |= (1 << p_task->priority);
+}
+
+static task_t* ready_pop(void)
+{
+	task_t *p_task = NULL;
+
+	TASK_LOCK();
+	uint8_t mask = g_ready_mask;
+	if (mask)
+	{
+		uint8_t priority = g_nibble_lsb[mask & 0x0F];
+		ready_queue_t *p_queue = &g_ready[priority];
+
+		p_task          = p_queue->p_head;
+		p_queue->p_head = p_task->p_ready_next;
+		if (NULL == p_queue->p_head)
+		{
+			p_queue->p_tail = NULL;
+			g_ready_mask    = mask & ~(1 << priority);
+		}
+	}
+	TASK_UNLOCK();
+
+	return p_task;
 }
 
+#if defined(TASK_MANAGER_TICKLESS)
+ISR(TIMER1_OVF_vect)
+{
+	STAT_ISR_INC();
+	g_overflow_cnt++;
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+	/* Only wakes the CPU, the due task is picked up by task_proccess(). */
+	STAT_ISR_INC();
+	COMPARE_INTERRUPT_DISABLE();
+}
+
+static uint32_t ticks_get(void)
+{
+	uint8_t sreg = SREG;
+	cli();
+	uint16_t overflow = g_overflow_cnt;
+	uint16_t cnt      = TCNT1;
+	/* Overflow happened but its ISR has not run yet. */
+	if ((TIFR1 & (1 << TOV1)) && cnt < 0x8000)
+	{
+		overflow++;
+	}
+	SREG = sreg;
+	return ((uint32_t)overflow << 16) | cnt;
+}
+
+static error_t task_insert(task_t *p_task)
+{
+	list_node_t *p_pos = NULL;
+	FOREACH(&task_list, p_iter)
+	{
+		task_t *p_next = list_item_data_get(p_iter);
+		if ((int32_t)(p_next->deadline - p_task->deadline) > 0)
+		{
+			break;
+		}
+		p_pos = p_iter;
+	}
+	return list_insert_after(&task_list, p_pos, p_task);
+}
+
+/* Moves every task whose deadline has passed to the ready queue. */
+static void ready_fill(void)
+{
+	TASK_LOCK();
+	uint32_t now = ticks_get();
+	FOREACH(&task_list, p_iter)
+	{
+		task_t *p_task = list_item_data_get(p_iter);
+		if ((int32_t)(now - p_task->deadline) < 0)
+		{
+			break;
+		}
+		if (p_task->state == TASK_STATE_IDLE)
+		{
+			ready_push(p_task);
+		}
+	}
+	TASK_UNLOCK();
+}
+
+static void task_finish(task_t *p_task)
+{
+	TASK_LOCK();
+	task_t task = *p_task;
+	if (list_remove(&task_list, list_item_node_get(p_task)) != ERROR_SUCCESS)
+	{
+		ASSERT(false);
+	}
+
+	if (task.period)
+	{
+		/* From the deadline, not from now, so the run time does not add up over the periods. */
+		task.state     = TASK_STATE_IDLE;
+		task.deadline += MS_TO_TICKS(task.period);
+		if (task_insert(&task) != ERROR_SUCCESS)
+		{
+			ASSERT(false);
+		}
+	}
+	TASK_UNLOCK();
+}
+
+/* Programs the compare match for the earliest deadline, returns false if it is already due. */
+static bool compare_arm(uint32_t deadline)
+{
+	COMPARE_INTERRUPT_DISABLE();
+
+	int32_t delta = (int32_t)(deadline - ticks_get());
+	if (delta <= TICKS_ARM_MARGIN)
+	{
+		return false;
+	}
+
+	/* Further than one Timer1 period, the overflow ISR wakes us up on the way. */
+	if (delta <= 0xFFFF)
+	{
+		OCR1A  = (uint16_t)deadline;
+		TIFR1  = (1 << OCF1A);
+		COMPARE_INTERRUPT_ENABLE();
+	}
+	return true;
+}
+#else /* TASK_MANAGER_TICKLESS */
+/* Runs from the timebase ISR once per millisecond. */
+static void task_tick(void)
+{
+	STAT_ISR_INC();
+	FOREACH(&task_list, p_iter)
+	{
+		task_t* p_task = list_item_data_get(p_iter);
+		if (p_task->state != TASK_STATE_IDLE)
+		{
+			continue;
+		}
+
+		if (p_task->delay == 0)
+		{
+			ready_push(p_task);
+		}
+		else
+		{
+			p_task->delay--;
+		}
+	}
+}
+
+static void task_finish(task_t *p_task)
+{
+	TASK_LOCK();
+	if (p_task->period)
+	{
+		p_task->delay = p_task->period;
+		p_task->state = TASK_STATE_IDLE;
+	}
+	else if (list_remove(&task_list, list_item_node_get(p_task)) != ERROR_SUCCESS)
+	{
+		ASSERT(false);
+	}
+	TASK_UNLOCK();
+}
+#endif /* TASK_MANAGER_TICKLESS */
+
 /***********************************************************/
 /*                    Public API                           */
 /***********************************************************/
+#if defined(TASK_MANAGER_TICKLESS)
 void task_manager_init(void)
 {
-	TIMSK0  = (1 << OCIE0A);                /* < Timer Output Compare Match A Interrupt Enable */
-    TCNT0   = 0;
-    OCR0A   = 250;
-    TCCR0A  = (1 << WGM01); 				/* < Timer mode is CTC */
-    TCCR0B  = (1 << CS01) | (1 << CS00);    /* < Timer prescaler is 64 */
-    /* Should be 1 ms. */
+	TCCR1A  = 0;							/* < Normal mode, timer runs free */
+	TCNT1   = 0;
+	TIFR1   = (1 << TOV1) | (1 << OCF1A);
+	TIMSK1  = (1 << TOIE1);					/* < Only overflow, compare match is armed on demand */
+	TCCR1B  = (1 << CS11) | (1 << CS10);	/* < Timer prescaler is 64 */
+	set_sleep_mode(SLEEP_MODE_IDLE);
 }
 
-error_t task_create(task_func_t task_cb, void *p_param, uint16_t delay, uint16_t period)
+error_t task_create(task_func_t task_cb, void *p_param, uint16_t delay, uint16_t period, task_priority_t priority)
 {
-	task_t new_task = {.state   = TASK_STATE_IDLE,
-	                   .cb      = task_cb,
-	                   .p_param = p_param,
-	                   .delay   = delay,
-	                   .period  = period};
-	return list_push_back(&task_list, &new_task);
+	if (priority >= TASK_PRIORITY_NUM)
+	{
+		return ERROR_INVALID_PARAM;
+	}
+
+	task_t new_task = {.deadline = ticks_get() + MS_TO_TICKS(delay),
+	                   .state    = TASK_STATE_IDLE,
+	                   .priority = priority,
+	                   .cb       = task_cb,
+	                   .p_param  = p_param,
+	                   .period   = period};
+
+	TASK_LOCK();
+	error_t err = task_insert(&new_task);
+	TASK_UNLOCK();
+	return err;
 }
 
 void task_proccess(void)
 {
-	FOREACH(&task_list, p_iter)
-    {
-    	task_t* p_task = list_item_data_get(p_iter);
-    	if (p_task->state == TASK_STATE_RUN)
-    	{
-    		p_task->cb(p_task->p_param);
-    		if (p_task->period)
-    		{
-    			p_task->delay = p_task->period;
-    			p_task->state = TASK_STATE_IDLE;
-    		}
-    		else
-    		{
-    			TIMER_INTERRUPT_DISABLE();
-    			ASSERT(list_remove(&task_list, p_iter) == ERROR_SUCCESS);
-    			TIMER_INTERRUPT_ENABLE();
-    		}
-    	}
-    }
+	task_t *p_task;
+
+	/* Refill after every run, so a task that became due meanwhile can overtake lower priorities. */
+	for (ready_fill(); (p_task = ready_pop()) != NULL; ready_fill())
+	{
+		p_task->cb(p_task->p_param);
+		task_finish(p_task);
+	}
+
+	/* Locked up to the sleep, a task created by an ISR meanwhile would not be armed. */
+	cli();
+	p_task = list_front(&task_list);
+	if (p_task && !compare_arm(p_task->deadline))
+	{
+		sei();
+		return;
+	}
+
+	/* Nothing is due: sleep until the compare match, the overflow or any other interrupt.
+	 * sei() takes effect after sleep_cpu(), so a match that is already pending wakes us at once. */
+	if (!p_task || (int32_t)(p_task->deadline - ticks_get()) > 0)
+	{
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+	}
+	sei();
+}
+#else /* TASK_MANAGER_TICKLESS */
+void task_manager_init(void)
+{
+	/* Timer0 is shared with app_timer, the timebase owns it. */
+	timer_timestamp_init();
+	if (timer_timestamp_subscribe(task_tick) != ERROR_SUCCESS)
+	{
+		ASSERT(false);
+	}
+}
+
+error_t task_create(task_func_t task_cb, void *p_param, uint16_t delay, uint16_t period, task_priority_t priority)
+{
+	if (priority >= TASK_PRIORITY_NUM)
+	{
+		return ERROR_INVALID_PARAM;
+	}
+
+	task_t new_task = {.state    = TASK_STATE_IDLE,
+	                   .priority = priority,
+	                   .cb       = task_cb,
+	                   .p_param  = p_param,
+	                   .delay    = delay,
+	                   .period   = period};
+
+	TASK_LOCK();
+	error_t err = list_push_back(&task_list, &new_task);
+	TASK_UNLOCK();
+	return err;
+}
+
+void task_proccess(void)
+{
+	task_t *p_task;
+	while ((p_task = ready_pop()) != NULL)
+	{
+		p_task->cb(p_task->p_param);
+		task_finish(p_task);
+	}
+}
+#endif /* TASK_MANAGER_TICKLESS */
+
+#if defined(TASK_MANAGER_STAT_ENABLE)
+uint32_t task_manager_isr_cnt_get(void)
+{
+	uint8_t sreg = SREG;
+	cli();
+	uint32_t cnt = g_isr_cnt;
+	SREG = sreg;
+	return cnt;
 }
+#endif /* TASK_MANAGER_STAT_ENABLE */
@@ -4,10 +4,31 @@
 #include "error.h"
 #define TASK_MANAGER_MAX_TASK_NUM				(10)
 
+/* By default tasks are counted down by the 1 ms timer_timestamp tick.
+ * TASK_MANAGER_TICKLESS - instead of the 1 ms tick, keep tasks sorted by
+ * deadline on free running Timer1, arm its compare match for the earliest one
+ * and sleep in task_proccess() while nothing is due.
+ * TASK_MANAGER_STAT_ENABLE - count scheduler ISR invocations. */
+
 typedef void (*task_func_t)(void *p_param);
 
+/* Ready tasks are dispatched highest priority first, FIFO within a priority. */
+typedef enum
+{
+	TASK_PRIORITY_CRITICAL,
+	TASK_PRIORITY_HIGH,
+	TASK_PRIORITY_NORMAL,
+	TASK_PRIORITY_LOW,
+	TASK_PRIORITY_NUM
+} task_priority_t;
+
 void task_manager_init(void);
-error_t task_create(task_func_t task_cb, void *p_param, uint16_t delay, uint16_t period);
+/* May also be called from an ISR. Periodic tasks keep their phase: the next
+ * run is due a period after the previous deadline, not after the run ended. */
+error_t task_create(task_func_t task_cb, void *p_param, uint16_t delay, uint16_t period, task_priority_t priority);
 void task_proccess(void);
+#if defined(TASK_MANAGER_STAT_ENABLE)
+uint32_t task_manager_isr_cnt_get(void);
+#endif /* TASK_MANAGER_STAT_ENABLE */
 
 #endif /* TASK_MANAGER_H__ */
\ No newline at end of file
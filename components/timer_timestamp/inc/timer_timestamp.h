@@ -2,9 +2,34 @@
 #define TIMER_TIMESTAMP_H__
 
 #include <stdint.h>
+#include "error.h"
 
+/* Timer0 timebase shared by every scheduler in the firmware.
+ * The module owns Timer0 and TIMER0_COMPA_vect: CTC mode, prescaler 64,
+ * one compare match per 1 ms and 4 us per TCNT0 count at 16 MHz. */
+
+/* Number of 1 ms tick callbacks that can be subscribed. */
+#ifndef TIMER_TIMESTAMP_MAX_SUBSCRIBERS
+#define TIMER_TIMESTAMP_MAX_SUBSCRIBERS     (2)
+#endif
+
+/* Called from the Timer0 ISR once per millisecond, keep it short. */
+typedef void (*timer_timestamp_tick_cb_t)(void);
+
+/* Starts Timer0, further calls do nothing. */
 void timer_timestamp_init(void);
 
+/* Returns ERROR_NO_MEM when all subscriber slots are taken. */
+error_t timer_timestamp_subscribe(timer_timestamp_tick_cb_t cb);
+
+/* Milliseconds since init, read atomically. */
 uint32_t timer_timestamp_ms_get(void);
 
-#endif /* TIMER_TIMESTAMP_H__ */
\ No newline at end of file
+/* Monotonic microseconds, 4 us resolution, wraps after ~71 minutes.
+ * Cheap enough to timestamp events from interrupt context. */
+uint32_t timer_timestamp_us_get(void);
+
+/* Same clock without the wrap, for long running logs. */
+uint64_t timer_timestamp_us64_get(void);
+
+#endif /* TIMER_TIMESTAMP_H__ */
@@ -1,16 +1,39 @@
+#include <stdbool.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include "timer_timestamp.h"
 
-static volatile uint32_t g_timestamp;
+#define TIMER_PRESCALER         (64)
+#define TIMER_TICKS_PER_MS      (F_CPU / TIMER_PRESCALER / 1000)
+#define TIMER_US_PER_TICK       (1000 / TIMER_TICKS_PER_MS)
+
+static volatile uint32_t         g_timestamp;
+static volatile uint16_t         g_timestamp_epoch;   /* < Wraps of g_timestamp, extends it for the 64-bit clock. */
+static timer_timestamp_tick_cb_t g_subscribers[TIMER_TIMESTAMP_MAX_SUBSCRIBERS];
+static uint8_t                   g_subscribers_num;
+static bool                      g_started;
 
 ISR(TIMER0_COMPA_vect)
 {
-    g_timestamp++;
+    if (++g_timestamp == 0)
+    {
+        g_timestamp_epoch++;
+    }
+
+    for (uint8_t i = 0; i < g_subscribers_num; ++i)
+    {
+        g_subscribers[i]();
+    }
 }
 
 void timer_timestamp_init(void)
 {
+    if (g_started)
+    {
+        return;
+    }
+    g_started = true;
+
     /* TCCR
      * CPU Freq 16Mhz
      * Need interval of 1Ms ==> 0,001/(1/16000000) = 16.000 ticks
@@ -27,16 +50,85 @@ void timer_timestamp_init(void)
      */
     TIMSK0 = (1 << OCIE0A);
 
-    OCR0A = 250 - 1;
+    OCR0A = TIMER_TICKS_PER_MS - 1;
 
-    /* Set prescaler to 64 ; (1 << CS01)|(1 << CS00)
-     * Clear Timer on Compare (CTC) mode ; (1 << WGM02)
+    /* Clear Timer on Compare (CTC) mode is WGM01 for Timer0,
+     * WGM02 alone selects a reserved mode.
+     * Set prescaler to 64 ; (1 << CS01)|(1 << CS00)
      */
-    TCCR0A = 0 ;   
-    TCCR0B |= (1 << WGM02)|(1 << CS01)|(1 << CS00) ;
+    TCCR0A = (1 << WGM01);
+    TCCR0B = (1 << CS01)|(1 << CS00);
+}
+
+error_t timer_timestamp_subscribe(timer_timestamp_tick_cb_t cb)
+{
+    if (!cb)
+    {
+        return ERROR_NULL_PTR;
+    }
+    if (g_subscribers_num >= TIMER_TIMESTAMP_MAX_SUBSCRIBERS)
+    {
+        return ERROR_NO_MEM;
+    }
+
+    /* The ISR reads the count, so publish the slot first. */
+    g_subscribers[g_subscribers_num] = cb;
+    uint8_t sreg = SREG;
+    cli();
+    g_subscribers_num++;
+    SREG = sreg;
+    return ERROR_SUCCESS;
+}
+
+/* Snapshot of the ms counter and TCNT0 that belong to the same millisecond.
+ * Must be called with interrupts disabled. */
+static uint8_t timestamp_capture(uint16_t *p_epoch, uint32_t *p_ms)
+{
+    uint16_t epoch = g_timestamp_epoch;
+    uint32_t ms    = g_timestamp;
+    uint8_t  cnt   = TCNT0;
+    /* Compare match happened but its ISR has not run yet, TCNT0 already restarted.
+     * A match right after the TCNT0 read leaves cnt near the top, so it is not counted twice. */
+    if ((TIFR0 & (1 << OCF0A)) && cnt < (TIMER_TICKS_PER_MS / 2))
+    {
+        if (++ms == 0)
+        {
+            epoch++;
+        }
+    }
+    *p_epoch = epoch;
+    *p_ms    = ms;
+    return cnt;
 }
 
 uint32_t timer_timestamp_ms_get(void)
 {
-    return g_timestamp;
-}
\ No newline at end of file
+    /* 32-bit load is four byte loads on AVR, keep the ISR out of it. */
+    uint8_t sreg = SREG;
+    cli();
+    uint32_t ms = g_timestamp;
+    SREG = sreg;
+    return ms;
+}
+
+uint32_t timer_timestamp_us_get(void)
+{
+    uint16_t epoch;
+    uint32_t ms;
+    uint8_t sreg = SREG;
+    cli();
+    uint8_t cnt = timestamp_capture(&epoch, &ms);
+    SREG = sreg;
+    return ms * 1000 + (uint32_t)cnt * TIMER_US_PER_TICK;
+}
+
+uint64_t timer_timestamp_us64_get(void)
+{
+    uint16_t epoch;
+    uint32_t ms;
+    uint8_t sreg = SREG;
+    cli();
+    uint8_t cnt = timestamp_capture(&epoch, &ms);
+    SREG = sreg;
+    return ((((uint64_t)epoch << 32) | ms) * 1000) + (uint32_t)cnt * TIMER_US_PER_TICK;
+}
@@ -1,23 +1,26 @@
 #include <avr/pgmspace.h>   
+#include <avr/interrupt.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
 #include "ssd1306.h"
 #include "twi.h"
 #include "assert.h"
 #include "logger.h"
 #include "font.h"
 
-#define SSD1306_ADDRESS                         (0b01111000) /* (0b01111010) */
-#define SSD1306_SLA_W                           (SSD1306_ADDRESS)
-
 #define SSD1306_CONTROL_BYTE_COMS               (0b00000000)
 #define SSD1306_CONTROL_BYTE_COM                (0b10000000)
 #define SSD1306_CONTROL_BYTE_DAT                (0b11000000)
 #define SSD1306_CONTROL_BYTE_DATS               (0b01000000)
 
 #define CONTROL_BYTE_SIZE                       (1)
-#define SSD1306_BUFF_SIZE                       (SSD1306_WIDTH * SSD1306_HEIGHT / 8)
-
-#define SSD1306_WRITE(_p_data, _len) twi_send(SSD1306_ADDRESS, _p_data, _len)
+/* Sequential COM pins for 32 rows and less, alternative for 64. */
+#define SSD1306_COMPINS_VALUE                   ((SSD1306_HEIGHT > 32) ? 0x12 : 0x02)
+/* Offset of the page holding row _y, shifts instead of a divide. */
+#define PAGE_OFFSET(_y)                         ((uint16_t)((_y) >> 3) * SSD1306_WIDTH)
 
 #define SSD1306_SETCONTRAST                     0x81
 #define SSD1306_DISPLAYALLON_RESUME             0xA4
@@ -49,15 +52,178 @@
 /*****************************************************************************/
 /*                         Static global vars                                */
 /*****************************************************************************/
-static uint8_t display_buff[SSD1306_BUFF_SIZE + CONTROL_BYTE_SIZE];
-static uint8_t *mp_display_buff = display_buff + CONTROL_BYTE_SIZE;
+/* Drawing always goes to buff. With SSD1306_DOUBLE_BUFFER the dirty spans are
+ * copied to front_buff that is streamed out, so drawing can go on during the transfer. */
+#if defined(SSD1306_DOUBLE_BUFFER)
+#define SSD1306_FRONT_BUFF(_p_display)          ((_p_display)->front_buff)
+#else /* SSD1306_DOUBLE_BUFFER */
+#define SSD1306_FRONT_BUFF(_p_display)          ((_p_display)->buff)
+#endif /* SSD1306_DOUBLE_BUFFER */
+
+/* Control byte of every band data transfer, the same for all panels. */
+static uint8_t m_data_control = SSD1306_CONTROL_BYTE_DATS;
 
 /*****************************************************************************/
 /*                         Static function                                   */
 /*****************************************************************************/
+/* Marks the same columns on a range of pages, called once per primitive. */
+static void dirty_mark(ssd1306_t *p_display, uint8_t page_first, uint8_t page_last, uint8_t x_min, uint8_t x_max)
+{
+    /* update_start() may take the dirty spans from the TWI interrupt. */
+    uint8_t sreg = SREG;
+    cli();
+    for (uint8_t page = page_first; page <= page_last; ++page)
+    {
+        if (x_min < p_display->dirty_min[page])
+        {
+            p_display->dirty_min[page] = x_min;
+        }
+        if (x_max > p_display->dirty_max[page])
+        {
+            p_display->dirty_max[page] = x_max;
+        }
+    }
+    SREG = sreg;
+}
+
+static void dirty_all(ssd1306_t *p_display)
+{
+    uint8_t sreg = SREG;
+    cli();
+    for (uint8_t page = 0; page < SSD1306_PAGES; ++page)
+    {
+        p_display->dirty_min[page] = 0;
+        p_display->dirty_max[page] = SSD1306_WIDTH - 1;
+    }
+    SREG = sreg;
+}
+
+static inline void byte_apply(ssd1306_mode_t mode, uint8_t *p_byte, uint8_t mask)
+{
+    switch (mode)
+    {
+        case SSD1306_MODE_CLEAR: *p_byte &= ~mask; break;
+        case SSD1306_MODE_XOR:   *p_byte ^=  mask; break;
+        case SSD1306_MODE_SET:
+        default:                 *p_byte |=  mask; break;
+    }
+}
+
+/* Draws one glyph page into one buffer page. The glyph bytes are shifted down
+ * (or up for the lower part of a straddling glyph), cell is the mask of the
+ * buffer rows the glyph cell covers. */
+static void glyph_page_draw(ssd1306_mode_t mode, uint8_t *p_byte, const uint8_t *p_glyph,
+                            uint8_t columns, uint8_t cell, uint8_t shift, bool shift_right)
+{
+    for (uint8_t i = 0; i < columns; ++i, ++p_byte)
+    {
+        uint8_t bits = pgm_read_byte(p_glyph + i);
+        bits = (shift_right ? (bits >> shift) : (uint8_t)(bits << shift)) & cell;
+        switch (mode)
+        {
+            case SSD1306_MODE_CLEAR: *p_byte = (*p_byte & ~cell) | (cell & ~bits); break;
+            case SSD1306_MODE_XOR:   *p_byte ^= bits;                             break;
+            case SSD1306_MODE_SET:
+            default:                 *p_byte = (*p_byte & ~cell) | bits;          break;
+        }
+    }
+}
+
+/* Queues the next dirty band, returns false when all bands are sent. */
+static bool band_send_next(ssd1306_t *p_display)
+{
+    for (; p_display->band_page < SSD1306_PAGES; ++p_display->band_page)
+    {
+        uint8_t page = p_display->band_page;
+        if (p_display->band_min[page] > p_display->band_max[page])
+        {
+            continue;
+        }
+
+        p_display->band_cmd[2] = p_display->band_min[page];
+        p_display->band_cmd[3] = p_display->band_max[page];
+        p_display->band_cmd[5] = page;
+        p_display->band_cmd[6] = page;
+        p_display->band_data_segments[1].p_buff = &SSD1306_FRONT_BUFF(p_display)[page * SSD1306_WIDTH + p_display->band_min[page]];
+        p_display->band_data_segments[1].len    = p_display->band_max[page] - p_display->band_min[page] + 1;
+        p_display->band_page++;
+
+        twi_transaction_push(&p_display->band_cmd_transaction);
+        twi_transaction_push(&p_display->band_data_transaction);
+        return true;
+    }
+    return false;
+}
+
+/* Empty span of a page is min > max. Interrupts must be disabled. */
+static void dirty_none(ssd1306_t *p_display)
+{
+    for (uint8_t page = 0; page < SSD1306_PAGES; ++page)
+    {
+        p_display->dirty_min[page] = 0xFF;
+        p_display->dirty_max[page] = 0;
+    }
+}
+
+/* Moves the dirty spans to the bands to send. Interrupts must be disabled. */
+static void spans_take(ssd1306_t *p_display)
+{
+    memcpy(p_display->band_min, p_display->dirty_min, sizeof(p_display->band_min));
+    memcpy(p_display->band_max, p_display->dirty_max, sizeof(p_display->band_max));
+    dirty_none(p_display);
+    p_display->update_busy = 1;
+}
+
+#if defined(SSD1306_DOUBLE_BUFFER)
+/* Front buffer is not on the bus yet, bring the bands up to date. */
+static void front_copy(ssd1306_t *p_display)
+{
+    for (uint8_t page = 0; page < SSD1306_PAGES; ++page)
+    {
+        if (p_display->band_min[page] > p_display->band_max[page])
+        {
+            continue;
+        }
+        uint16_t offset = page * SSD1306_WIDTH + p_display->band_min[page];
+        memcpy(&p_display->front_buff[offset], &p_display->buff[offset], p_display->band_max[page] - p_display->band_min[page] + 1);
+    }
+}
+#endif /* SSD1306_DOUBLE_BUFFER */
+
+static void bands_start(ssd1306_t *p_display)
+{
+    p_display->band_page = 0;
+    if (!band_send_next(p_display))
+    {
+        p_display->update_busy = 0;
+    }
+}
+
+static void band_complete(twi_transaction_t *p_transaction, uint8_t status)
+{
+    ssd1306_t *p_display = p_transaction->p_context;
+
+    if (band_send_next(p_display))
+    {
+        return;
+    }
+
+    p_display->update_busy = 0;
+    /* An update was asked for while this one was on the bus, send the new spans.
+     * A double buffer is flipped here, from the TWI interrupt. */
+    if (p_display->update_pending)
+    {
+        p_display->update_pending = 0;
+        spans_take(p_display);
+#if defined(SSD1306_DOUBLE_BUFFER)
+        front_copy(p_display);
+#endif /* SSD1306_DOUBLE_BUFFER */
+        bands_start(p_display);
+    }
+}
 
-/* Init sequence for 128x32 OLED module */
-const uint8_t init_sequence[] PROGMEM = {
+/* Init sequence for the configured panel, sent straight from flash */
+static const uint8_t init_sequence[] PROGMEM = {
     SSD1306_CONTROL_BYTE_COMS,
     SSD1306_DISPLAYOFF,         //display off
     SSD1306_MEMORYMODE,         //Set Memory Addressing Mode   
@@ -72,7 +238,7 @@ const uint8_t init_sequence[] PROGMEM = {
     0xA1,                       //--set segment re-map 0 to 127
     SSD1306_NORMALDISPLAY,      //--set normal display
     SSD1306_SETMULTIPLEX,       //--set multiplex ratio(1 to 64)
-    0x3F,                       //
+    SSD1306_HEIGHT - 1,         //
     SSD1306_DISPLAYALLON_RESUME,//0xa4,Output follows RAM content;0xa5,Output ignores RAM content
     SSD1306_SETDISPLAYOFFSET,   //-set display offset
     0x00,                       //-not offset
@@ -81,7 +247,7 @@ const uint8_t init_sequence[] PROGMEM = {
     SSD1306_SETPRECHARGE,       //--set pre-charge period
     0x22,                       //
     SSD1306_SETCOMPINS,         //--set com pins hardware configuration
-    0x02,                       //
+    SSD1306_COMPINS_VALUE,      //
     SSD1306_SETVCOMDETECT,      //--set vcomh
     0x20,                       //0x20,0.77xVcc
     SSD1306_CHARGEPUMP,         //--set DC-DC enable
@@ -89,82 +255,371 @@ const uint8_t init_sequence[] PROGMEM = {
     SSD1306_DISPLAYON           //
 };
 
-
 /*****************************************************************************/
 /*                         Public API                                        */
 /*****************************************************************************/
-void ssd1306_init(void)
+void ssd1306_init(ssd1306_t *p_display, uint8_t address)
 {
 	if (twi_initialized() != ERROR_SUCCESS)
 	{
 		twi_init(TWI_SCL_100KHZ, NULL, NULL);
 	}
 
-	/* A little delay */
-    uint32_t delay = 0xFFFFFFFF;
-    while(delay--);
+    memset(p_display, 0, sizeof(*p_display));
+    p_display->p_font = &ssd1306_font_6x8;
+
+    p_display->init_segment.dir                 = TWI_SEGMENT_WRITE_P;
+    p_display->init_segment.p_buff              = (uint8_t*)init_sequence;
+    p_display->init_segment.len                 = sizeof(init_sequence);
+    p_display->init_transaction.slave_addr      = address;
+    p_display->init_transaction.p_segments      = &p_display->init_segment;
+    p_display->init_transaction.segments_num    = 1;
+
+    /* Column and page range are filled in per band. */
+    p_display->band_cmd[0]                      = SSD1306_CONTROL_BYTE_COMS;
+    p_display->band_cmd[1]                      = SSD1306_COLUMNADDR;
+    p_display->band_cmd[4]                      = SSD1306_PAGEADDR;
+    p_display->band_cmd_segment.dir             = TWI_SEGMENT_WRITE;
+    p_display->band_cmd_segment.p_buff          = p_display->band_cmd;
+    p_display->band_cmd_segment.len             = sizeof(p_display->band_cmd);
+    p_display->band_cmd_transaction.slave_addr  = address;
+    p_display->band_cmd_transaction.p_segments  = &p_display->band_cmd_segment;
+    p_display->band_cmd_transaction.segments_num = 1;
+
+    p_display->band_data_segments[0].dir        = TWI_SEGMENT_WRITE;
+    p_display->band_data_segments[0].p_buff     = &m_data_control;
+    p_display->band_data_segments[0].len        = CONTROL_BYTE_SIZE;
+    p_display->band_data_segments[1].dir        = TWI_SEGMENT_WRITE;
+    p_display->band_data_transaction.slave_addr = address;
+    p_display->band_data_transaction.p_segments = p_display->band_data_segments;
+    p_display->band_data_transaction.segments_num = 2;
+    p_display->band_data_transaction.cb         = band_complete;
+    p_display->band_data_transaction.p_context  = p_display;
+
+    /* Drawing is allowed right away, updates wait for ssd1306_power_up(). */
+    uint8_t sreg = SREG;
+    cli();
+    dirty_none(p_display);
+    p_display->update_busy = 1;
+    SREG = sreg;
+}
 
+/* Panel is powered, send the init sequence and the first frame. Until now
+ * updates were held back as busy, the frame has everything drawn so far. */
+void ssd1306_power_up(ssd1306_t *p_display)
+{
+    if (p_display->ready)
+    {
+        return;
+    }
+
+    /* The TWI queue keeps the order, the first frame goes after the init sequence. */
+    twi_transaction_push(&p_display->init_transaction);
+
+    uint8_t sreg = SREG;
+    cli();
+    p_display->update_busy    = 0;
+    p_display->update_pending = 0;
+    p_display->ready          = 1;
+    SREG = sreg;
+
+    ssd1306_update(p_display);
+}
+
+bool ssd1306_ready(ssd1306_t *p_display)
+{
+    return p_display->ready;
+}
+
+error_t ssd1306_update(ssd1306_t *p_display)
+{
+    dirty_all(p_display);
+    return ssd1306_update_partial(p_display);
+}
 
-    uint8_t commandSequence[sizeof(init_sequence)];
-    for (uint8_t i = 0; i < sizeof (init_sequence); i++)
+error_t ssd1306_update_partial(ssd1306_t *p_display)
+{
+    uint8_t sreg = SREG;
+    cli();
+    if (p_display->update_busy)
     {
-        commandSequence[i] = (pgm_read_byte(&init_sequence[i]));
+        /* Latched, band_complete() starts it once the bus is free. */
+        p_display->update_pending = 1;
+        SREG = sreg;
+        return ERROR_SUCCESS;
     }
+    spans_take(p_display);
+    SREG = sreg;
+
+#if defined(SSD1306_DOUBLE_BUFFER)
+    front_copy(p_display);
+#endif /* SSD1306_DOUBLE_BUFFER */
+    bands_start(p_display);
+    return ERROR_SUCCESS;
+}
+
+bool ssd1306_busy(ssd1306_t *p_display)
+{
+    return p_display->update_busy;
+}
 
-    SSD1306_WRITE(commandSequence, sizeof(commandSequence));
-    ssd1306_update();	
+void ssd1306_draw_mode_set(ssd1306_t *p_display, ssd1306_mode_t mode)
+{
+    p_display->draw_mode = mode;
 }
 
-void ssd1306_update(void)
-{    
-    display_buff[0] = SSD1306_CONTROL_BYTE_DATS;
-    SSD1306_WRITE(display_buff, sizeof(display_buff));
+void ssd1306_clear(ssd1306_t *p_display)
+{
+    memset(p_display->buff, 0, sizeof(p_display->buff));
+    dirty_all(p_display);
 }
 
-void ssd1306_draw_pixel(uint8_t x, uint8_t y)
+void ssd1306_draw_pixel(ssd1306_t *p_display, uint8_t x, uint8_t y)
 {
     if (x >= SSD1306_WIDTH || y >= SSD1306_HEIGHT)
     {
         return;
     }
-    
-    mp_display_buff[x + (y / 8) * SSD1306_WIDTH] |= (1 << (y % 8));
+
+    byte_apply(p_display->draw_mode, &p_display->buff[PAGE_OFFSET(y) + x], 1 << (y & 7));
+    dirty_mark(p_display, y >> 3, y >> 3, x, x);
+}
+
+void ssd1306_line_v(ssd1306_t *p_display, uint8_t x, uint8_t y, uint8_t height)
+{
+    ssd1306_fill_rect(p_display, x, y, 1, height);
+}
+
+void ssd1306_line_h(ssd1306_t *p_display, uint8_t x, uint8_t y, uint8_t width)
+{
+    ssd1306_fill_rect(p_display, x, y, width, 1);
+}
+
+void ssd1306_rect(ssd1306_t *p_display, uint8_t x, uint8_t y, uint8_t width, uint8_t height)
+{
+    if (width == 0 || height == 0)
+    {
+        return;
+    }
+
+    /* Far edges are computed wide, a rect running off screen must not wrap around. */
+    uint16_t x_end = (uint16_t)x + width  - 1;
+    uint16_t y_end = (uint16_t)y + height - 1;
+
+    ssd1306_line_h(p_display, x, y, width);
+    if (height > 1 && y_end < SSD1306_HEIGHT)
+    {
+        ssd1306_line_h(p_display, x, y_end, width);
+    }
+    /* Corners are already drawn, XOR must not flip them back. */
+    if (height > 2)
+    {
+        ssd1306_line_v(p_display, x, y + 1, height - 2);
+        if (width > 1 && x_end < SSD1306_WIDTH)
+        {
+            ssd1306_line_v(p_display, x_end, y + 1, height - 2);
+        }
+    }
 }
 
-void ssd1306_line_v(uint8_t x, uint8_t y, uint8_t height)
+void ssd1306_fill_rect(ssd1306_t *p_display, uint8_t x, uint8_t y, uint8_t width, uint8_t height)
 {
-    for (uint8_t i = 0; i < height; ++i)
+    if (x >= SSD1306_WIDTH || y >= SSD1306_HEIGHT || width == 0 || height == 0)
     {
-        ssd1306_draw_pixel(x, y + i);
+        return;
     }
+
+    uint8_t x_end = (width  > SSD1306_WIDTH  - x) ? SSD1306_WIDTH  - 1 : x + width  - 1;
+    uint8_t y_end = (height > SSD1306_HEIGHT - y) ? SSD1306_HEIGHT - 1 : y + height - 1;
+
+    uint8_t page_first = y >> 3;
+    uint8_t page_last  = y_end >> 3;
+    for (uint8_t page = page_first; page <= page_last; ++page)
+    {
+        /* Rows of this page covered by the rect, as one byte mask. */
+        uint8_t mask = 0xFF;
+        if (page == page_first)
+        {
+            mask &= 0xFF << (y & 7);
+        }
+        if (page == page_last)
+        {
+            mask &= 0xFF >> (7 - (y_end & 7));
+        }
+
+        uint8_t *p_byte = &p_display->buff[page * SSD1306_WIDTH + x];
+        uint8_t *p_end  = p_byte + (x_end - x) + 1;
+        switch (p_display->draw_mode)
+        {
+            case SSD1306_MODE_CLEAR: mask = ~mask; while (p_byte != p_end) *p_byte++ &= mask; break;
+            case SSD1306_MODE_XOR:                 while (p_byte != p_end) *p_byte++ ^= mask; break;
+            case SSD1306_MODE_SET:
+            default:                               while (p_byte != p_end) *p_byte++ |= mask; break;
+        }
+    }
+    dirty_mark(p_display, page_first, page_last, x, x_end);
 }
-void ssd1306_line_h(uint8_t x, uint8_t y, uint8_t width)
+
+void ssd1306_line(ssd1306_t *p_display, uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
 {
-    for (uint8_t i = 0; i < width; ++i)
+    if (x0 == x1 || y0 == y1)
+    {
+        uint8_t x = (x0 < x1) ? x0 : x1;
+        uint8_t y = (y0 < y1) ? y0 : y1;
+        ssd1306_fill_rect(p_display, x, y, ((x0 < x1) ? x1 - x0 : x0 - x1) + 1, ((y0 < y1) ? y1 - y0 : y0 - y1) + 1);
+        return;
+    }
+
+    /* Bresenham, every pixel hits the buffer directly, the bounding box is marked dirty once. */
+    int16_t dx    =  (x0 < x1) ? x1 - x0 : x0 - x1;
+    int16_t dy    = -((y0 < y1) ? y1 - y0 : y0 - y1);
+    int8_t  sx    = (x0 < x1) ? 1 : -1;
+    int8_t  sy    = (y0 < y1) ? 1 : -1;
+    int16_t error = dx + dy;
+    uint8_t x     = x0;
+    uint8_t y     = y0;
+
+    for (;;)
+    {
+        if (x < SSD1306_WIDTH && y < SSD1306_HEIGHT)
+        {
+            byte_apply(p_display->draw_mode, &p_display->buff[PAGE_OFFSET(y) + x], 1 << (y & 7));
+        }
+        if (x == x1 && y == y1)
+        {
+            break;
+        }
+
+        int16_t error2 = error * 2;
+        if (error2 >= dy)
+        {
+            error += dy;
+            x     += sx;
+        }
+        if (error2 <= dx)
+        {
+            error += dx;
+            y     += sy;
+        }
+    }
+
+    uint8_t x_min = (x0 < x1) ? x0 : x1;
+    uint8_t x_max = (x0 < x1) ? x1 : x0;
+    uint8_t y_min = (y0 < y1) ? y0 : y1;
+    uint8_t y_max = (y0 < y1) ? y1 : y0;
+    if (x_min >= SSD1306_WIDTH || y_min >= SSD1306_HEIGHT)
     {
-        ssd1306_draw_pixel(x + i, y);
+        return;
     }
+    if (x_max >= SSD1306_WIDTH)
+    {
+        x_max = SSD1306_WIDTH - 1;
+    }
+    if (y_max >= SSD1306_HEIGHT)
+    {
+        y_max = SSD1306_HEIGHT - 1;
+    }
+    dirty_mark(p_display, y_min >> 3, y_max >> 3, x_min, x_max);
 }
-void ssd1306_rect(uint8_t x, uint8_t y, uint8_t width, uint8_t height)
+
+void ssd1306_font_set(ssd1306_t *p_display, const ssd1306_font_t *p_font)
 {
-    ssd1306_line_h(x, y, width);
-    ssd1306_line_v(x, y, height);
-    ssd1306_line_v(x + width-1, y, height);
-    ssd1306_line_h(x, y + height-1, width);
+    p_display->p_font = p_font ? p_font : &ssd1306_font_6x8;
 }
 
-void ssd1306_putc(uint8_t x, uint8_t y, char c)
+uint8_t ssd1306_putc(ssd1306_t *p_display, uint8_t x, uint8_t y, char c)
 {
-    char index = c - ' ';
-    if((index < 0) || (index > '~' - ' '))
+    const ssd1306_font_t *p_font = p_display->p_font;
+    if (c < p_font->first || c > p_font->last)
     {
-        return;
+        return x;
+    }
+    if (x >= SSD1306_WIDTH || y >= SSD1306_HEIGHT)
+    {
+        return x + p_font->width;
+    }
+
+    uint8_t glyph_pages = (p_font->height + 7) >> 3;
+    uint8_t columns     = (p_font->width > SSD1306_WIDTH - x) ? SSD1306_WIDTH - x : p_font->width;
+    uint8_t shift       = y & 7;
+    uint8_t page        = y >> 3;
+    const uint8_t *p_glyph = p_font->p_glyphs + (uint16_t)(c - p_font->first) * p_font->width * glyph_pages;
+
+    for (uint8_t glyph_page = 0; glyph_page < glyph_pages; ++glyph_page, ++page)
+    {
+        /* Rows of the cell in this glyph page, the last one may be partial. */
+        uint8_t rows = p_font->height - (glyph_page << 3);
+        uint8_t cell = (rows >= 8) ? 0xFF : (uint8_t)(0xFF >> (8 - rows));
+
+        /* Glyph byte straddles two buffer pages unless y is page aligned. */
+        if (page < SSD1306_PAGES)
+        {
+            glyph_page_draw(p_display->draw_mode, &p_display->buff[page * SSD1306_WIDTH + x], p_glyph, columns,
+                            cell << shift, shift, false);
+        }
+        if (shift && page + 1 < SSD1306_PAGES)
+        {
+            glyph_page_draw(p_display->draw_mode, &p_display->buff[(page + 1) * SSD1306_WIDTH + x], p_glyph, columns,
+                            cell >> (8 - shift), 8 - shift, true);
+        }
+        p_glyph += p_font->width;
     }
 
-    uint8_t map[CHAR_WIDTH];
-    char_map_get(index, map);
-    for (uint8_t i = 0; i < CHAR_WIDTH; ++i)
+    /* Pages the cell rows fall on. A straddling glyph can also write an empty mask
+     * to the page below, that one stays clean. */
+    uint16_t y_end = (uint16_t)y + p_font->height - 1;
+    dirty_mark(p_display, y >> 3, (y_end < SSD1306_HEIGHT) ? y_end >> 3 : SSD1306_PAGES - 1,
+               x, x + columns - 1);
+
+    return x + p_font->width;
+}
+
+static uint8_t puts_generic(ssd1306_t *p_display, uint8_t x, uint8_t y, const char *p_str, bool progmem)
+{
+    uint8_t x_start = x;
+    for (;;)
     {
-        mp_display_buff[(x + i) + (y / 8) * SSD1306_WIDTH] = map[i];
+        char c = progmem ? pgm_read_byte(p_str) : *p_str;
+        if (c == '\0')
+        {
+            break;
+        }
+        p_str++;
+
+        if (c == '\n')
+        {
+            x  = x_start;
+            y += p_display->p_font->height;
+            continue;
+        }
+        /* Nothing further right is visible, just skip to the next line. */
+        if (x >= SSD1306_WIDTH)
+        {
+            continue;
+        }
+        x = ssd1306_putc(p_display, x, y, c);
     }
-}
\ No newline at end of file
+    return x;
+}
+
+uint8_t ssd1306_puts(ssd1306_t *p_display, uint8_t x, uint8_t y, const char *p_str)
+{
+    return puts_generic(p_display, x, y, p_str, false);
+}
+
+uint8_t ssd1306_puts_P(ssd1306_t *p_display, uint8_t x, uint8_t y, const char *p_str)
+{
+    return puts_generic(p_display, x, y, p_str, true);
+}
+
+uint8_t ssd1306_printf(ssd1306_t *p_display, uint8_t x, uint8_t y, const char *p_format, ...)
+{
+    char buff[SSD1306_PRINTF_BUFF_SIZE];
+
+    va_list args;
+    va_start(args, p_format);
+    vsnprintf(buff, sizeof(buff), p_format, args);
+    va_end(args);
+
+    return ssd1306_puts(p_display, x, y, buff);
+}
@@ -2,16 +2,125 @@
 #define SSD1306__H__
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "error.h"
+#include "twi.h"
 
+/* Panel geometry, override from the project Makefile, e.g. CFLAGS += -DSSD1306_HEIGHT=64.
+ * All panels of a build share it, each one has its own address and buffers. */
+#ifndef SSD1306_WIDTH
 #define SSD1306_WIDTH 		(128)
+#endif
+#ifndef SSD1306_HEIGHT
 #define SSD1306_HEIGHT		(32)
+#endif
+/* 8-bit write address for ssd1306_init(), 0x78 or 0x7A selected by the SA0 pin. */
+#ifndef SSD1306_ADDRESS
+#define SSD1306_ADDRESS		(0b01111000)
+#endif
 
-void ssd1306_init(void);
-void ssd1306_update(void);
-void ssd1306_draw_pixel(uint8_t x, uint8_t y);
-void ssd1306_line_v(uint8_t x, uint8_t y, uint8_t height);
-void ssd1306_line_h(uint8_t x, uint8_t y, uint8_t width);
-void ssd1306_rect(uint8_t x, uint8_t y, uint8_t width, uint8_t height);
-void ssd1306_putc(uint8_t x, uint8_t y, char c);
+#if (SSD1306_HEIGHT % 8) || (SSD1306_HEIGHT > 64) || (SSD1306_WIDTH > 128)
+#error "SSD1306 supports up to 128x64, height must be a multiple of 8."
+#endif
+
+#define SSD1306_PAGES       (SSD1306_HEIGHT / 8)
+#define SSD1306_BUFF_SIZE   (SSD1306_WIDTH * SSD1306_PAGES)
+
+/* SSD1306_DOUBLE_BUFFER - draw into a back buffer and stream a front copy,
+ * tear free, costs a second frame buffer of RAM. */
+
+/* How drawing primitives combine with the pixels already in the buffer. */
+typedef enum
+{
+    SSD1306_MODE_SET,
+    SSD1306_MODE_CLEAR,
+    SSD1306_MODE_XOR
+} ssd1306_mode_t;
+
+/* Glyphs live in PROGMEM, column bytes with bit 0 on top. A glyph taller than
+ * 8 rows is stored page after page, width bytes each. */
+typedef struct
+{
+    const uint8_t   *p_glyphs;
+    uint8_t         width;
+    uint8_t         height;
+    char            first;
+    char            last;
+} ssd1306_font_t;
+
+extern const ssd1306_font_t ssd1306_font_6x8;
+
+/* One panel. Allocate it statically and pass it to every call,
+ * the fields are only for internal usage. */
+typedef struct
+{
+    uint8_t                 buff[SSD1306_BUFF_SIZE];
+#if defined(SSD1306_DOUBLE_BUFFER)
+    uint8_t                 front_buff[SSD1306_BUFF_SIZE];
+#endif /* SSD1306_DOUBLE_BUFFER */
+    ssd1306_mode_t          draw_mode;
+    const ssd1306_font_t    *p_font;
+    uint8_t                 dirty_min[SSD1306_PAGES];   /* < Columns touched per page, clean when min > max. */
+    uint8_t                 dirty_max[SSD1306_PAGES];
+    uint8_t                 band_min[SSD1306_PAGES];    /* < Bands of the update on the bus. */
+    uint8_t                 band_max[SSD1306_PAGES];
+    uint8_t                 band_page;
+    volatile uint8_t        update_busy;
+    volatile uint8_t        update_pending;
+    volatile uint8_t        ready;
+    uint8_t                 band_cmd[7];
+    twi_segment_t           band_cmd_segment;
+    twi_segment_t           band_data_segments[2];
+    twi_segment_t           init_segment;
+    twi_transaction_t       band_cmd_transaction;
+    twi_transaction_t       band_data_transaction;
+    twi_transaction_t       init_transaction;
+} ssd1306_t;
+
+/* Size of the buffer ssd1306_printf() formats into. */
+#ifndef SSD1306_PRINTF_BUFF_SIZE
+#define SSD1306_PRINTF_BUFF_SIZE    (32)
+#endif
+
+/* Panel supply has to settle before the init sequence. */
+#ifndef SSD1306_POWER_UP_MS
+#define SSD1306_POWER_UP_MS         (100)
+#endif
+
+/* Non-blocking. Drawing is allowed at once, updates are held back until the
+ * application calls ssd1306_power_up() SSD1306_POWER_UP_MS later from whatever
+ * timebase it already runs. ssd1306_ready() tells when the panel is on.
+ * Panels on the same bus share the TWI queue, their updates interleave by band. */
+void ssd1306_init(ssd1306_t *p_display, uint8_t address);
+void ssd1306_power_up(ssd1306_t *p_display);
+bool ssd1306_ready(ssd1306_t *p_display);
+
+/* Sends the whole frame buffer. */
+error_t ssd1306_update(ssd1306_t *p_display);
+/* Sends only the columns drawn since the last update, one band per page.
+ * Non-blocking. A call while an update is on the bus is latched and sent when
+ * that one completes, calls in between merge into it. With a double buffer the
+ * flip is then done from the TWI interrupt, a primitive drawn at that moment
+ * may reach the panel over two updates. */
+error_t ssd1306_update_partial(ssd1306_t *p_display);
+bool    ssd1306_busy(ssd1306_t *p_display);
+void ssd1306_draw_mode_set(ssd1306_t *p_display, ssd1306_mode_t mode);
+void ssd1306_clear(ssd1306_t *p_display);
+void ssd1306_draw_pixel(ssd1306_t *p_display, uint8_t x, uint8_t y);
+void ssd1306_line_v(ssd1306_t *p_display, uint8_t x, uint8_t y, uint8_t height);
+void ssd1306_line_h(ssd1306_t *p_display, uint8_t x, uint8_t y, uint8_t width);
+void ssd1306_line(ssd1306_t *p_display, uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1);
+void ssd1306_rect(ssd1306_t *p_display, uint8_t x, uint8_t y, uint8_t width, uint8_t height);
+void ssd1306_fill_rect(ssd1306_t *p_display, uint8_t x, uint8_t y, uint8_t width, uint8_t height);
+
+/* Text goes at any pixel position and is clipped at the screen edges.
+ * SET draws the glyph cell opaque, CLEAR draws it inverted, XOR flips the
+ * glyph pixels only. '\n' returns to x of the call and moves one line down.
+ * All return the x position after the last glyph. */
+void    ssd1306_font_set(ssd1306_t *p_display, const ssd1306_font_t *p_font);
+uint8_t ssd1306_putc(ssd1306_t *p_display, uint8_t x, uint8_t y, char c);
+uint8_t ssd1306_puts(ssd1306_t *p_display, uint8_t x, uint8_t y, const char *p_str);
+uint8_t ssd1306_puts_P(ssd1306_t *p_display, uint8_t x, uint8_t y, const char *p_str);
+uint8_t ssd1306_printf(ssd1306_t *p_display, uint8_t x, uint8_t y, const char *p_format, ...);
 
 #endif /* SSD1306__H__ */
\ No newline at end of file
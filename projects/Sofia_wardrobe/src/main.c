@@ -9,6 +9,7 @@
 #include "task_manager.h"
 #include "logger.h"
 
+static ssd1306_t m_display;
 
 static int uart_putchar(char c, FILE * stream)
 {
@@ -33,8 +34,13 @@ static void task_draw_pixel(void *p_param)
 	// static uint8_t x, y;
 	// x = rand() % 128;
 	// y = rand() % 32;
-	// ssd1306_draw_pixel(x, y);
-	// ssd1306_update();
+	// ssd1306_draw_pixel(&m_display, x, y);
+	// ssd1306_update(&m_display);
+}
+
+static void task_display_power_up(void *p_param)
+{
+	ssd1306_power_up(p_param);
 }
 int main()
 {
@@ -44,18 +50,20 @@ int main()
 	LED_DEBUG_INIT();
 	INTERRUPT_ENABLE();
 	serial_init();
-	ssd1306_init();
+	task_manager_init();
+	ssd1306_init(&m_display, SSD1306_ADDRESS);
+	/* One-shot on the tickless timer, a Timer0 timebase would wake the sleep every ms. */
+	task_create(task_display_power_up, &m_display, SSD1306_POWER_UP_MS, 0, TASK_PRIORITY_HIGH);
 	
-	ssd1306_putc(0, 0, 'M');
-	ssd1306_rect(50, 5, 50, 20);
-	ssd1306_update();
+	ssd1306_putc(&m_display, 0, 0, 'M');
+	ssd1306_rect(&m_display, 50, 5, 50, 20);
+	ssd1306_update(&m_display);
 
-	task_manager_init();
-	task_create(task_sys_led_on,  0, 0, 2000);
-	task_create(task_sys_led_off, 0, 1000, 2000);
-	task_create(task_draw_pixel,  0, 0, 5000);
+	task_create(task_sys_led_on,  0, 0, 2000, TASK_PRIORITY_NORMAL);
+	task_create(task_sys_led_off, 0, 1000, 2000, TASK_PRIORITY_NORMAL);
+	task_create(task_draw_pixel,  0, 0, 5000, TASK_PRIORITY_LOW);
 	for(;;)
 	{
-		task_proccess();		
+		task_proccess();
 	}
 }
\ No newline at end of file
@@ -68,9 +68,25 @@ static void ce_init(void)
     CE_DDR  |= (1 << CE_PIN);
 }
 
-static void delay(uint32_t ms)
+static void radio_rx_cb(uint8_t pipe, uint8_t *p_data, uint8_t len)
 {
-    _delay_ms(150);
+    __LOG(LOG_LEVEL_DEBUG, "PKT_RECEIVED: pipe %u\r\n", pipe);
+    __LOG_XB(LOG_LEVEL_DEBUG, "DATA RAW: ", p_data, len);
+}
+
+static void node_handler(uint8_t *p_data, uint8_t len, void *p_context)
+{
+    uint8_t *p_addr = p_context;
+    __LOG(LOG_LEVEL_DEBUG, "NODE %02X: ", p_addr[0]);
+    __LOG_XB(LOG_LEVEL_DEBUG, "", p_data, len);
+}
+
+static void delay_us(uint16_t us)
+{
+    while (us--)
+    {
+        _delay_us(1);
+    }
 }
 
 static void print_details(void)
@@ -152,7 +168,7 @@ int main()
         sts = radio_init(spi_transfer_block,
                          ce_unselect,
                          ce_select,
-                         delay);
+                         delay_us);
         _delay_ms(300);
 
         if (sts != RADIO_E_SUCCESS)
@@ -171,23 +187,19 @@ int main()
         __LOG(LOG_LEVEL_DEBUG, "Radio setup fail %02X\r\n", sts);
     }
 
-    uint8_t rx_addr[RADIO_ADDR_SIZE] = {0xDD, 0xAD, 0xBE, 0xEF, 0x01};
-    // uint8_t pipes_addr[RADIO_MULTIRECEIVERS] = {0x01, 0, 0, 0, 0};
-    // sts = radio_rx_addr(base_addr, pipes_addr);
-    sts = radio_rx_pipe_open(RADIO_PIPE_1, rx_addr);
-    if (sts != RADIO_E_SUCCESS)
-    {
-        __LOG(LOG_LEVEL_DEBUG, "Radio setup rx addr %02X RADIO_PIPE_1\r\n", sts);
-    }
-
-//!!!!!!!!!!!!!!!
-    rx_addr[4] = 0xDE;
-    sts = radio_rx_pipe_open(RADIO_PIPE_2, &rx_addr[4]);
-    if (sts != RADIO_E_SUCCESS)
+    /* Nodes on pipes 1..5 share the upper address bytes, only the LSB differs. */
+    static uint8_t node_addr[][RADIO_ADDR_SIZE] = {{0xDD, 0xAD, 0xBE, 0xEF, 0x01},
+                                                   {0xDE, 0xAD, 0xBE, 0xEF, 0x01}};
+    for (uint8_t i = 0; i < sizeof(node_addr) / sizeof(node_addr[0]); ++i)
     {
-        __LOG(LOG_LEVEL_DEBUG, "Radio setup rx addr %02X RADIO_PIPE_\r\n", sts);
+        sts = radio_hub_pipe_open(i + 1, node_addr[i], node_handler, node_addr[i]);
+        if (sts != RADIO_E_SUCCESS)
+        {
+            __LOG(LOG_LEVEL_DEBUG, "Radio hub pipe %u open fail %02X\r\n", i + 1, sts);
+        }
     }
 
+    radio_rx_cb_set(radio_rx_cb);
     sts = radio_receive();
     if (sts != RADIO_E_SUCCESS)
     {
@@ -205,18 +217,7 @@ int main()
             }
             case RADIO_STATE_PKT_RECEIVED:
             {
-                for (uint8_t i = 0; i < proc.recv.cnt; ++i)
-                {
-                    __LOG(LOG_LEVEL_DEBUG, "PKT_RECEIVED[%d/%d]: [%02X%02X%02X%02X%02X]\r\n",
-                        i+1, proc.recv.cnt,
-                        proc.recv.pkt[i].addr[0],
-                        proc.recv.pkt[i].addr[1],
-                        proc.recv.pkt[i].addr[2],
-                        proc.recv.pkt[i].addr[3],
-                        proc.recv.pkt[i].addr[4]);
-                    __LOG(LOG_LEVEL_DEBUG, "DATA STR: %s\r\n", (char *) proc.recv.pkt[i].payload);
-                    __LOG_XB(LOG_LEVEL_DEBUG, "DATA RAW: ", proc.recv.pkt[i].payload, proc.recv.pkt[i].len);
-                }
+                /* Payloads were already handed to radio_rx_cb(). */
                 break;
             }
             case RADIO_STATE_PKT_SENT:
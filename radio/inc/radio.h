@@ -4,6 +4,7 @@
 *                         Standard headers                          *
 ********************************************************************/
 #include <stdint.h>
+#include <stdbool.h>
 
 /********************************************************************
 *                           Local headers                           *
@@ -12,8 +13,48 @@
 /********************************************************************
 *                       Function macro defines                      *
 ********************************************************************/
+/* The nRF24 IRQ line is wired to INT0 (PD2). Define RADIO_STATE_POLLING
+ * when it is not, STATUS is then read on every radio_proccess() call. */
+#if !defined(RADIO_STATE_POLLING)
 #define RADIO_STATE_IRQ
-#define RADIO_STATE_POLLING
+#endif
+
+/* Payload slots the RX FIFO is drained into from the SPI interrupt, radio_proccess()
+ * hands them to the RX callback. */
+#ifndef RADIO_RX_RING_SIZE
+#define RADIO_RX_RING_SIZE  (3)
+#endif
+
+/* Payloads a send or a stream queues ahead of the 3 deep TX FIFO, written to it from
+ * the SPI interrupt. */
+#ifndef RADIO_TX_QUEUE_SIZE
+#define RADIO_TX_QUEUE_SIZE (3)
+#endif
+
+#ifndef RADIO_CHANNEL_DEFAULT
+#define RADIO_CHANNEL_DEFAULT   (40)
+#endif
+
+/* Link monitor, only runs while a hop sequence of two or more channels is set.
+ * Hop when PLOS reaches RADIO_HOP_PLOS_LIMIT within RADIO_HOP_WINDOW packets,
+ * or when the average ARC of the last ~8 packets reaches RADIO_HOP_ARC_LIMIT. */
+#ifndef RADIO_HOP_CHANNELS_MAX
+#define RADIO_HOP_CHANNELS_MAX  (4)
+#endif
+#ifndef RADIO_HOP_WINDOW
+#define RADIO_HOP_WINDOW        (64)
+#endif
+#ifndef RADIO_HOP_PLOS_LIMIT
+#define RADIO_HOP_PLOS_LIMIT    (4)
+#endif
+#ifndef RADIO_HOP_ARC_LIMIT
+#define RADIO_HOP_ARC_LIMIT     (5)
+#endif
+
+/* Worst case radio_channel_scan() blocks per sweep at 16 MHz and the default SPI_CLOCK_DIV.
+ * Each of the 126 channels costs the 170 us RPD settle, an RF_CH write and an RPD read
+ * (4 bytes at 8 us, about 200 us with the SPI queue), the rest is margin. */
+#define RADIO_SCAN_SWEEP_US     (35000UL)
 
 /********************************************************************
 *                             Typedefs                              *
@@ -25,13 +66,51 @@ typedef enum
     RADIO_E_INVALID_CONFIG,
     RADIO_E_INTERNAL,
     RADIO_E_NO_MEM,
+    RADIO_E_BUSY,
+    RADIO_E_TX_FAILED,
 } radio_error_t;
 
+/* Called from radio_proccess() once the chip reports TX_DS (RADIO_E_SUCCESS)
+ * or MAX_RT (RADIO_E_TX_FAILED) for a packet sent by radio_pkt_send() or
+ * radio_stream_send(). MAX_RT drops whatever was still queued in a stream. */
+typedef void (*radio_tx_cb_t)(radio_error_t result);
+
+/* Called from radio_proccess() for every received payload. p_data points into the
+ * driver's RX ring and is only valid until the callback returns. */
+typedef void (*radio_rx_cb_t)(uint8_t pipe, uint8_t *p_data, uint8_t len);
+
+/* Called after the radio moved to the next channel of the hop sequence. */
+typedef void (*radio_hop_cb_t)(uint8_t channel);
+
 /********************************************************************
 *                                API                                *
 ********************************************************************/
 radio_error_t radio_init(void);
+/* Starts the transmission and returns, completion is reported through the TX callback. */
 radio_error_t radio_pkt_send(uint8_t *addr, uint8_t *pkt, uint8_t len);
+/* Same, but sent with W_TX_PAYLOAD_NOACK: no ACK is awaited and no retransmit is made,
+ * TX_DS comes as soon as the frame is on air. For telemetry where a stale sample is useless. */
+radio_error_t radio_pkt_send_no_ack(uint8_t *addr, uint8_t *pkt, uint8_t len);
+/* Queues a payload for the TX FIFO and keeps the radio in PTX until both run dry.
+ * Returns RADIO_E_NO_MEM when RADIO_TX_QUEUE_SIZE payloads are still waiting for the
+ * FIFO, refill from the TX callback.
+ * Returns RADIO_E_BUSY for another destination while the stream is running. */
+radio_error_t radio_stream_send(uint8_t *addr, uint8_t *pkt, uint8_t len);
+void radio_tx_cb_set(radio_tx_cb_t cb);
+bool radio_tx_busy(void);
 radio_error_t radio_listen(uint8_t *addr);
+void radio_rx_cb_set(radio_rx_cb_t cb);
 void radio_proccess(void);
+
+/* Blocking spectrum scan, the main loop stalls for up to `sweeps` * RADIO_SCAN_SWEEP_US
+ * and nothing is received meanwhile. Every channel is sampled `sweeps` times for
+ * RPD (> -64 dBm) and the one with the quietest neighbourhood is returned in p_best.
+ * p_hits, if given, receives the hit count of each of the NRF_CHANNELS_NUM channels.
+ * The radio goes back to its current channel, mode and CE state afterwards. */
+radio_error_t radio_channel_scan(uint8_t sweeps, uint8_t *p_hits, uint8_t *p_best);
+radio_error_t radio_channel_set(uint8_t channel);
+/* Both ends set the same sequence. The sender moves on by itself when the link monitor trips,
+ * a receiver calls radio_hop_next() when it has not heard the sender for longer than that. */
+radio_error_t radio_hop_channels_set(const uint8_t *channels, uint8_t num, radio_hop_cb_t cb);
+radio_error_t radio_hop_next(void);
 #endif /* RADIO_H__ */
\ No newline at end of file
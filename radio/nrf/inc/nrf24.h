@@ -15,6 +15,17 @@
 *                       Function macro defines                      *
 ********************************************************************/
 #define MAX_PAYLOAD_SIZE    (32)
+#define NRF_CHANNELS_NUM    (126)   /* < RF_CH 0..125, 2400..2525 MHz. */
+
+/* nrf_fifo_read() clocks the payload straight into the caller's slot,
+ * the first byte of the slot receives STATUS. */
+#define NRF_RX_SLOT_OFFSET  (1)
+#define NRF_RX_SLOT_SIZE    (MAX_PAYLOAD_SIZE + NRF_RX_SLOT_OFFSET)
+
+/* nrf_frame_push() puts the command in front of the payload, STATUS comes back in its place. */
+#define NRF_TX_SLOT_OFFSET  (1)
+#define NRF_TX_SLOT_SIZE    (MAX_PAYLOAD_SIZE + NRF_TX_SLOT_OFFSET)
+#define NRF_WIDTH_FRAME_SIZE    (2)
 
 /********************************************************************
 *                             Typedefs                              *
@@ -99,6 +110,7 @@ typedef struct
     // nrf_rx_cb_t     rx_cb;
 } nrf_setup_t;
 
+/* One CSN framed transfer. Blocking, rx is filled when it returns, rx may equal tx. */
 typedef void (*nrf_spi_t)(uint8_t *tx, uint8_t *rx, uint8_t length);
 
 
@@ -116,12 +128,32 @@ nrf_error_t  nrf_pipe_addr_set(nrf_pipe_t pipe, const uint8_t *addr, uint8_t add
 nrf_error_t nrf_flush_tx_fifo(void);
 nrf_error_t nrf_flush_rx_fifo(void);
 nrf_error_t nrf_fifo_push(uint8_t *data, uint8_t len);
+nrf_error_t nrf_fifo_push_no_ack(uint8_t *data, uint8_t len);
+bool nrf_tx_fifo_empty(void);
 nrf_error_t nrf_fifo_pop(uint8_t *data, uint8_t *len, nrf_pipe_t *pipe);
+nrf_error_t nrf_fifo_read(uint8_t *p_slot, uint8_t *len, nrf_pipe_t *pipe);
+
+/* Payload transfers for callers that put them on an SPI queue of their own rather than
+ * going through nrf_spi_t. Each one builds its frame and returns the transfer length,
+ * 0 if the payload does not fit. The _result() ones decode what came back. */
+uint8_t     nrf_frame_push(uint8_t *p_slot, const uint8_t *data, uint8_t len, bool ack);
+/* p_rx holds what came back, STATUS first. NRF_E_FIFO_FULL if the chip dropped the payload,
+ * the slot can be clocked out again as long as it was not received into. */
+nrf_error_t nrf_frame_push_result(const uint8_t *p_rx);
+/* Width and payload reads are clocked in place, the payload lands at NRF_RX_SLOT_OFFSET. */
+uint8_t     nrf_frame_width(uint8_t *p_frame);
+/* NRF_E_FIFO_EMPTY, or NRF_E_INVALID_SIZE on a corrupted width: flush the RX FIFO then. */
+nrf_error_t nrf_frame_width_result(const uint8_t *p_frame, uint8_t *len, nrf_pipe_t *pipe);
+uint8_t     nrf_frame_read(uint8_t *p_slot, uint8_t len);
+uint8_t     nrf_frame_flush_rx(uint8_t *p_frame);
 
 void nrf_setup(nrf_setup_t *config);
 nrf_error_t nrf_pipe_open(nrf_pipe_t pipe, uint8_t *addr);
 void nrf_addr_get(nrf_pipe_t pipe, uint8_t *addr, uint8_t *addr_size);
 void nrf_mode_set(nrf_mode_t mode);
+nrf_mode_t nrf_mode_get(void);
 void nrf_status_clear(nrf_status_t flags);
+void nrf_channel_set(uint8_t channel);
+bool nrf_rpd_get(void);
 void nrf_observe_tx(uint8_t *retr_cnt, uint8_t *lost_cnt);
 #endif /* NRF24_H__ */
\ No newline at end of file
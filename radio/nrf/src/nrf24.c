@@ -3,6 +3,7 @@
 ********************************************************************/
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 /********************************************************************
 *                           Local headers                           *
@@ -14,6 +15,9 @@
 ********************************************************************/
 #define NRF_NOP             (0xFF)
 #define NRF_DUMMY_OFFSET    (1)
+#define NRF_STATUS_TX_FULL  (1 << 0)
+#define NRF_RX_P_NO(_sts)   (((_sts) >> 1) & 0x07)
+#define NRF_RX_P_NO_EMPTY   (0x07)
 #define MAX_PAYLOAD_SIZE    (32)
 
 /********************************************************************
@@ -22,14 +26,15 @@
 /* NRF24L01 Commands */
 typedef enum
 {
-    NRF_CMD_R_REGISTER   = 0b00000000,
-    NRF_CMD_W_REGISTER   = 0b00100000,
-    NRF_CMD_R_RX_PAYLOAD = 0b01100001,
-    NRF_CMD_W_TX_PAYLOAD = 0b10100000,
-    NRF_CMD_FLUSH_TX     = 0b11100001,
-    NRF_CMD_FLUSH_RX     = 0b11100010,
-    NRF_CMD_R_RX_PL_WID  = 0b01100000,
-    NRF_CMD_NOP          = 0b11111111
+    NRF_CMD_R_REGISTER         = 0b00000000,
+    NRF_CMD_W_REGISTER         = 0b00100000,
+    NRF_CMD_R_RX_PAYLOAD       = 0b01100001,
+    NRF_CMD_W_TX_PAYLOAD       = 0b10100000,
+    NRF_CMD_FLUSH_TX           = 0b11100001,
+    NRF_CMD_FLUSH_RX           = 0b11100010,
+    NRF_CMD_R_RX_PL_WID        = 0b01100000,
+    NRF_CMD_W_TX_PAYLOAD_NOACK = 0b10110000,
+    NRF_CMD_NOP                = 0b11111111
 } nrf_cmd_t;
 
 /* NRF24L01 Registers */
@@ -43,6 +48,7 @@ typedef enum
     NRF_REG_RF_CH       = 0x05,
     NRF_REG_STATUS      = 0x07,
     NRF_REG_OBSERVE_TX  = 0x08,
+    NRF_REG_RPD         = 0x09,
     NRF_REG_RX_ADDR_P0  = 0x0A,
     NRF_REG_RX_ADDR_P1,
     NRF_REG_RX_ADDR_P2,
@@ -159,6 +165,21 @@ static void reg_write_bytes(nrf_reg_t reg, const uint8_t *value, uint8_t len)
     spi(data, NULL, len + 1);
 }
 
+/* STATUS comes back on the command byte. The chip drops the payload if the FIFO was full,
+ * so one transfer both loads and checks it. */
+static nrf_error_t payload_write(uint8_t *data, uint8_t len, bool ack)
+{
+    uint8_t buff[NRF_TX_SLOT_SIZE];
+    uint8_t frame_len = nrf_frame_push(buff, data, len, ack);
+    if (frame_len == 0)
+    {
+        return NRF_E_INVALID_SIZE;
+    }
+
+    spi(buff, buff, frame_len);
+    return nrf_frame_push_result(buff);
+}
+
 /********************************************************************
 *                                API                                *
 ********************************************************************/
@@ -186,7 +207,9 @@ nrf_error_t  nrf_is_chip_connected(void)
 
 nrf_status_t nrf_status_get(void)
 {
-    uint8_t sts_reg = reg_read(NRF_REG_STATUS);
+    /* STATUS is shifted out while the command byte goes in, a lone NOP is enough. */
+    uint8_t sts_reg = NRF_CMD_NOP;
+    spi(&sts_reg, &sts_reg, 1);
 
     return sts_reg & (NRF_STATUS_MAX_RT | NRF_STATUS_TX_DS | NRF_STATUS_RX_DR);
 }
@@ -255,9 +278,10 @@ nrf_error_t nrf_pipe_addr_set(nrf_pipe_t pipe, const uint8_t *addr, uint8_t addr
 
 void nrf_setup(nrf_setup_t *config)
 {
-    config_reg_t reg = {.mask_max_rt = 1,
-                        .mask_rx_dr  = 1,
-                        .mask_tx_ds  = 1,
+    /* RX_DR, TX_DS and MAX_RT are all reflected on the IRQ pin. */
+    config_reg_t reg = {.mask_max_rt = 0,
+                        .mask_rx_dr  = 0,
+                        .mask_tx_ds  = 0,
                         .prim_rx     = 1,
                         .pwr_up      = 1};
 
@@ -280,7 +304,8 @@ void nrf_setup(nrf_setup_t *config)
 
     reg_write(NRF_REG_SETUP_AW, config->addr_size);
 
-    nrf_feature_t feature = {.en_dpl = 1};
+    /* EN_DYN_ACK lets single payloads skip the ACK with W_TX_PAYLOAD_NOACK. */
+    nrf_feature_t feature = {.en_dpl = 1, .en_dyn_ack = 1};
     reg_write_bytes(NRF_REG_FEATURE, (uint8_t *)&feature, 1);
 }
 
@@ -314,47 +339,108 @@ nrf_error_t nrf_flush_rx_fifo(void)
 
 nrf_error_t nrf_fifo_push(uint8_t *data, uint8_t len)
 {
-    if (len > MAX_PAYLOAD_SIZE)
-    {
-        return NRF_E_INVALID_SIZE;
-    }
+    return payload_write(data, len, true);
+}
+
+nrf_error_t nrf_fifo_push_no_ack(uint8_t *data, uint8_t len)
+{
+    return payload_write(data, len, false);
+}
+
+bool nrf_tx_fifo_empty(void)
+{
     uint8_t reg = reg_read(NRF_REG_FIFO_STATUS);
     nrf_fifo_info_t *fifo = (nrf_fifo_info_t *)&reg;
-    if (fifo->tx_full)
+    return fifo->tx_empty;
+}
+
+nrf_error_t nrf_fifo_pop(uint8_t *data, uint8_t *len, nrf_pipe_t *pipe)
+{
+    uint8_t slot[NRF_RX_SLOT_SIZE];
+    nrf_error_t error = nrf_fifo_read(slot, len, pipe);
+    if (error == NRF_E_SUCCESS)
     {
-        return NRF_E_FIFO_FULL;
+        memcpy(data, &slot[NRF_RX_SLOT_OFFSET], *len);
     }
-    
-    reg_write_bytes(NRF_CMD_W_TX_PAYLOAD, data, len);
+    return error;
+}
+
+nrf_error_t nrf_fifo_read(uint8_t *p_slot, uint8_t *len, nrf_pipe_t *pipe)
+{
+    uint8_t wid[NRF_WIDTH_FRAME_SIZE];
+    spi(wid, wid, nrf_frame_width(wid));
 
-    reg = reg_read(NRF_REG_FIFO_STATUS);
-    return (fifo->tx_empty) ? NRF_E_INTERNAL : NRF_E_SUCCESS;
+    nrf_error_t error = nrf_frame_width_result(wid, len, pipe);
+    if (error == NRF_E_INVALID_SIZE)
+    {
+        /* Corrupted width, the datasheet asks to flush the RX FIFO. */
+        nrf_flush_rx_fifo();
+    }
+    if (error != NRF_E_SUCCESS)
+    {
+        return error;
+    }
+
+    spi(p_slot, p_slot, nrf_frame_read(p_slot, *len));
+    return NRF_E_SUCCESS;
 }
 
-nrf_error_t nrf_fifo_pop(uint8_t *data, uint8_t *len, nrf_pipe_t *pipe)
+uint8_t nrf_frame_push(uint8_t *p_slot, const uint8_t *data, uint8_t len, bool ack)
 {
-    uint8_t reg = reg_read(NRF_REG_FIFO_STATUS);
-    nrf_fifo_info_t *fifo = (nrf_fifo_info_t *)&reg;
-    if (fifo->rx_empty)
+    if (len > MAX_PAYLOAD_SIZE)
+    {
+        return 0;
+    }
+
+    p_slot[0] = ack ? NRF_CMD_W_TX_PAYLOAD : NRF_CMD_W_TX_PAYLOAD_NOACK;
+    memcpy(&p_slot[NRF_TX_SLOT_OFFSET], data, len);
+    return len + NRF_TX_SLOT_OFFSET;
+}
+
+nrf_error_t nrf_frame_push_result(const uint8_t *p_rx)
+{
+    return (p_rx[0] & NRF_STATUS_TX_FULL) ? NRF_E_FIFO_FULL : NRF_E_SUCCESS;
+}
+
+uint8_t nrf_frame_width(uint8_t *p_frame)
+{
+    p_frame[0] = NRF_CMD_R_RX_PL_WID;
+    p_frame[1] = NRF_NOP;
+    return NRF_WIDTH_FRAME_SIZE;
+}
+
+nrf_error_t nrf_frame_width_result(const uint8_t *p_frame, uint8_t *len, nrf_pipe_t *pipe)
+{
+    /* STATUS comes back with the width, its RX_P_NO tells the pipe of the top payload
+     * or that the RX FIFO is empty, so FIFO_STATUS and STATUS reads are not needed. */
+    uint8_t rx_p_no = NRF_RX_P_NO(p_frame[0]);
+    if (rx_p_no == NRF_RX_P_NO_EMPTY)
     {
         return NRF_E_FIFO_EMPTY;
     }
 
-    uint8_t pl_size = reg_read(NRF_CMD_R_RX_PL_WID);
-    if (pl_size == 0)
+    if (p_frame[1] == 0 || p_frame[1] > MAX_PAYLOAD_SIZE)
     {
         return NRF_E_INVALID_SIZE;
     }
 
-    uint8_t status = reg_read(NRF_REG_STATUS);
-    *pipe = (status >> 1) & 0x07;
-    
-    reg_read_bytes(NRF_CMD_R_RX_PAYLOAD, data, pl_size);
-    *len = pl_size;
-
+    *len  = p_frame[1];
+    *pipe = rx_p_no;
     return NRF_E_SUCCESS;
 }
 
+uint8_t nrf_frame_read(uint8_t *p_slot, uint8_t len)
+{
+    p_slot[0] = NRF_CMD_R_RX_PAYLOAD;
+    return len + NRF_RX_SLOT_OFFSET;
+}
+
+uint8_t nrf_frame_flush_rx(uint8_t *p_frame)
+{
+    p_frame[0] = NRF_CMD_FLUSH_RX;
+    return 1;
+}
+
 nrf_error_t nrf_pipe_open(nrf_pipe_t pipe, uint8_t *addr)
 {
     uint8_t addr_size = reg_read(NRF_REG_SETUP_AW);
@@ -385,14 +471,10 @@ nrf_error_t nrf_pipe_open(nrf_pipe_t pipe, uint8_t *addr)
             reg_write_bytes(NRF_REG_RX_ADDR_P0 + pipe, addr, 1);
         }
 
-        uint8_t en_rx_addr = (1 << pipe);
-        reg_write(NRF_REG_EN_RX_ADDR, en_rx_addr);
-
-        uint8_t dynpl = (1 << pipe);
-        reg_write_bytes(NRF_REG_DYNPD, &dynpl, 1);
-
-        uint8_t en_aa = (1 << pipe);
-        reg_write_bytes(NRF_REG_EN_AA, &en_aa, 1);
+        /* Other pipes stay open, e.g. P0 taking the ACKs must not close the listening P1. */
+        reg_write(NRF_REG_EN_RX_ADDR, reg_read(NRF_REG_EN_RX_ADDR) | (1 << pipe));
+        reg_write(NRF_REG_DYNPD, reg_read(NRF_REG_DYNPD) | (1 << pipe));
+        reg_write(NRF_REG_EN_AA, reg_read(NRF_REG_EN_AA) | (1 << pipe));
     }
     else
     {
@@ -427,11 +509,29 @@ void nrf_mode_set(nrf_mode_t mode)
     reg_write_bytes(NRF_REG_CONFIG, (uint8_t *)&config, 1);
 }
 
+nrf_mode_t nrf_mode_get(void)
+{
+    config_reg_t config;
+    reg_read_bytes(NRF_REG_CONFIG, (uint8_t *)&config, 1);
+    return config.prim_rx ? NRF_MODE_PRX : NRF_MODE_PTX;
+}
+
 void nrf_status_clear(nrf_status_t flags)
 {
     reg_write(NRF_REG_STATUS, flags); 
 }
 
+void nrf_channel_set(uint8_t channel)
+{
+    /* Also restarts the PLOS counter of OBSERVE_TX. */
+    reg_write(NRF_REG_RF_CH, channel);
+}
+
+bool nrf_rpd_get(void)
+{
+    return reg_read(NRF_REG_RPD) & 0x01;
+}
+
 void nrf_observe_tx(uint8_t *retr_cnt, uint8_t *lost_cnt)
 {
     uint8_t reg = reg_read(NRF_REG_OBSERVE_TX);
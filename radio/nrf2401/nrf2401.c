@@ -14,6 +14,9 @@
 *                       Function macro defines                      *
 ********************************************************************/
 #define REG_SIZE                (1)
+#define RX_P_NO(_sts)           (((_sts) >> 1) & 0x07)
+#define RX_P_NO_EMPTY           (0x07)
+#define STATUS_TX_FULL          (1 << 0)
 
 /********************************************************************
 *                             Typedefs                              *
@@ -110,6 +113,26 @@ void write(nrf_reg_t reg, uint8_t *data, uint8_t len)
     g_ctx.spi(tx_buff, NULL, len + REG_SIZE);
 }
 
+/* Writes a TX FIFO payload. STATUS comes back on the command byte and the chip
+ * drops the write if the FIFO was full, so one transfer both loads and checks it. */
+static nrf_error_t payload_write(uint8_t cmd, uint8_t *data, uint8_t len)
+{
+    if (len > MAX_PAYLOAD_SIZE)
+    {
+        return NRF_E_INVALID_DATA_SIZE;
+    }
+
+    uint8_t buff[sizeof(cmd) + len];
+    buff[0] = cmd;
+    for (uint8_t i = 0; i < len; i++)
+    {
+        buff[i + 1] = data[i];
+    }
+
+    g_ctx.spi(buff, buff, sizeof(cmd) + len);
+    return (buff[0] & STATUS_TX_FULL) ? NRF_E_FIFO_FULL : NRF_E_SUCCESS;
+}
+
 /********************************************************************
 *                                API                                *
 ********************************************************************/
@@ -285,7 +308,7 @@ nrf_error_t nrf_retr_setup(uint8_t retr, uint8_t delay)
 
 nrf_error_t nrf_rf_setup(uint8_t channel, nrf_data_rate_t rate, nrf_output_power_t power)
 {
-    if (channel > 124)
+    if (channel > 125)
     {
         return NRF_E_INVALID_PARAM;
     }
@@ -299,6 +322,18 @@ nrf_error_t nrf_rf_setup(uint8_t channel, nrf_data_rate_t rate, nrf_output_power
     return NRF_E_SUCCESS;
 }
 
+nrf_error_t nrf_channel_set(uint8_t channel)
+{
+    if (channel > 125)
+    {
+        return NRF_E_INVALID_PARAM;
+    }
+
+    write(NRF_REG_RF_CH, &channel, sizeof(channel));
+    g_ctx.rf_channel = channel;
+    return NRF_E_SUCCESS;
+}
+
 uint8_t nrf_status_get(void)
 {
     uint8_t status;
@@ -423,28 +458,12 @@ void nrf_fifo_flush_tx(void)
 
 nrf_error_t nrf_fifo_push(uint8_t *data, uint8_t len)
 {
-    if (len > MAX_PAYLOAD_SIZE)
-    {
-        return NRF_E_INVALID_DATA_SIZE;
-    }
-
-    uint8_t fifo = nrf_fifo_status();
-    if (fifo & NRF_FIFO_STATUS_TX_FULL)
-    {
-        return NRF_E_FIFO_FULL;
-    }
-
-    uint8_t cmd = NRF_CMD_W_TX_PAYLOAD;
-    uint8_t buff[sizeof(cmd) + len];
-    buff[0] = cmd;
-    for (uint8_t i = 0; i < len; i++)
-    {
-        buff[i + 1] = data[i];
-    }
-    
-    g_ctx.spi(buff, NULL, sizeof(cmd) + len);
+    return payload_write(NRF_CMD_W_TX_PAYLOAD, data, len);
+}
 
-    return NRF_E_SUCCESS;
+nrf_error_t nrf_fifo_push_no_ack(uint8_t *data, uint8_t len)
+{
+    return payload_write(NRF_CMD_W_TX_PAYLOAD_NOACK, data, len);
 }
 
 nrf_error_t nrf_fifo_pop(uint8_t *data, uint8_t *len, nrf_pipe_t *pipe)
@@ -477,6 +496,45 @@ nrf_error_t nrf_fifo_pop(uint8_t *data, uint8_t *len, nrf_pipe_t *pipe)
     return NRF_E_SUCCESS;
 }
 
+nrf_error_t nrf_fifo_read(uint8_t *p_slot, uint8_t *len, nrf_pipe_t *pipe)
+{
+    /* STATUS comes back with the width, its RX_P_NO tells the pipe of the top payload
+     * or that the RX FIFO is empty, so FIFO_STATUS and STATUS reads are not needed. */
+    uint8_t wid[] = {NRF_CMD_R_RX_PL_WID, NRF_CMD_NOP};
+    g_ctx.spi(wid, wid, sizeof(wid));
+
+    uint8_t rx_p_no = RX_P_NO(wid[0]);
+    if (rx_p_no == RX_P_NO_EMPTY)
+    {
+        return NRF_E_FIFO_EMPTY;
+    }
+
+    if (wid[1] == 0 || wid[1] > MAX_PAYLOAD_SIZE)
+    {
+        /* Corrupted width, the datasheet asks to flush the RX FIFO. */
+        nrf_fifo_flush_rx();
+        return NRF_E_INVALID_DATA_SIZE;
+    }
+
+    p_slot[0] = NRF_CMD_R_RX_PAYLOAD;
+    g_ctx.spi(p_slot, p_slot, wid[1] + NRF_RX_SLOT_OFFSET);
+
+    *len  = wid[1];
+    *pipe = rx_p_no;
+    return NRF_E_SUCCESS;
+}
+
+nrf_error_t nrf_ack_payload_push(nrf_pipe_t pipe, uint8_t *data, uint8_t len)
+{
+    if (pipe > NRF_PIPE_5)
+    {
+        return NRF_E_INVALID_PARAM;
+    }
+
+    /* ACK payloads share the 3 deep TX FIFO with the TX payloads. */
+    return payload_write(NRF_CMD_W_ACK_PAYLOAD | pipe, data, len);
+}
+
 nrf_error_t nrf_dynamic_payload(nrf_pipe_t pipe, bool enable)
 {
     if (pipe >= NRF_PIPE_TX)
@@ -16,6 +16,11 @@
 ********************************************************************/
 #define MAX_PAYLOAD_SIZE     (32)
 
+/* nrf_fifo_read() clocks the payload straight into the caller's slot,
+ * the first byte of the slot receives STATUS. */
+#define NRF_RX_SLOT_OFFSET   (1)
+#define NRF_RX_SLOT_SIZE     (MAX_PAYLOAD_SIZE + NRF_RX_SLOT_OFFSET)
+
 #define NRF_FLAG_RX_DR    	 (1 << 6)
 #define NRF_FLAG_TX_DS    	 (1 << 5)
 #define NRF_FLAG_MAX_RT   	 (1 << 4)
@@ -46,15 +51,17 @@ typedef enum
 /* NRF24L01 Commands */
 typedef enum
 {
-    NRF_CMD_R_REGISTER   = 0b00000000,
-    NRF_CMD_W_REGISTER   = 0b00100000,
-    NRF_CMD_R_RX_PAYLOAD = 0b01100001,
-    NRF_CMD_W_TX_PAYLOAD = 0b10100000,
-    NRF_CMD_FLUSH_TX     = 0b11100001,
-    NRF_CMD_FLUSH_RX     = 0b11100010,
-    NRF_CMD_R_RX_PL_WID  = 0b01100000,
-    NRF_CMD_ACTIVATE     = 0b01010000,
-    NRF_CMD_NOP          = 0b11111111
+    NRF_CMD_R_REGISTER         = 0b00000000,
+    NRF_CMD_W_REGISTER         = 0b00100000,
+    NRF_CMD_R_RX_PAYLOAD       = 0b01100001,
+    NRF_CMD_W_TX_PAYLOAD       = 0b10100000,
+    NRF_CMD_FLUSH_TX           = 0b11100001,
+    NRF_CMD_FLUSH_RX           = 0b11100010,
+    NRF_CMD_R_RX_PL_WID        = 0b01100000,
+    NRF_CMD_W_ACK_PAYLOAD      = 0b10101000,  /* < Pipe number in the 3 LSB. */
+    NRF_CMD_W_TX_PAYLOAD_NOACK = 0b10110000,
+    NRF_CMD_ACTIVATE           = 0b01010000,
+    NRF_CMD_NOP                = 0b11111111
 } nrf_cmd_t;
 
 /* NRF24L01 Registers */
@@ -147,6 +154,7 @@ nrf_error_t nrf_rx_pipe(nrf_pipe_t pipe, bool enable, bool ack);
 nrf_error_t nrf_addr_size(nrf_addr_size_t size);
 nrf_error_t nrf_retr_setup(uint8_t retr, uint8_t delay);
 nrf_error_t nrf_rf_setup(uint8_t channel, nrf_data_rate_t rate, nrf_output_power_t power);
+nrf_error_t nrf_channel_set(uint8_t channel);
 uint8_t nrf_status_get(void);
 void nrf_flag_clear(uint8_t flags);
 nrf_error_t nrf_addr_set(nrf_pipe_t pipe, uint8_t *addr);
@@ -158,7 +166,10 @@ uint8_t nrf_fifo_status(void);
 void nrf_fifo_flush_rx(void);
 void nrf_fifo_flush_tx(void);
 nrf_error_t nrf_fifo_push(uint8_t *data, uint8_t len);
+nrf_error_t nrf_fifo_push_no_ack(uint8_t *data, uint8_t len);
 nrf_error_t nrf_fifo_pop(uint8_t *data, uint8_t *len, nrf_pipe_t *pipe);
+nrf_error_t nrf_fifo_read(uint8_t *p_slot, uint8_t *len, nrf_pipe_t *pipe);
+nrf_error_t nrf_ack_payload_push(nrf_pipe_t pipe, uint8_t *data, uint8_t len);
 nrf_error_t nrf_dynamic_payload(nrf_pipe_t pipe, bool enable);
 void nrf_feature(bool dpl, bool ack_pay, bool dyn_ack);
 uint8_t nrf_read_reg(nrf_reg_t reg);
@@ -1,4 +1,5 @@
 #include <stdbool.h>
+#include <string.h>
 
 #include "radio.h"
 #include "nrf2401.h"
@@ -32,21 +33,66 @@ typedef enum
 
 typedef struct
 {
-    ce_high_t    nrf_ce_high;
-    ce_low_t     nrf_ce_low;
-    delay_t      delay;
-    radio_mode_t mode;
-    irg_state_t  irq_state;
+    radio_pipe_handler_t cb;
+    void                 *p_context;
+} radio_pipe_route_t;
+
+typedef struct
+{
+    ce_high_t            nrf_ce_high;
+    ce_low_t             nrf_ce_low;
+    delay_us_t           delay_us;
+    radio_mode_t         mode;
+    volatile irg_state_t irq_state;
+    bool                 rx_active;    /* < radio_receive() was called, RX is resumed after each TX. */
+    bool                 tx_busy;      /* < Own PTX send in flight, the chip left RX for it. */
+    radio_tx_cb_t        tx_cb;
+    radio_rx_cb_t        rx_cb;
+    radio_pipe_route_t   routes[RADIO_HUB_PIPES_NUM];
+    radio_pipe_route_t   request_saved; /* < Pipe 0 route radio_request() took over. */
+    bool                 request_active;
+    uint8_t              hub_base[RADIO_ADDR_SIZE - 1];    /* < Upper address bytes shared by pipes 1..5. */
+    bool                 hub_base_valid;
+    uint8_t              adv_channels[RADIO_ADV_CHANNELS_MAX];
+    uint8_t              adv_num;
+    uint8_t              adv_next;      /* < Hop index of the next repeat, adv_num when idle. */
+    bool                 adv_restore;   /* < A repeat left channels[0], go back after the last one. */
+    uint8_t              adv_len;
+    uint8_t              adv_pkt[RADIO_FIFO_DATA_MAX];
 } radio_ctx_t;
 
+typedef struct
+{
+    uint8_t    buff[NRF_RX_SLOT_SIZE];
+    uint8_t    len;
+    nrf_pipe_t pipe;
+} radio_rx_slot_t;
+
 /********************************************************************
 *                  Static global data declarations                  *
 ********************************************************************/
-static radio_ctx_t g_ctx;
+static radio_ctx_t     g_ctx;
+static radio_rx_slot_t g_rx_ring[RADIO_RX_RING_SIZE];
 /********************************************************************
 *                     Functions implementations                     *
 ********************************************************************/
 
+/* Gives pipe 0 back to the route it had before radio_request(). */
+static void radio_request_end(void)
+{
+    if (g_ctx.request_active)
+    {
+        g_ctx.request_active     = false;
+        g_ctx.routes[NRF_PIPE_0] = g_ctx.request_saved;
+    }
+}
+
+/* As PRX a TX_DS means a loaded ACK payload went out, it is not the end of an own send. */
+static void radio_ack_payload_sent(void)
+{
+    nrf_flag_clear(NRF_FLAG_TX_DS);
+}
+
 static void radio_state_pkt_sent_handle(radio_pkt_sent_t *pkt_sent)
 {
     pkt_sent->retr_cnt = nrf_retr_cnt();
@@ -55,32 +101,130 @@ static void radio_state_pkt_sent_handle(radio_pkt_sent_t *pkt_sent)
 
 static void radio_state_pkt_recv_handle(radio_pkt_received_t *pkt_recv)
 {
+    /* Clear first: a payload landing during the drain sets RX_DR again instead of being hidden. */
+    nrf_flag_clear(NRF_FLAG_RX_DR);
+
+    /* Empty the chip RX FIFO into the ring before running the callbacks,
+     * so a slow consumer does not keep the FIFO full while the next packets arrive. */
     pkt_recv->cnt = 0;
-    for (uint8_t i = 0; i < RADIO_FIFO_SIZE_MAX; ++i)
+    uint8_t cnt;
+    do
     {
-        nrf_pipe_t pipe;
-        if (nrf_fifo_pop(pkt_recv->pkt[i].payload, &pkt_recv->pkt[i].len, &pipe) != NRF_E_SUCCESS)
+        for (cnt = 0; cnt < RADIO_RX_RING_SIZE; ++cnt)
         {
-            break;
+            radio_rx_slot_t *p_slot = &g_rx_ring[cnt];
+            if (nrf_fifo_read(p_slot->buff, &p_slot->len, &p_slot->pipe) != NRF_E_SUCCESS)
+            {
+                break;
+            }
         }
 
-        nrf_addr_get(NRF_PIPE_1, pkt_recv->pkt[i].addr);
-        if (pipe != NRF_PIPE_1)
+        for (uint8_t i = 0; i < cnt; ++i)
         {
-            nrf_addr_get(pipe, &pkt_recv->pkt[i].addr[4]);
+            radio_rx_slot_t    *p_slot  = &g_rx_ring[i];
+            radio_pipe_route_t *p_route = &g_ctx.routes[p_slot->pipe];
+            uint8_t            *p_data  = &p_slot->buff[NRF_RX_SLOT_OFFSET];
+            if (p_route->cb)
+            {
+                p_route->cb(p_data, p_slot->len, p_route->p_context);
+                /* One response per request, later P0 packets belong to the route from before. */
+                if (p_slot->pipe == NRF_PIPE_0)
+                {
+                    radio_request_end();
+                }
+            }
+            else if (g_ctx.rx_cb)
+            {
+                g_ctx.rx_cb(p_slot->pipe, p_data, p_slot->len);
+            }
         }
-
-        pkt_recv->cnt++;
-    }
-    nrf_flag_clear(NRF_FLAG_RX_DR);
+        pkt_recv->cnt += cnt;
+    } while (cnt == RADIO_RX_RING_SIZE);
 }
 
 static void radio_state_pkt_lost_handle(radio_pkt_lost_t *lost)
 {
     lost->lost_pkts = nrf_lost_packets_cnt();
+    /* The failed payload stays in the TX FIFO until flushed. */
+    nrf_fifo_flush_tx();
     nrf_flag_clear(NRF_FLAG_MAX_RT);
 }
 
+/* Ends an own send, with or without a response to a radio_request(). */
+static void radio_tx_complete(radio_state_t result)
+{
+    if (g_ctx.rx_active)
+    {
+        nrf_mode(NRF_MODE_RX);
+        g_ctx.nrf_ce_high();
+    }
+
+    radio_request_end();
+    g_ctx.tx_busy = false;
+    if (g_ctx.tx_cb)
+    {
+        g_ctx.tx_cb(result);
+    }
+}
+
+/* Leaves RX, loads one payload and pulses CE, RX is resumed by radio_tx_complete(). */
+static radio_error_t radio_tx_start(uint8_t *pkt, uint8_t pkt_len, bool ack)
+{
+    /* ACK payloads share the TX FIFO, as PTX the chip would send them to TX_ADDR first.
+     * Several of them going out raise TX_DS only once, so the FIFO tells, not a count. */
+    if (!(nrf_fifo_status() & NRF_FIFO_STATUS_TX_EMPTY))
+    {
+        return RADIO_E_BUSY;
+    }
+    /* A TX_DS left by an ACK payload must not be taken for the end of this send. */
+    nrf_flag_clear(NRF_FLAG_TX_DS);
+
+    g_ctx.nrf_ce_low();
+    bail_required(nrf_mode(NRF_MODE_TX));
+
+    nrf_error_t err = ack ? nrf_fifo_push(pkt, pkt_len) : nrf_fifo_push_no_ack(pkt, pkt_len);
+    bail_required(err);
+    g_ctx.tx_busy = true;
+
+    /* A single pulse sends one payload, the chip then waits in standby for the ACK. */
+    g_ctx.nrf_ce_high();
+    g_ctx.delay_us(RADIO_CE_PULSE_US);
+    g_ctx.nrf_ce_low();
+
+    return RADIO_E_SUCCESS;
+
+bail:
+    if (g_ctx.rx_active)
+    {
+        nrf_mode(NRF_MODE_RX);
+        g_ctx.nrf_ce_high();
+    }
+    return RADIO_E_INTERNAL;
+}
+
+/* Sends the pending broadcast on the next hop channel, returns false once all are done. */
+static bool radio_adv_next(void)
+{
+    if (g_ctx.adv_next >= g_ctx.adv_num)
+    {
+        return false;
+    }
+
+    uint8_t channel = g_ctx.adv_channels[g_ctx.adv_next++];
+    if (channel != g_ctx.adv_channels[0])
+    {
+        g_ctx.adv_restore = true;
+    }
+
+    if (nrf_channel_set(channel) != NRF_E_SUCCESS ||
+        radio_tx_start(g_ctx.adv_pkt, g_ctx.adv_len, false) != RADIO_E_SUCCESS)
+    {
+        g_ctx.adv_next = g_ctx.adv_num;
+        return false;
+    }
+    return true;
+}
+
 static void radio_state_fifo_full_handle(void)
 {
     nrf_fifo_flush_tx();
@@ -89,16 +233,16 @@ static void radio_state_fifo_full_handle(void)
 /********************************************************************
 *                                API                                *
 ********************************************************************/
-radio_error_t radio_init(spi_tx_rx_t spi, ce_high_t ce_high, ce_low_t ce_low, delay_t delay)
+radio_error_t radio_init(spi_tx_rx_t spi, ce_high_t ce_high, ce_low_t ce_low, delay_us_t delay_us)
 {
-    if (spi == NULL || ce_high == NULL || ce_low == NULL)
+    if (spi == NULL || ce_high == NULL || ce_low == NULL || delay_us == NULL)
     {
         return RADIO_E_INVALID_PARAM;
     }
 
     g_ctx.nrf_ce_high = ce_high;
     g_ctx.nrf_ce_low  = ce_low;
-    g_ctx.delay       = delay;
+    g_ctx.delay_us    = delay_us;
 
     nrf_error_t sts = nrf_init(spi);
     if (sts != NRF_E_SUCCESS)
@@ -117,6 +261,10 @@ radio_error_t radio_setup(radio_mode_t mode, uint8_t channel)
 
     bail_required(nrf_interrupt(false));
     g_ctx.irq_state = RADIO_IRQ_NOT_USED;
+    g_ctx.tx_busy   = false;
+    g_ctx.hub_base_valid = false;
+    g_ctx.request_active = false;
+    memset(g_ctx.routes, 0, sizeof(g_ctx.routes));
     bail_required(nrf_addr_size(ADDR_SIZE_5B));
 
     switch (mode)
@@ -138,7 +286,14 @@ radio_error_t radio_setup(radio_mode_t mode, uint8_t channel)
     g_ctx.mode = mode;
 
     bail_required(nrf_rf_setup(channel, RADIO_DATA_RATE, RADIO_POWER));
-    nrf_feature(true, false, false);
+    /* ACK payloads ride on auto ACK, so they are only available in shockburst.
+     * EN_DYN_ACK allows W_TX_PAYLOAD_NOACK per packet in both modes. */
+    nrf_feature(true, (mode == RADIO_MODE_SHOCKBURST), true);
+
+    g_ctx.adv_channels[0] = channel;
+    g_ctx.adv_num         = 1;
+    g_ctx.adv_next        = 1;
+    g_ctx.adv_restore     = false;
 
     return RADIO_E_SUCCESS;
 
@@ -197,6 +352,61 @@ bail:
     return RADIO_E_INTERNAL;
 }
 
+radio_error_t radio_hub_pipe_open(uint8_t pipe, uint8_t *addr, radio_pipe_handler_t handler, void *p_context)
+{
+    /* P0 belongs to radio_tx_addr() and radio_request(), they rewrite it on every send. */
+    if (pipe == NRF_PIPE_0 || pipe >= RADIO_HUB_PIPES_NUM || addr == NULL || handler == NULL)
+    {
+        return RADIO_E_INVALID_PARAM;
+    }
+
+    if (!g_ctx.hub_base_valid)
+    {
+        /* Pipes 2..5 only have an LSB register, the rest comes from RX_ADDR_P1.
+         * Only the shared bytes go there, P1 keeps its own LSB. */
+        if (pipe != NRF_PIPE_1)
+        {
+            uint8_t addr_p1[RADIO_ADDR_SIZE];
+            bail_required(nrf_addr_get(NRF_PIPE_1, addr_p1));
+            memcpy(&addr_p1[1], &addr[1], sizeof(g_ctx.hub_base));
+            bail_required(nrf_addr_set(NRF_PIPE_1, addr_p1));
+        }
+        memcpy(g_ctx.hub_base, &addr[1], sizeof(g_ctx.hub_base));
+        g_ctx.hub_base_valid = true;
+    }
+    else if (memcmp(g_ctx.hub_base, &addr[1], sizeof(g_ctx.hub_base)) != 0)
+    {
+        return RADIO_E_INVALID_PARAM;
+    }
+
+    bail_required(nrf_addr_set(pipe, addr));
+    /* Dynamic payload length needs auto ACK on the pipe, only the real payload is clocked out. */
+    bail_required(nrf_rx_pipe(pipe, true, true));
+    bail_required(nrf_dynamic_payload(pipe, true));
+
+    g_ctx.routes[pipe].cb        = handler;
+    g_ctx.routes[pipe].p_context = p_context;
+    return RADIO_E_SUCCESS;
+
+bail:
+    return RADIO_E_INTERNAL;
+}
+
+radio_error_t radio_hub_pipe_close(uint8_t pipe)
+{
+    if (pipe == NRF_PIPE_0 || pipe >= RADIO_HUB_PIPES_NUM)
+    {
+        return RADIO_E_INVALID_PARAM;
+    }
+
+    bail_required(nrf_rx_pipe(pipe, false, false));
+    g_ctx.routes[pipe].cb = NULL;
+    return RADIO_E_SUCCESS;
+
+bail:
+    return RADIO_E_INTERNAL;
+}
+
 // radio_error_t radio_rx_addr(uint8_t *base_addr, uint8_t *pipes_addr)
 // {
 //     uint8_t addr_p1[RADIO_ADDR_SIZE];
@@ -239,6 +449,8 @@ radio_error_t radio_tx_addr(uint8_t *addr)
     // if (g_ctx.mode == RADIO_MODE_SHOCKBURST)
     {
         bail_required(nrf_addr_set(NRF_PIPE_0, addr));
+        /* ACK payloads come back on P0 and need dynamic payload length there. */
+        bail_required(nrf_dynamic_payload(NRF_PIPE_0, true));
         // bail_required(nrf_rx_pipe(NRF_PIPE_0, true, true));
     }
     // else
@@ -257,68 +469,206 @@ radio_error_t radio_receive(void)
     if (nrf_mode(NRF_MODE_RX) != NRF_E_SUCCESS)
         return RADIO_E_INTERNAL;
     
+    g_ctx.rx_active = true;
     g_ctx.nrf_ce_high();
     return RADIO_E_SUCCESS;
 }
 
 radio_error_t radio_send(uint8_t *pkt, uint8_t pkt_len)
 {
-    g_ctx.nrf_ce_low();
-    bail_required(nrf_mode(NRF_MODE_TX));
+    if (g_ctx.tx_busy)
+    {
+        return RADIO_E_BUSY;
+    }
 
-    bail_required(nrf_fifo_push(pkt, pkt_len));
+    return radio_tx_start(pkt, pkt_len, true);
+}
 
-    g_ctx.nrf_ce_high();
-    g_ctx.delay(10);
-    g_ctx.nrf_ce_low();
+radio_error_t radio_send_no_ack(uint8_t *pkt, uint8_t pkt_len)
+{
+    if (g_ctx.tx_busy)
+    {
+        return RADIO_E_BUSY;
+    }
 
-    return RADIO_E_SUCCESS;
+    return radio_tx_start(pkt, pkt_len, false);
+}
 
-bail:
-    return RADIO_E_INTERNAL;
+radio_error_t radio_adv_channels_set(const uint8_t *channels, uint8_t num)
+{
+    if (channels == NULL || num == 0 || num > RADIO_ADV_CHANNELS_MAX)
+    {
+        return RADIO_E_INVALID_PARAM;
+    }
+
+    if (g_ctx.tx_busy)
+    {
+        return RADIO_E_BUSY;
+    }
+
+    for (uint8_t i = 0; i < num; ++i)
+    {
+        g_ctx.adv_channels[i] = channels[i];
+    }
+    g_ctx.adv_num  = num;
+    g_ctx.adv_next = num;
+
+    return (nrf_channel_set(channels[0]) == NRF_E_SUCCESS) ? RADIO_E_SUCCESS : RADIO_E_INVALID_PARAM;
+}
+
+radio_error_t radio_advertise(uint8_t *pkt, uint8_t pkt_len)
+{
+    if (g_ctx.mode != RADIO_MODE_ADVERTISER || pkt_len > RADIO_FIFO_DATA_MAX)
+    {
+        return RADIO_E_INVALID_PARAM;
+    }
+
+    if (g_ctx.tx_busy)
+    {
+        return RADIO_E_BUSY;
+    }
+
+    /* Kept for the repeats, the TX FIFO entry is gone once it has been sent. */
+    memcpy(g_ctx.adv_pkt, pkt, pkt_len);
+    g_ctx.adv_len  = pkt_len;
+    g_ctx.adv_next = 0;
+
+    return radio_adv_next() ? RADIO_E_SUCCESS : RADIO_E_INTERNAL;
+}
+
+radio_error_t radio_request(uint8_t *pkt, uint8_t pkt_len, radio_pipe_handler_t on_response, void *p_context)
+{
+    if (g_ctx.mode != RADIO_MODE_SHOCKBURST || on_response == NULL)
+    {
+        return RADIO_E_INVALID_PARAM;
+    }
+
+    if (g_ctx.tx_busy)
+    {
+        return RADIO_E_BUSY;
+    }
+
+    /* The reply arrives on P0 along with the ACK, route it like a hub pipe until it is in
+     * or the send is over. */
+    g_ctx.request_saved                = g_ctx.routes[NRF_PIPE_0];
+    g_ctx.request_active               = true;
+    g_ctx.routes[NRF_PIPE_0].cb        = on_response;
+    g_ctx.routes[NRF_PIPE_0].p_context = p_context;
+
+    radio_error_t err = radio_send(pkt, pkt_len);
+    if (err != RADIO_E_SUCCESS)
+    {
+        radio_request_end();
+    }
+    return err;
+}
+
+radio_error_t radio_ack_payload_set(uint8_t pipe, uint8_t *data, uint8_t len)
+{
+    if (g_ctx.mode != RADIO_MODE_SHOCKBURST)
+    {
+        return RADIO_E_INVALID_PARAM;
+    }
+
+    switch (nrf_ack_payload_push(pipe, data, len))
+    {
+        case NRF_E_SUCCESS:   return RADIO_E_SUCCESS;
+        case NRF_E_FIFO_FULL: return RADIO_E_NO_MEM;
+        default:              return RADIO_E_INVALID_PARAM;
+    }
+}
+
+void radio_tx_cb_set(radio_tx_cb_t cb)
+{
+    g_ctx.tx_cb = cb;
+}
+
+void radio_rx_cb_set(radio_rx_cb_t cb)
+{
+    g_ctx.rx_cb = cb;
+}
+
+bool radio_tx_busy(void)
+{
+    return g_ctx.tx_busy;
+}
+
+radio_error_t radio_irq_enable(void)
+{
+    if (nrf_interrupt(true) != NRF_E_SUCCESS)
+    {
+        return RADIO_E_INTERNAL;
+    }
+
+    /* The line may already be low, so start with one STATUS read. */
+    g_ctx.irq_state = RADIO_IRQ_ASSERTED;
+    return RADIO_E_SUCCESS;
 }
 
 void radio_irq_handle(void)
 {
-    if (g_ctx.irq_state == RADIO_IRQ_IDLE)
+    if (g_ctx.irq_state != RADIO_IRQ_NOT_USED)
         g_ctx.irq_state = RADIO_IRQ_ASSERTED;
 }
 
 void radio_proccess(radio_proccess_t *proc)
 {
+    proc->state = RADIO_STATE_IDLE;
     if (g_ctx.irq_state == RADIO_IRQ_ASSERTED ||
         g_ctx.irq_state == RADIO_IRQ_NOT_USED)
     {
+        /* Drop the latch before reading STATUS, an edge that comes meanwhile sets it again. */
+        bool irq_used = (g_ctx.irq_state != RADIO_IRQ_NOT_USED);
+        if (irq_used)
+        {
+            g_ctx.irq_state = RADIO_IRQ_IDLE;
+        }
+
         uint8_t status = nrf_status_get();
         if (status & NRF_FLAG_RX_DR)
         {
             proc->state = RADIO_STATE_PKT_RECEIVED;
             radio_state_pkt_recv_handle(&proc->recv);
         }
+        else if ((status & NRF_FLAG_TX_DS) && !g_ctx.tx_busy)
+        {
+            /* Reply went out on an ACK, nothing to report to the TX callback. */
+            radio_ack_payload_sent();
+        }
+        else if ((status & NRF_FLAG_TX_DS) && radio_adv_next())
+        {
+            /* Broadcast repeated on the next hop channel, reported after the last one. */
+        }
         else if (status & NRF_FLAG_TX_DS)
         {
+            if (g_ctx.adv_restore)
+            {
+                g_ctx.adv_restore = false;
+                nrf_channel_set(g_ctx.adv_channels[0]);
+            }
             __LOG(LOG_LEVEL_DEBUG, "%s[%u]: status %02X\r\n", __func__, __LINE__, status);
             proc->state = RADIO_STATE_PKT_SENT;
             radio_state_pkt_sent_handle(&proc->sent);
+            radio_tx_complete(RADIO_STATE_PKT_SENT);
         }
         else if (status & NRF_FLAG_MAX_RT)
         {
              __LOG(LOG_LEVEL_DEBUG, "%s[%u]: status %02X\r\n", __func__, __LINE__, status);
             proc->state = RADIO_STATE_PKT_LOST;
             radio_state_pkt_lost_handle(&proc->lost);
+            radio_tx_complete(RADIO_STATE_PKT_LOST);
         }
         else if (status & NRF_FLAG_TX_FULL)
         {
             proc->state = RADIO_STATE_FIFO_FULL;
             radio_state_fifo_full_handle();
         }
-        else
+
+        /* One flag is handled per call and the others keep the line low without a new edge. */
+        if (irq_used && (status & (NRF_FLAG_RX_DR | NRF_FLAG_TX_DS | NRF_FLAG_MAX_RT)))
         {
-            proc->state = RADIO_STATE_IDLE;
+            g_ctx.irq_state = RADIO_IRQ_ASSERTED;
         }
-
-        g_ctx.irq_state = (g_ctx.irq_state == RADIO_IRQ_ASSERTED) ?
-            RADIO_IRQ_IDLE : RADIO_IRQ_NOT_USED;
     }
 }
 
@@ -6,6 +6,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 /********************************************************************
 *                           Local headers                           *
@@ -14,6 +15,20 @@
 
 #define RADIO_FIFO_DATA_MAX     (32)
 #define RADIO_FIFO_SIZE_MAX     (3)
+#define RADIO_HUB_PIPES_NUM     (6)
+
+/* Channels a broadcast is repeated on in RADIO_MODE_ADVERTISER. */
+#ifndef RADIO_ADV_CHANNELS_MAX
+#define RADIO_ADV_CHANNELS_MAX  (3)
+#endif
+
+/* Minimal CE high time (Thce) that starts a PTX transmission. */
+#define RADIO_CE_PULSE_US       (10)
+
+/* Payload slots the RX FIFO is drained into before the RX callback runs. */
+#ifndef RADIO_RX_RING_SIZE
+#define RADIO_RX_RING_SIZE      (RADIO_FIFO_SIZE_MAX)
+#endif
 
 /********************************************************************
 *                       Function macro defines                      *
@@ -28,6 +43,8 @@ typedef enum
     RADIO_E_INVALID_PARAM,
     RADIO_E_CHIP_FAIL,
     RADIO_E_INTERNAL,
+    RADIO_E_BUSY,
+    RADIO_E_NO_MEM,
 } radio_error_t;
 
 typedef enum
@@ -79,15 +96,7 @@ typedef struct
 
 typedef struct
 {
-    uint8_t addr[RADIO_ADDR_SIZE];
-    uint8_t len;
-    uint8_t payload[RADIO_FIFO_DATA_MAX];
-} radio_pkt_t;
-
-typedef struct
-{
-    uint8_t     cnt;
-    radio_pkt_t pkt[RADIO_FIFO_SIZE_MAX];
+    uint8_t cnt;    /* < Payloads handed to the RX callback. */
 } radio_pkt_received_t;
 
 typedef struct
@@ -114,12 +123,24 @@ typedef struct
 typedef void (*spi_tx_rx_t)(uint8_t *tx_buff, uint8_t *rx_buff, uint8_t len);
 typedef void (*ce_high_t)(void);
 typedef void (*ce_low_t)(void);
-typedef void (*delay_t)(uint32_t ms);
+typedef void (*delay_us_t)(uint16_t us);
+
+/* Called from radio_proccess() with RADIO_STATE_PKT_SENT or RADIO_STATE_PKT_LOST
+ * once the packet started by radio_send() is done. */
+typedef void (*radio_tx_cb_t)(radio_state_t result);
+
+/* Called from radio_proccess() for every received payload, pipe is the nRF pipe 0..5.
+ * p_data points into the driver's RX ring and is only valid until the callback returns. */
+typedef void (*radio_rx_cb_t)(uint8_t pipe, uint8_t *p_data, uint8_t len);
+
+/* Per pipe handler of the hub, takes precedence over radio_rx_cb_t for its pipe.
+ * Same lifetime rules for p_data as radio_rx_cb_t. */
+typedef void (*radio_pipe_handler_t)(uint8_t *p_data, uint8_t len, void *p_context);
 
 /********************************************************************
 *                                API                                *
 ********************************************************************/
-radio_error_t radio_init(spi_tx_rx_t spi, ce_high_t ce_high, ce_low_t ce_low,  delay_t delay);
+radio_error_t radio_init(spi_tx_rx_t spi, ce_high_t ce_high, ce_low_t ce_low, delay_us_t delay_us);
 radio_error_t radio_setup(radio_mode_t mode, uint8_t channel);
 
 /* Base address width 4 bytes.
@@ -128,10 +149,45 @@ radio_error_t radio_setup(radio_mode_t mode, uint8_t channel);
 // radio_error_t radio_rx_addr(uint8_t *base_addr, uint8_t *pipes_addr);
 radio_error_t radio_rx_pipe_open(radio_pipe_t pipe, uint8_t *pipes_addr);
 radio_error_t radio_rx_pipe_close(radio_pipe_t pipe);
+/* Hub mode: one node per pipe 1..5, each with auto ACK, dynamic payload length and its own handler.
+ * addr is the full node address, LSB first. All pipes must share addr[1..4], the first one
+ * opened fixes it, P1 keeps its own LSB until it is opened. Pipe 0 is rejected, radio_tx_addr()
+ * and radio_request() rewrite it on every send. */
+radio_error_t radio_hub_pipe_open(uint8_t pipe, uint8_t *addr, radio_pipe_handler_t handler, void *p_context);
+radio_error_t radio_hub_pipe_close(uint8_t pipe);
 radio_error_t radio_tx_addr(uint8_t *addr);
 radio_error_t radio_receive(void);
+void radio_rx_cb_set(radio_rx_cb_t cb);
+/* Starts the transmission and returns, the result comes through radio_proccess(). */
 radio_error_t radio_send(uint8_t *pkt, uint8_t pkt_len);
-
+void radio_tx_cb_set(radio_tx_cb_t cb);
+bool radio_tx_busy(void);
+
+/* Fire and forget: no ACK is awaited and no retransmit is made, TX_DS comes right after
+ * the frame is on air. Works in both modes. */
+radio_error_t radio_send_no_ack(uint8_t *pkt, uint8_t pkt_len);
+
+/* RADIO_MODE_ADVERTISER: radio_advertise() sends the packet without ACK once on every channel
+ * of the hop set, a receiver parked on any of them gets it. The TX callback runs after the last
+ * one. The hop set defaults to the radio_setup() channel, the radio listens on channels[0]. */
+radio_error_t radio_adv_channels_set(const uint8_t *channels, uint8_t num);
+radio_error_t radio_advertise(uint8_t *pkt, uint8_t pkt_len);
+
+/* Request/response over ACK payloads (shockburst mode only).
+ * The requester sends with radio_request(), the reply comes back inside the auto ACK and is
+ * handed to on_response before the TX callback reports RADIO_STATE_PKT_SENT. Pipe 0 goes back
+ * to its previous handler after the response or when the send ends without one.
+ * The responder preloads its reply with radio_ack_payload_set() for the pipe the request
+ * arrives on. The chip sends whatever is loaded when the request comes in, so a reply built
+ * in the request handler rides on the ACK of the next request from that node. A reply going
+ * out is not reported to the TX callback. Loaded replies share the TX FIFO, so the own sends
+ * return RADIO_E_BUSY until they are gone or flushed by radio_tx_addr(). */
+radio_error_t radio_request(uint8_t *pkt, uint8_t pkt_len, radio_pipe_handler_t on_response, void *p_context);
+radio_error_t radio_ack_payload_set(uint8_t pipe, uint8_t *data, uint8_t len);
+
+/* Reflect RX_DR, TX_DS and MAX_RT on the IRQ pin. radio_irq_handle() must then be
+ * called from the falling edge ISR, radio_proccess() only reads STATUS after it. */
+radio_error_t radio_irq_enable(void);
 void radio_irq_handle(void);
 void radio_proccess(radio_proccess_t *proc);
 
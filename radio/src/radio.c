@@ -3,6 +3,10 @@
 ********************************************************************/
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
 
 /********************************************************************
 *                           Local headers                           *
@@ -19,34 +23,141 @@
 #define CE_DDR      (DDRB)
 #define CE_PORT     (PORTB)
 
+#define ADDR_SIZE   (5)
+
+/* RX settling (Tstby2a) plus the time RPD needs to latch. */
+#define RPD_SETTLE_US   (170)
+
+/* nRF24 IRQ is active low and stays low while any STATUS flag is set. */
+#define IRQ_PIN     (2)
+#define IRQ_DDR     (DDRD)
+#define IRQ_PORT    (PORTD)
+#define IRQ_IN      (PIND)
+
+#define IRQ_IS_ACTIVE()     (!(IRQ_IN & (1 << IRQ_PIN)))
+
 /********************************************************************
 *                             Typedefs                              *
 ********************************************************************/
+typedef enum
+{
+    TX_STATE_IDLE,
+    TX_STATE_SINGLE,    /* < One payload, RX resumes on its TX_DS. */
+    TX_STATE_STREAM     /* < The chip sends whatever reaches the TX FIFO until it runs dry. */
+} tx_state_t;
+
+typedef struct
+{
+    uint8_t        channels[RADIO_HOP_CHANNELS_MAX];
+    uint8_t        num;
+    uint8_t        idx;
+    bool           pending;     /* < Link monitor tripped, hop as soon as TX is idle. */
+    bool           plos_reset;  /* < PLOS window is over, rewrite RF_CH as soon as TX is idle. */
+    int16_t        arc_avg;     /* < Retries per packet in 1/16 units. */
+    uint8_t        pkt_cnt;     /* < Packets in the current PLOS window. */
+    radio_hop_cb_t cb;
+} hop_t;
+
+typedef struct
+{
+    uint8_t    buff[NRF_RX_SLOT_SIZE];
+    uint8_t    len;
+    nrf_pipe_t pipe;
+} rx_slot_t;
+
+/* Payload reads chained from SPI_STC_vect: width, payload, width, ... until the RX FIFO
+ * is empty or the ring is full. radio_proccess() hands the filled slots to the callback. */
+typedef struct
+{
+    rx_slot_t          slots[RADIO_RX_RING_SIZE];
+    spi_transaction_t  transaction;
+    uint8_t            wid[NRF_WIDTH_FRAME_SIZE];
+    uint8_t            head;        /* < Slot the chain fills next, SPI_STC_vect only. */
+    uint8_t            tail;        /* < Slot the callback gets next, main loop only. */
+    volatile uint8_t   cnt;         /* < Filled slots. */
+    volatile bool      busy;        /* < A read of the chain is on the SPI queue. */
+    volatile bool      again;       /* < RX_DR came meanwhile or the ring filled up, read on. */
+} rx_queue_t;
+
+typedef struct
+{
+    uint8_t    buff[NRF_TX_SLOT_SIZE];
+    uint8_t    len;                 /* < Whole transfer, command byte included. */
+} tx_slot_t;
+
+/* Payloads on their way to the TX FIFO, written from SPI_STC_vect so a send does not wait
+ * for the transfer. A write that finds the FIFO full is dropped by the chip, the slot
+ * stays and goes again after the next TX_DS. */
+typedef struct
+{
+    tx_slot_t          slots[RADIO_TX_QUEUE_SIZE];
+    spi_transaction_t  transaction;
+    uint8_t            rx[NRF_TX_SLOT_SIZE];    /* < STATUS first, the slot stays intact. */
+    uint8_t            head;        /* < Slot filled next, main loop only. */
+    uint8_t            tail;        /* < Slot written next, SPI_STC_vect only. */
+    volatile uint8_t   cnt;         /* < Slots not in the TX FIFO yet. */
+    volatile bool      busy;        /* < A write is on the SPI queue. */
+} tx_queue_t;
 
 /********************************************************************
 *                  Static global data declarations                  *
 ********************************************************************/
+#if defined(RADIO_STATE_IRQ)
+static volatile uint8_t g_irq_pending;
+#endif /* RADIO_STATE_IRQ */
+
+static tx_state_t    g_tx_state;
+static radio_tx_cb_t g_tx_cb;
+
+/* TX and P0 addresses currently programmed into the chip. */
+static uint8_t       g_tx_addr[ADDR_SIZE];
+static bool          g_tx_addr_valid;
+
+static tx_queue_t    g_tx_queue;
+static rx_queue_t    g_rx_queue;
+static radio_rx_cb_t g_rx_cb;
+
+static uint8_t       g_channel = RADIO_CHANNEL_DEFAULT;
+static hop_t         g_hop;
+
+/* RPD hits of radio_channel_scan() when the caller does not want them, too big for the stack. */
+static uint8_t       g_scan_hits[NRF_CHANNELS_NUM];
 
 /********************************************************************
 *                     Functions implementations                     *
 ********************************************************************/
+/* Blocking adapter for the nRF24 register layer, which returns register values and STATUS
+ * to its callers and keeps its buffers on the stack. Payloads do not take it, they go
+ * through tx_queue_t and rx_queue_t. The transfer still goes through the SPI queue, so
+ * CSN is framed there and it can not interleave with other queued transfers.
+ * Must not be called with interrupts disabled, the queue is driven from SPI_STC_vect. */
 static void spi_rw(uint8_t *tx, uint8_t *rx, uint8_t length)
 {
-    spi_select();
-    spi_master_send_block(tx, rx, length);
-    spi_unselect();
+    spi_transaction_t transaction = {.p_cs_port = &CSN_PORT,
+                                     .cs_pin    = CSN_PIN,
+                                     .p_tx      = tx,
+                                     .p_rx      = rx,
+                                     .len       = length};
+    if (spi_transaction_push(&transaction) != ERROR_SUCCESS)
+    {
+        return;
+    }
+    while (spi_transaction_busy(&transaction));
 }
 
-static void ce_select(void)
+static void ce_low(void)
 {
     CE_PORT &= ~(1 << CE_PIN);
-    PORTB ^= (1 << 5);
 }
 
-static void ce_unselect(void)
+static void ce_high(void)
 {
     CE_PORT |= (1 << CE_PIN);
-    PORTB ^= (1 << 5);
+}
+
+static bool ce_is_high(void)
+{
+    return CE_PORT & (1 << CE_PIN);
 }
 
 static void ce_init(void)
@@ -55,17 +166,355 @@ static void ce_init(void)
     CE_DDR  |= (1 << CE_PIN);
 }
 
-static void tx_complete(void)
+#if defined(RADIO_STATE_IRQ)
+ISR(INT0_vect)
+{
+    /* SPI belongs to the main loop, only latch the event here. */
+    g_irq_pending = 1;
+}
+
+static void irq_init(void)
+{
+    IRQ_DDR  &= ~(1 << IRQ_PIN);
+    IRQ_PORT |=  (1 << IRQ_PIN);                    /* < IRQ is open drain on some modules. */
+    EICRA     = (EICRA & 0xFC) | (1 << ISC01);      /* < Falling edge on INT0. */
+    EIFR      = (1 << INTF0);
+    EIMSK    |= (1 << INT0);
+    /* The line may already be low, in which case there is no edge to wait for. */
+    g_irq_pending = 1;
+}
+
+/* Returns true and consumes the latched event if the radio raised its IRQ. */
+static bool irq_take(void)
 {
-    ce_unselect();
+    uint8_t sreg = SREG;
+    cli();
+    bool pending = g_irq_pending;
+    g_irq_pending = 0;
+    SREG = sreg;
+    return pending;
+}
+#endif /* RADIO_STATE_IRQ */
+
+static void rx_resume(void)
+{
+    ce_low();
     nrf_mode_set(NRF_MODE_PRX);
+    ce_high();
+    g_tx_state = TX_STATE_IDLE;
+}
+
+static void tx_report(radio_error_t result)
+{
+    if (g_tx_cb)
+    {
+        g_tx_cb(result);
+    }
+}
+
+static void queue_push(spi_transaction_t *p_transaction, uint8_t *p_tx, uint8_t *p_rx,
+                       uint8_t len, spi_transaction_cb_t cb)
+{
+    p_transaction->p_cs_port = &CSN_PORT;
+    p_transaction->cs_pin    = CSN_PIN;
+    p_transaction->p_tx      = p_tx;
+    p_transaction->p_rx      = p_rx;
+    p_transaction->len       = len;
+    p_transaction->cb        = cb;
+    spi_transaction_push(p_transaction);
+}
+
+static void rx_read_next(void);
+
+static void rx_read_end(spi_transaction_t *p_transaction)
+{
+    if (g_rx_queue.again)
+    {
+        g_rx_queue.again = false;
+        rx_read_next();
+        return;
+    }
+    g_rx_queue.busy = false;
+}
+
+static void rx_payload_done(spi_transaction_t *p_transaction)
+{
+    g_rx_queue.head = (g_rx_queue.head + 1) % RADIO_RX_RING_SIZE;
+    g_rx_queue.cnt++;
+    rx_read_next();
+}
+
+static void rx_width_done(spi_transaction_t *p_transaction)
+{
+    rx_slot_t   *p_slot = &g_rx_queue.slots[g_rx_queue.head];
+    nrf_error_t error   = nrf_frame_width_result(g_rx_queue.wid, &p_slot->len, &p_slot->pipe);
+    if (error == NRF_E_SUCCESS)
+    {
+        queue_push(&g_rx_queue.transaction, p_slot->buff, p_slot->buff,
+                   nrf_frame_read(p_slot->buff, p_slot->len), rx_payload_done);
+    }
+    else if (error == NRF_E_INVALID_SIZE)
+    {
+        /* Corrupted width, the datasheet asks to flush the RX FIFO. */
+        queue_push(&g_rx_queue.transaction, g_rx_queue.wid, NULL,
+                   nrf_frame_flush_rx(g_rx_queue.wid), rx_read_end);
+    }
+    else
+    {
+        rx_read_end(p_transaction);
+    }
+}
+
+/* From SPI_STC_vect or with interrupts disabled. */
+static void rx_read_next(void)
+{
+    if (g_rx_queue.cnt == RADIO_RX_RING_SIZE)
+    {
+        /* Goes on from rx_deliver() once a slot is free. */
+        g_rx_queue.again = true;
+        g_rx_queue.busy  = false;
+        return;
+    }
+
+    g_rx_queue.busy = true;
+    queue_push(&g_rx_queue.transaction, g_rx_queue.wid, g_rx_queue.wid,
+               nrf_frame_width(g_rx_queue.wid), rx_width_done);
+}
+
+/* RX_DR seen. A running chain may have found the FIFO empty just before the packet came,
+ * so it reads on once more instead. */
+static void rx_read_start(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    if (g_rx_queue.busy)
+    {
+        g_rx_queue.again = true;
+    }
+    else
+    {
+        rx_read_next();
+    }
+    SREG = sreg;
+}
+
+/* Runs the callback on what the chain read, the chain keeps filling the freed slots. */
+static void rx_deliver(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint8_t cnt = g_rx_queue.cnt;
+    SREG = sreg;
+
+    for (; cnt; --cnt)
+    {
+        rx_slot_t *p_slot = &g_rx_queue.slots[g_rx_queue.tail];
+        if (g_rx_cb)
+        {
+            g_rx_cb(p_slot->pipe, &p_slot->buff[NRF_RX_SLOT_OFFSET], p_slot->len);
+        }
+        g_rx_queue.tail = (g_rx_queue.tail + 1) % RADIO_RX_RING_SIZE;
+
+        sreg = SREG;
+        cli();
+        g_rx_queue.cnt--;
+        if (g_rx_queue.again && !g_rx_queue.busy)
+        {
+            g_rx_queue.again = false;
+            rx_read_next();
+        }
+        SREG = sreg;
+    }
+}
+
+static void tx_write_next(void);
+
+static void tx_write_done(spi_transaction_t *p_transaction)
+{
+    if (nrf_frame_push_result(g_tx_queue.rx) != NRF_E_SUCCESS)
+    {
+        /* Dropped on a full TX FIFO, tx_write_kick() tries again after the next TX_DS. */
+        g_tx_queue.busy = false;
+        return;
+    }
+
+    g_tx_queue.tail = (g_tx_queue.tail + 1) % RADIO_TX_QUEUE_SIZE;
+    g_tx_queue.cnt--;
+    tx_write_next();
+}
+
+/* From SPI_STC_vect or with interrupts disabled. */
+static void tx_write_next(void)
+{
+    if (g_tx_queue.cnt == 0)
+    {
+        g_tx_queue.busy = false;
+        return;
+    }
+
+    tx_slot_t *p_slot = &g_tx_queue.slots[g_tx_queue.tail];
+    g_tx_queue.busy = true;
+    queue_push(&g_tx_queue.transaction, p_slot->buff, g_tx_queue.rx, p_slot->len, tx_write_done);
+}
+
+static void tx_write_kick(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    if (!g_tx_queue.busy)
+    {
+        tx_write_next();
+    }
+    SREG = sreg;
+}
+
+static radio_error_t tx_enqueue(uint8_t *pkt, uint8_t len, bool ack)
+{
+    if (g_tx_queue.cnt == RADIO_TX_QUEUE_SIZE)
+    {
+        return RADIO_E_NO_MEM;
+    }
+
+    tx_slot_t *p_slot = &g_tx_queue.slots[g_tx_queue.head];
+    p_slot->len = nrf_frame_push(p_slot->buff, pkt, len, ack);
+    if (p_slot->len == 0)
+    {
+        return RADIO_E_NO_MEM;
+    }
+    g_tx_queue.head = (g_tx_queue.head + 1) % RADIO_TX_QUEUE_SIZE;
+
+    uint8_t sreg = SREG;
+    cli();
+    g_tx_queue.cnt++;
+    if (!g_tx_queue.busy)
+    {
+        tx_write_next();
+    }
+    SREG = sreg;
+    return RADIO_E_SUCCESS;
+}
+
+static bool tx_queue_empty(void)
+{
+    return g_tx_queue.cnt == 0;
+}
+
+/* MAX_RT: the failed payload, the ones behind it in the TX FIFO and the queued ones go. */
+static void tx_queue_flush(void)
+{
+    /* A write still on the SPI queue would land behind the flush. */
+    while (g_tx_queue.busy);
+
+    uint8_t sreg = SREG;
+    cli();
+    g_tx_queue.cnt  = 0;
+    g_tx_queue.tail = g_tx_queue.head;
+    SREG = sreg;
+
+    nrf_flush_tx_fifo();
+}
+
+static void channel_apply(uint8_t channel)
+{
+    g_channel        = channel;
+    g_hop.arc_avg    = 0;
+    g_hop.pkt_cnt    = 0;
+    g_hop.pending    = false;
+    g_hop.plos_reset = false;
+    nrf_channel_set(channel);
+}
+
+/* Called once per TX result, OBSERVE_TX then describes the packet that just finished. */
+static void link_update(void)
+{
+    if (g_hop.num < 2)
+    {
+        return;
+    }
+
+    uint8_t arc, plos;
+    nrf_observe_tx(&arc, &plos);
+
+    g_hop.arc_avg += (((int16_t)arc << 4) - g_hop.arc_avg) / 8;
+    if (plos >= RADIO_HOP_PLOS_LIMIT || g_hop.arc_avg >= (RADIO_HOP_ARC_LIMIT << 4))
+    {
+        g_hop.pending = true;
+    }
+    else if (++g_hop.pkt_cnt >= RADIO_HOP_WINDOW)
+    {
+        /* Rewriting RF_CH restarts PLOS, so it counts losses per window rather than forever.
+         * A stream that never lets TX go idle keeps counting until it does. */
+        g_hop.pkt_cnt    = 0;
+        g_hop.plos_reset = true;
+    }
+}
+
+/* RF_CH must not change under a packet that is still on air. */
+static void hop_try(void)
+{
+    if (g_tx_state != TX_STATE_IDLE)
+    {
+        return;
+    }
+
+    if (g_hop.pending)
+    {
+        radio_hop_next();
+    }
+    else if (g_hop.plos_reset)
+    {
+        g_hop.plos_reset = false;
+        nrf_channel_set(g_channel);
+    }
+}
+
+/* TX and P0 (for the auto ACK) are only rewritten when the destination changes. */
+static radio_error_t tx_addr_set(uint8_t *addr)
+{
+    if (g_tx_addr_valid && memcmp(g_tx_addr, addr, ADDR_SIZE) == 0)
+    {
+        return RADIO_E_SUCCESS;
+    }
+
+    g_tx_addr_valid = false;
+    if (nrf_pipe_open(NRF_PIPE_TX, addr) != NRF_E_SUCCESS ||
+        nrf_pipe_open(NRF_RX_P0, addr) != NRF_E_SUCCESS)
+    {
+        return RADIO_E_INTERNAL;
+    }
+
+    memcpy(g_tx_addr, addr, ADDR_SIZE);
+    g_tx_addr_valid = true;
+    return RADIO_E_SUCCESS;
+}
+
+/* Leaves RX, queues the first payload and raises CE. With CE high in PTX the chip sends
+ * as soon as the payload reaches the TX FIFO and waits in standby-II for the next one. */
+static radio_error_t tx_start(uint8_t *addr, uint8_t *pkt, uint8_t len, bool ack)
+{
+    ce_low();
+
+    radio_error_t error = tx_addr_set(addr);
+    if (error == RADIO_E_SUCCESS)
+    {
+        nrf_mode_set(NRF_MODE_PTX);
+        error = tx_enqueue(pkt, len, ack);
+    }
+
+    if (error != RADIO_E_SUCCESS)
+    {
+        rx_resume();
+        return error;
+    }
+
+    ce_high();
+    return RADIO_E_SUCCESS;
 }
 
 /********************************************************************
 *                                API                                *
 ********************************************************************/
 #include "logger.h"
-#include <util/delay.h>
 static void print_detail(void)
 {
     uint8_t addr[] = {0xDE, 0xAD, 0xBE, 0xEF, 0x1};
@@ -104,10 +553,14 @@ radio_error_t radio_init(void)
 
     nrf_status_clear(NRF_STATUS_MAX_RT | NRF_STATUS_RX_DR | NRF_STATUS_TX_DS);
 
+#if defined(RADIO_STATE_IRQ)
+    irq_init();
+#endif /* RADIO_STATE_IRQ */
+
     nrf_setup_t config = {.addr_size = NRF_ADDR_SIZE_5B,
                           .retr      = NRF_AUTO_RETR_10,
                           .delay     = 0x0F,
-                          .channel   = 40,
+                          .channel   = g_channel,
                           .crc_mode  = NRF_CRC_1B};
     
     nrf_setup(&config);
@@ -117,29 +570,66 @@ radio_error_t radio_init(void)
     return RADIO_E_SUCCESS;
 }
 
-radio_error_t radio_pkt_send(uint8_t *addr, uint8_t *pkt, uint8_t len)
+static radio_error_t pkt_send(uint8_t *addr, uint8_t *pkt, uint8_t len, bool ack)
 {
-    nrf_error_t error = nrf_fifo_push(pkt, len);
-    if (error != NRF_E_SUCCESS)
+    if (g_tx_state != TX_STATE_IDLE)
     {
-        return RADIO_E_NO_MEM;
+        return RADIO_E_BUSY;
     }
 
-    if (nrf_pipe_open(NRF_PIPE_TX, addr) != NRF_E_SUCCESS)
+    radio_error_t error = tx_start(addr, pkt, len, ack);
+    if (error == RADIO_E_SUCCESS)
     {
-        return RADIO_E_INTERNAL;
+        g_tx_state = TX_STATE_SINGLE;
     }
+    return error;
+}
 
-    if (nrf_pipe_open(NRF_RX_P0, addr) != NRF_E_SUCCESS)
+radio_error_t radio_pkt_send(uint8_t *addr, uint8_t *pkt, uint8_t len)
+{
+    return pkt_send(addr, pkt, len, true);
+}
+
+radio_error_t radio_pkt_send_no_ack(uint8_t *addr, uint8_t *pkt, uint8_t len)
+{
+    return pkt_send(addr, pkt, len, false);
+}
+
+radio_error_t radio_stream_send(uint8_t *addr, uint8_t *pkt, uint8_t len)
+{
+    if (g_tx_state == TX_STATE_IDLE)
     {
-        return RADIO_E_INTERNAL;
+        /* CE stays high, the chip goes from one payload to the next without leaving PTX. */
+        radio_error_t error = tx_start(addr, pkt, len, true);
+        if (error == RADIO_E_SUCCESS)
+        {
+            g_tx_state = TX_STATE_STREAM;
+        }
+        return error;
     }
 
-    nrf_mode_set(NRF_MODE_PTX);
-    ce_select();
-    _delay_ms(100);
-    ce_unselect();
-    return RADIO_E_SUCCESS;
+    /* The address can not change under the payloads that are still queued for it. */
+    if (g_tx_state != TX_STATE_STREAM || memcmp(g_tx_addr, addr, ADDR_SIZE) != 0)
+    {
+        return RADIO_E_BUSY;
+    }
+
+    return tx_enqueue(pkt, len, true);
+}
+
+void radio_tx_cb_set(radio_tx_cb_t cb)
+{
+    g_tx_cb = cb;
+}
+
+bool radio_tx_busy(void)
+{
+    return g_tx_state != TX_STATE_IDLE;
+}
+
+void radio_rx_cb_set(radio_rx_cb_t cb)
+{
+    g_rx_cb = cb;
 }
 
 radio_error_t radio_listen(uint8_t *addr)
@@ -150,46 +640,209 @@ radio_error_t radio_listen(uint8_t *addr)
     }
 
     nrf_mode_set(NRF_MODE_PRX);
-    ce_unselect();
+    ce_high();
     __LOG(LOG_LEVEL_DEBUG, "Start listerning...\r\n");
     return RADIO_E_SUCCESS;
 }
 
 void radio_proccess(void)
 {
+    rx_deliver();
+
+#if defined(RADIO_STATE_IRQ)
+    if (!irq_take())
+    {
+        return;
+    }
+#endif /* RADIO_STATE_IRQ */
+
     nrf_status_t status = nrf_status_get();
-    if (status & NRF_STATUS_TX_DS)
+    if (!status)
+    {
+        return;
+    }
+
+    /* CE is held high while sending, clearing MAX_RT would let the failed payload go again. */
+    if ((status & NRF_STATUS_MAX_RT) && g_tx_state != TX_STATE_IDLE)
+    {
+        ce_low();
+    }
+
+    /* Clear before draining: a packet landing meanwhile raises the IRQ again
+     * instead of being hidden behind an already set RX_DR. */
+    nrf_status_clear(status);
+
+#if defined(RADIO_STATE_IRQ)
+    /* A flag set between the read and the clear keeps the line low without a new edge. */
+    if (IRQ_IS_ACTIVE())
+    {
+        g_irq_pending = 1;
+    }
+#endif /* RADIO_STATE_IRQ */
+
+    if (status & NRF_STATUS_RX_DR)
+    {
+        rx_read_start();
+    }
+
+    /* TX_DS or MAX_RT without a send of ours in flight is stale, it was cleared above. */
+    if (g_tx_state == TX_STATE_IDLE)
     {
-        __LOG(LOG_LEVEL_DEBUG, "Packet sent\r\n");
-        tx_complete();
-        nrf_status_clear(NRF_STATUS_TX_DS);
+        return;
     }
-    else if (status & NRF_STATUS_RX_DR)
+
+    if (status & (NRF_STATUS_TX_DS | NRF_STATUS_MAX_RT))
+    {
+        link_update();
+    }
+
+    if (status & NRF_STATUS_TX_DS)
     {
-        uint8_t pkt[MAX_PAYLOAD_SIZE];
-        uint8_t pkt_size = 0;
-        nrf_pipe_t pipe;
-        nrf_error_t error = nrf_fifo_pop(pkt, &pkt_size, &pipe);
-        if (error != NRF_E_SUCCESS)
+        if (g_tx_state == TX_STATE_SINGLE)
         {
-            __LOG(LOG_LEVEL_DEBUG, "Fifo pop fail %u\r\n", error);
+            rx_resume();
+            hop_try();
         }
         else
         {
-            pkt[pkt_size] = '\0';
-            __LOG(LOG_LEVEL_DEBUG, "%s\r\n", (char *)pkt);
+            /* Room in the TX FIFO for a write it dropped. */
+            tx_write_kick();
+        }
+        /* A streaming sender refills the queue from here. */
+        tx_report(RADIO_E_SUCCESS);
+    }
+
+    if (status & NRF_STATUS_MAX_RT)
+    {
+        /* The failed payload and the ones queued behind it stay in the TX FIFO until flushed. */
+        tx_queue_flush();
+        rx_resume();
+        hop_try();
+        tx_report(RADIO_E_TX_FAILED);
+    }
+    else if ((status & NRF_STATUS_TX_DS) &&
+             g_tx_state == TX_STATE_STREAM && tx_queue_empty() && nrf_tx_fifo_empty())
+    {
+        rx_resume();
+        hop_try();
+    }
+}
+
+radio_error_t radio_channel_scan(uint8_t sweeps, uint8_t *p_hits, uint8_t *p_best)
+{
+    if (p_best == NULL || sweeps == 0)
+    {
+        return RADIO_E_INVALID_CONFIG;
+    }
+
+    if (g_tx_state != TX_STATE_IDLE)
+    {
+        return RADIO_E_BUSY;
+    }
+
+    if (p_hits == NULL)
+    {
+        p_hits = g_scan_hits;
+    }
+    memset(p_hits, 0, NRF_CHANNELS_NUM);
+
+    bool       ce_was_high = ce_is_high();
+    nrf_mode_t mode        = nrf_mode_get();
+    ce_low();
+    nrf_mode_set(NRF_MODE_PRX);
+    for (uint8_t sweep = 0; sweep < sweeps; ++sweep)
+    {
+        for (uint8_t ch = 0; ch < NRF_CHANNELS_NUM; ++ch)
+        {
+            nrf_channel_set(ch);
+            ce_high();
+            _delay_us(RPD_SETTLE_US);
+            if (nrf_rpd_get() && p_hits[ch] < UINT8_MAX)
+            {
+                p_hits[ch]++;
+            }
+            ce_low();
         }
-        nrf_status_clear(NRF_STATUS_RX_DR);
     }
-    else if (status & NRF_STATUS_MAX_RT)
+
+    /* A 2 Mbps link is 2 MHz wide, so judge each channel together with its neighbours. */
+    uint16_t best_score = UINT16_MAX;
+    for (uint8_t ch = 0; ch < NRF_CHANNELS_NUM; ++ch)
     {
-        __LOG(LOG_LEVEL_DEBUG, "Max retransmit. Flush fifo\r\n");
-        tx_complete();
-        nrf_flush_tx_fifo();
-        nrf_status_clear(NRF_STATUS_MAX_RT);
+        uint16_t score = p_hits[ch];
+        score += (ch > 0) ? p_hits[ch - 1] : p_hits[ch];
+        score += (ch < NRF_CHANNELS_NUM - 1) ? p_hits[ch + 1] : p_hits[ch];
+        if (score < best_score)
+        {
+            best_score = score;
+            *p_best    = ch;
+        }
     }
-    else if (status)
+
+    nrf_channel_set(g_channel);
+    nrf_mode_set(mode);
+    if (ce_was_high)
     {
-        __LOG(LOG_LEVEL_DEBUG, "Unknown nrf status %02X\r\n", status);
+        ce_high();
     }
-}
\ No newline at end of file
+    return RADIO_E_SUCCESS;
+}
+
+radio_error_t radio_channel_set(uint8_t channel)
+{
+    if (channel >= NRF_CHANNELS_NUM)
+    {
+        return RADIO_E_INVALID_CONFIG;
+    }
+
+    if (g_tx_state != TX_STATE_IDLE)
+    {
+        return RADIO_E_BUSY;
+    }
+
+    channel_apply(channel);
+    return RADIO_E_SUCCESS;
+}
+
+radio_error_t radio_hop_channels_set(const uint8_t *channels, uint8_t num, radio_hop_cb_t cb)
+{
+    if (channels == NULL || num == 0 || num > RADIO_HOP_CHANNELS_MAX)
+    {
+        return RADIO_E_INVALID_CONFIG;
+    }
+
+    for (uint8_t i = 0; i < num; ++i)
+    {
+        if (channels[i] >= NRF_CHANNELS_NUM)
+        {
+            return RADIO_E_INVALID_CONFIG;
+        }
+        g_hop.channels[i] = channels[i];
+    }
+    g_hop.num = num;
+    g_hop.idx = 0;
+    g_hop.cb  = cb;
+
+    return radio_channel_set(channels[0]);
+}
+
+radio_error_t radio_hop_next(void)
+{
+    if (g_hop.num == 0)
+    {
+        return RADIO_E_INVALID_CONFIG;
+    }
+
+    if (g_tx_state != TX_STATE_IDLE)
+    {
+        return RADIO_E_BUSY;
+    }
+
+    g_hop.idx = (g_hop.idx + 1) % g_hop.num;
+    channel_apply(g_hop.channels[g_hop.idx]);
+    if (g_hop.cb)
+    {
+        g_hop.cb(g_channel);
+    }
+    return RADIO_E_SUCCESS;
+}
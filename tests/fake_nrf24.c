@@ -0,0 +1,617 @@
+#include <string.h>
+
+#include "fake_nrf24.h"
+
+#define REG_CONFIG          (0x00)
+#define REG_EN_AA           (0x01)
+#define REG_EN_RXADDR       (0x02)
+#define REG_SETUP_AW        (0x03)
+#define REG_SETUP_RETR      (0x04)
+#define REG_RF_CH           (0x05)
+#define REG_RF_SETUP        (0x06)
+#define REG_STATUS          (0x07)
+#define REG_OBSERVE_TX      (0x08)
+#define REG_RPD             (0x09)
+#define REG_RX_ADDR_P0      (0x0A)
+#define REG_TX_ADDR         (0x10)
+#define REG_FIFO_STATUS     (0x17)
+#define REG_DYNPD           (0x1C)
+#define REG_FEATURE         (0x1D)
+
+#define CMD_R_RX_PL_WID     (0x60)
+#define CMD_R_RX_PAYLOAD    (0x61)
+#define CMD_W_TX_PAYLOAD    (0xA0)
+#define CMD_W_ACK_PAYLOAD   (0xA8)
+#define CMD_W_TX_NOACK      (0xB0)
+#define CMD_FLUSH_TX        (0xE1)
+#define CMD_FLUSH_RX        (0xE2)
+
+#define CONFIG_PRIM_RX      (1 << 0)
+#define CONFIG_PWR_UP       (1 << 1)
+#define CONFIG_CRCO         (1 << 2)
+#define CONFIG_EN_CRC       (1 << 3)
+#define STATUS_FLAGS        (0x70)
+#define STATUS_RX_DR        (1 << 6)
+#define STATUS_TX_DS        (1 << 5)
+#define STATUS_MAX_RT       (1 << 4)
+#define FEATURE_EN_DYN_ACK  (1 << 0)
+#define FEATURE_EN_ACK_PAY  (1 << 1)
+#define RF_SETUP_DR_HIGH    (1 << 3)
+
+#define FIFO_DEPTH          (3)
+#define ADDR_MAX            (5)
+#define PEER_ARD_US         (500)
+#define PEER_ARC            (15)
+
+typedef enum
+{
+    SLOT_TX,
+    SLOT_TX_NO_ACK,
+    SLOT_ACK_PL,
+} slot_kind_t;
+
+typedef struct
+{
+    uint8_t     data[32];
+    uint8_t     len;
+    uint8_t     pipe;
+    slot_kind_t kind;
+} slot_t;
+
+typedef struct
+{
+    bool        active;
+    uint8_t     addr[ADDR_MAX];
+    uint8_t     data[32];
+    uint8_t     len;
+    uint8_t     tries;
+    uint64_t    at;                         /* < End of the current attempt on air. */
+} peer_tx_t;
+
+fake_nrf24_peer_t g_fake_peer;
+fake_nrf24_stat_t g_fake_stat;
+uint8_t           g_fake_noise[FAKE_NRF24_CHANNELS];
+
+static uint64_t          m_now;
+static uint8_t           m_regs[0x20];
+static uint8_t           m_addr[7][ADDR_MAX];   /* < P0..P5, TX. P2..P5 only use the LSB. */
+static uint8_t           m_plos;
+static uint8_t           m_arc;
+static slot_t            m_tx_fifo[FIFO_DEPTH];
+static uint8_t           m_tx_cnt;
+static slot_t            m_rx_fifo[FIFO_DEPTH];
+static uint8_t           m_rx_cnt;
+static bool              m_ce;
+static bool              m_ce_latched;      /* < CE pulse seen in PTX, one payload goes out. */
+static bool              m_tx_active;
+static bool              m_tx_ok;
+static bool              m_tx_acked;        /* < Sent with an ACK expected. */
+static uint64_t          m_tx_end;
+static uint32_t          m_frame_no;
+static peer_tx_t         m_peer_tx;
+static bool              m_irq_line;
+static fake_nrf24_edge_t m_edge;
+
+/*****************************************************************************/
+/*                         Chip state                                        */
+/*****************************************************************************/
+static uint8_t addr_width(void)
+{
+    return m_regs[REG_SETUP_AW] + 2;
+}
+
+static bool ptx(void)
+{
+    return (m_regs[REG_CONFIG] & (CONFIG_PWR_UP | CONFIG_PRIM_RX)) == CONFIG_PWR_UP;
+}
+
+static bool listening(void)
+{
+    return (m_regs[REG_CONFIG] & (CONFIG_PWR_UP | CONFIG_PRIM_RX)) == (CONFIG_PWR_UP | CONFIG_PRIM_RX) &&
+           m_ce && !m_tx_active;
+}
+
+static uint8_t status_get(void)
+{
+    uint8_t rx_p_no = m_rx_cnt ? m_rx_fifo[0].pipe : 0x07;
+    return (m_regs[REG_STATUS] & STATUS_FLAGS) | (rx_p_no << 1) | (m_tx_cnt == FIFO_DEPTH ? 1 : 0);
+}
+
+/* Preamble, address, packet control field, payload and CRC. */
+static uint32_t air_us(uint8_t len)
+{
+    uint32_t bits = 8 + addr_width() * 8 + 9 + len * 8;
+    if (m_regs[REG_CONFIG] & CONFIG_EN_CRC)
+    {
+        bits += (m_regs[REG_CONFIG] & CONFIG_CRCO) ? 16 : 8;
+    }
+    return (m_regs[REG_RF_SETUP] & RF_SETUP_DR_HIGH) ? (bits + 1) / 2 : bits;
+}
+
+static void slot_pop(slot_t *p_fifo, uint8_t *p_cnt, uint8_t idx)
+{
+    memmove(&p_fifo[idx], &p_fifo[idx + 1], (*p_cnt - idx - 1) * sizeof(slot_t));
+    (*p_cnt)--;
+}
+
+static bool rx_push(uint8_t pipe, const uint8_t *p_data, uint8_t len)
+{
+    if (m_rx_cnt == FIFO_DEPTH)
+    {
+        return false;
+    }
+    slot_t *p_slot = &m_rx_fifo[m_rx_cnt++];
+    memcpy(p_slot->data, p_data, len);
+    p_slot->len  = len;
+    p_slot->pipe = pipe;
+    m_regs[REG_STATUS] |= STATUS_RX_DR;
+    return true;
+}
+
+static void irq_update(void)
+{
+    bool line = fake_nrf24_irq_active();
+    if (line && !m_irq_line && m_edge)
+    {
+        m_irq_line = line;
+        m_edge();
+    }
+    m_irq_line = line;
+}
+
+/*****************************************************************************/
+/*                         Own transmissions                                 */
+/*****************************************************************************/
+static bool peer_hears(void)
+{
+    if (g_fake_peer.deaf)
+    {
+        return false;
+    }
+    if (g_fake_peer.channel != FAKE_NRF24_ANY_CHANNEL && g_fake_peer.channel != m_regs[REG_RF_CH])
+    {
+        return false;
+    }
+    m_frame_no++;
+    return !g_fake_peer.loss_every || (m_frame_no % g_fake_peer.loss_every) != 0;
+}
+
+/* One attempt of the top payload, the outcome is known at m_tx_end. */
+static void tx_attempt(void)
+{
+    slot_t *p_slot = &m_tx_fifo[0];
+    bool no_ack    = p_slot->kind == SLOT_TX_NO_ACK && (m_regs[REG_FEATURE] & FEATURE_EN_DYN_ACK);
+    bool heard     = peer_hears();
+
+    g_fake_stat.frames_sent++;
+    m_tx_active = true;
+    m_tx_end    = m_now + FAKE_NRF24_SETTLE_US + air_us(p_slot->len);
+    if (heard)
+    {
+        g_fake_peer.channel_log[g_fake_peer.frames % FAKE_NRF24_LOG_SIZE] = m_regs[REG_RF_CH];
+        g_fake_peer.frames++;
+        g_fake_peer.frames_no_ack += no_ack;
+        memcpy(g_fake_peer.last, p_slot->data, p_slot->len);
+        g_fake_peer.last_len = p_slot->len;
+        g_fake_peer.heard_at = m_tx_end;
+    }
+
+    m_tx_acked = !no_ack;
+    if (no_ack)
+    {
+        m_tx_ok = true;
+        return;
+    }
+
+    /* The ACK comes back on P0, so P0 must carry the TX address. */
+    m_tx_ok = heard && memcmp(m_addr[0], m_addr[6], addr_width()) == 0;
+    if (m_tx_ok)
+    {
+        uint8_t ack_len = g_fake_peer.ack_pl_cnt ? g_fake_peer.ack_pl_len : 0;
+        m_tx_end += FAKE_NRF24_SETTLE_US + air_us(ack_len);
+    }
+    else
+    {
+        m_tx_end += ((m_regs[REG_SETUP_RETR] >> 4) + 1) * 250;
+    }
+}
+
+static void tx_kick(void)
+{
+    if (m_tx_active || !ptx() || !(m_ce || m_ce_latched) || !m_tx_cnt ||
+        (m_regs[REG_STATUS] & STATUS_MAX_RT))
+    {
+        return;
+    }
+    m_ce_latched = false;
+    m_arc        = 0;
+    tx_attempt();
+}
+
+static void tx_end(void)
+{
+    m_tx_active = false;
+    if (m_tx_ok)
+    {
+        slot_pop(m_tx_fifo, &m_tx_cnt, 0);
+        m_regs[REG_STATUS] |= STATUS_TX_DS;
+        if (m_tx_acked && g_fake_peer.ack_pl_cnt)
+        {
+            /* The reply needs dynamic payload length on P0 and EN_ACK_PAY to be taken. */
+            g_fake_peer.ack_pl_cnt--;
+            if (g_fake_peer.ack_pl_len && (m_regs[REG_FEATURE] & FEATURE_EN_ACK_PAY) &&
+                (m_regs[REG_DYNPD] & 0x01))
+            {
+                rx_push(0, g_fake_peer.ack_pl, g_fake_peer.ack_pl_len);
+            }
+        }
+        /* CE held high goes on with the next payload. */
+        if (m_ce)
+        {
+            tx_kick();
+        }
+    }
+    else if (m_arc < (m_regs[REG_SETUP_RETR] & 0x0F))
+    {
+        m_arc++;
+        tx_attempt();
+    }
+    else
+    {
+        m_regs[REG_STATUS] |= STATUS_MAX_RT;
+        if (m_plos < 15)
+        {
+            m_plos++;
+        }
+    }
+}
+
+/*****************************************************************************/
+/*                         Peer transmissions                                */
+/*****************************************************************************/
+static int8_t pipe_match(const uint8_t *p_addr)
+{
+    uint8_t aw = addr_width();
+    for (uint8_t pipe = 0; pipe < 6; ++pipe)
+    {
+        if (!(m_regs[REG_EN_RXADDR] & (1 << pipe)))
+        {
+            continue;
+        }
+        uint8_t addr[ADDR_MAX];
+        memcpy(addr, m_addr[pipe < 2 ? pipe : 1], ADDR_MAX);
+        addr[0] = m_addr[pipe][0];
+        if (memcmp(addr, p_addr, aw) == 0)
+        {
+            return pipe;
+        }
+    }
+    return -1;
+}
+
+static void peer_arrival(void)
+{
+    int8_t pipe = listening() ? pipe_match(m_peer_tx.addr) : -1;
+    if (pipe >= 0 && (g_fake_peer.channel == FAKE_NRF24_ANY_CHANNEL ||
+                      g_fake_peer.channel == m_regs[REG_RF_CH]) &&
+        rx_push(pipe, m_peer_tx.data, m_peer_tx.len))
+    {
+        m_peer_tx.active = false;
+        if (!(m_regs[REG_EN_AA] & (1 << pipe)))
+        {
+            return;
+        }
+        /* The first ACK payload loaded for the pipe rides on the ACK. */
+        for (uint8_t i = 0; i < m_tx_cnt; ++i)
+        {
+            if (m_tx_fifo[i].kind == SLOT_ACK_PL && m_tx_fifo[i].pipe == pipe)
+            {
+                memcpy(g_fake_peer.reply, m_tx_fifo[i].data, m_tx_fifo[i].len);
+                g_fake_peer.reply_len = m_tx_fifo[i].len;
+                g_fake_peer.replies++;
+                slot_pop(m_tx_fifo, &m_tx_cnt, i);
+                m_regs[REG_STATUS] |= STATUS_TX_DS;
+                break;
+            }
+        }
+        return;
+    }
+
+    if (++m_peer_tx.tries > PEER_ARC)
+    {
+        m_peer_tx.active = false;
+        g_fake_peer.sends_failed++;
+        return;
+    }
+    m_peer_tx.at += PEER_ARD_US + air_us(m_peer_tx.len);
+}
+
+static void advance(uint64_t until)
+{
+    for (;;)
+    {
+        uint64_t next = UINT64_MAX;
+        if (m_tx_active)
+        {
+            next = m_tx_end;
+        }
+        if (m_peer_tx.active && m_peer_tx.at < next)
+        {
+            next = m_peer_tx.at;
+        }
+        if (next > until)
+        {
+            break;
+        }
+
+        m_now = next;
+        if (m_tx_active && m_tx_end == next)
+        {
+            tx_end();
+        }
+        else
+        {
+            peer_arrival();
+        }
+        irq_update();
+    }
+    m_now = until;
+}
+
+/*****************************************************************************/
+/*                         SPI                                               */
+/*****************************************************************************/
+static uint8_t reg_byte(uint8_t reg, uint8_t idx)
+{
+    switch (reg)
+    {
+        case REG_STATUS:      return status_get();
+        case REG_OBSERVE_TX:  return (m_plos << 4) | m_arc;
+        case REG_RPD:         return g_fake_noise[m_regs[REG_RF_CH] % FAKE_NRF24_CHANNELS] ? 1 : 0;
+        case REG_FIFO_STATUS:
+            return (m_tx_cnt == FIFO_DEPTH ? 0x20 : 0) | (m_tx_cnt == 0 ? 0x10 : 0) |
+                   (m_rx_cnt == FIFO_DEPTH ? 0x02 : 0) | (m_rx_cnt == 0 ? 0x01 : 0);
+        default:
+            break;
+    }
+
+    if (reg >= REG_RX_ADDR_P0 && reg <= REG_TX_ADDR)
+    {
+        uint8_t width = (reg == REG_RX_ADDR_P0 || reg == REG_RX_ADDR_P0 + 1 || reg == REG_TX_ADDR) ?
+                        ADDR_MAX : 1;
+        return (idx < width) ? m_addr[reg - REG_RX_ADDR_P0][idx] : 0;
+    }
+    return idx ? 0 : m_regs[reg];
+}
+
+static void reg_write(uint8_t reg, const uint8_t *p_data, uint8_t len)
+{
+    if (!len)
+    {
+        return;
+    }
+
+    if (reg >= REG_RX_ADDR_P0 && reg <= REG_TX_ADDR)
+    {
+        memcpy(m_addr[reg - REG_RX_ADDR_P0], p_data, len < ADDR_MAX ? len : ADDR_MAX);
+        return;
+    }
+
+    switch (reg)
+    {
+        case REG_STATUS:
+            m_regs[REG_STATUS] &= ~(p_data[0] & STATUS_FLAGS);
+            break;
+        case REG_RF_CH:
+            /* Writing RF_CH restarts PLOS. */
+            g_fake_stat.rf_ch_writes++;
+            g_fake_stat.rf_ch_in_flight += m_tx_active;
+            m_regs[REG_RF_CH] = p_data[0] & 0x7F;
+            m_plos = 0;
+            break;
+        case REG_CONFIG:
+            m_regs[REG_CONFIG] = p_data[0];
+            if (!ptx())
+            {
+                m_ce_latched = false;
+            }
+            break;
+        case REG_OBSERVE_TX:
+        case REG_RPD:
+        case REG_FIFO_STATUS:
+            break;
+        default:
+            m_regs[reg] = p_data[0];
+            break;
+    }
+}
+
+static void tx_push(slot_kind_t kind, uint8_t pipe, const uint8_t *p_data, uint8_t len)
+{
+    /* A full FIFO drops the write, the caller sees TX_FULL on the command byte. */
+    if (m_tx_cnt == FIFO_DEPTH || len > 32)
+    {
+        return;
+    }
+    slot_t *p_slot = &m_tx_fifo[m_tx_cnt++];
+    memcpy(p_slot->data, p_data, len);
+    p_slot->len  = len;
+    p_slot->pipe = pipe;
+    p_slot->kind = kind;
+}
+
+void fake_nrf24_spi(uint8_t *p_tx, uint8_t *p_rx, uint8_t len)
+{
+    uint8_t in[64]  = {0};
+    uint8_t out[64] = {0};
+    if (!len || len > sizeof(in))
+    {
+        return;
+    }
+    memcpy(in, p_tx, len);
+
+    g_fake_stat.spi_transactions++;
+    g_fake_stat.spi_bytes += len;
+    advance(m_now + (uint64_t)len * FAKE_NRF24_SPI_BYTE_US);
+
+    /* STATUS is shifted out while the command byte goes in. */
+    out[0]      = status_get();
+    uint8_t cmd = in[0];
+    if (cmd < 0x20)
+    {
+        for (uint8_t i = 1; i < len; ++i)
+        {
+            out[i] = reg_byte(cmd, i - 1);
+        }
+    }
+    else if (cmd < 0x40)
+    {
+        reg_write(cmd & 0x1F, &in[1], len - 1);
+    }
+    else if (cmd == CMD_R_RX_PL_WID)
+    {
+        out[1] = m_rx_cnt ? m_rx_fifo[0].len : 0;
+    }
+    else if (cmd == CMD_R_RX_PAYLOAD)
+    {
+        if (m_rx_cnt)
+        {
+            memcpy(&out[1], m_rx_fifo[0].data, m_rx_fifo[0].len);
+            slot_pop(m_rx_fifo, &m_rx_cnt, 0);
+        }
+    }
+    else if (cmd == CMD_W_TX_PAYLOAD)
+    {
+        g_fake_stat.w_tx_payload++;
+        tx_push(SLOT_TX, 0, &in[1], len - 1);
+    }
+    else if (cmd == CMD_W_TX_NOACK)
+    {
+        g_fake_stat.w_tx_payload_no_ack++;
+        tx_push(SLOT_TX_NO_ACK, 0, &in[1], len - 1);
+    }
+    else if ((cmd & 0xF8) == CMD_W_ACK_PAYLOAD)
+    {
+        g_fake_stat.w_ack_payload++;
+        tx_push(SLOT_ACK_PL, cmd & 0x07, &in[1], len - 1);
+    }
+    else if (cmd == CMD_FLUSH_TX)
+    {
+        m_tx_cnt = 0;
+    }
+    else if (cmd == CMD_FLUSH_RX)
+    {
+        m_rx_cnt = 0;
+    }
+
+    if (p_rx)
+    {
+        memcpy(p_rx, out, len);
+    }
+    tx_kick();
+    irq_update();
+}
+
+/*****************************************************************************/
+/*                         API                                               */
+/*****************************************************************************/
+void fake_nrf24_reset(void)
+{
+    static const uint8_t reset[][ADDR_MAX] =
+    {
+        {0xE7, 0xE7, 0xE7, 0xE7, 0xE7}, {0xC2, 0xC2, 0xC2, 0xC2, 0xC2},
+        {0xC3}, {0xC4}, {0xC5}, {0xC6},
+        {0xE7, 0xE7, 0xE7, 0xE7, 0xE7},
+    };
+
+    memset(m_regs, 0, sizeof(m_regs));
+    m_regs[REG_CONFIG]     = CONFIG_EN_CRC;
+    m_regs[REG_EN_AA]      = 0x3F;
+    m_regs[REG_EN_RXADDR]  = 0x03;
+    m_regs[REG_SETUP_AW]   = 0x03;
+    m_regs[REG_SETUP_RETR] = 0x03;
+    m_regs[REG_RF_CH]      = 0x02;
+    m_regs[REG_RF_SETUP]   = 0x0F;
+    memcpy(m_addr, reset, sizeof(m_addr));
+
+    memset(&g_fake_peer, 0, sizeof(g_fake_peer));
+    memset(&g_fake_stat, 0, sizeof(g_fake_stat));
+    memset(g_fake_noise, 0, sizeof(g_fake_noise));
+    memset(&m_peer_tx, 0, sizeof(m_peer_tx));
+    g_fake_peer.channel = FAKE_NRF24_ANY_CHANNEL;
+
+    m_now        = 0;
+    m_plos       = 0;
+    m_arc        = 0;
+    m_tx_cnt     = 0;
+    m_rx_cnt     = 0;
+    m_ce         = false;
+    m_ce_latched = false;
+    m_tx_active  = false;
+    m_frame_no   = 0;
+    m_irq_line   = false;
+    m_edge       = NULL;
+}
+
+void fake_nrf24_ce(bool high)
+{
+    if (high && !m_ce && ptx())
+    {
+        m_ce_latched = true;
+    }
+    m_ce = high;
+    tx_kick();
+    irq_update();
+}
+
+void fake_nrf24_edge_set(fake_nrf24_edge_t edge)
+{
+    m_edge = edge;
+}
+
+bool fake_nrf24_irq_active(void)
+{
+    /* CONFIG masks sit on the same bits as the STATUS flags. */
+    return m_regs[REG_STATUS] & STATUS_FLAGS & ~m_regs[REG_CONFIG];
+}
+
+void fake_nrf24_run(uint32_t us)
+{
+    advance(m_now + us);
+    tx_kick();
+    irq_update();
+}
+
+uint64_t fake_nrf24_now(void)
+{
+    return m_now;
+}
+
+uint8_t fake_nrf24_reg(uint8_t reg)
+{
+    return reg_byte(reg, 0);
+}
+
+void fake_nrf24_flags_set(uint8_t flags)
+{
+    m_regs[REG_STATUS] |= flags & STATUS_FLAGS;
+    irq_update();
+}
+
+void fake_nrf24_addr(uint8_t reg, uint8_t *p_addr)
+{
+    for (uint8_t i = 0; i < ADDR_MAX; ++i)
+    {
+        p_addr[i] = reg_byte(reg, i);
+    }
+}
+
+void fake_nrf24_peer_send(const uint8_t *p_addr, const uint8_t *p_data, uint8_t len)
+{
+    memcpy(m_peer_tx.addr, p_addr, ADDR_MAX);
+    memcpy(m_peer_tx.data, p_data, len);
+    m_peer_tx.len    = len;
+    m_peer_tx.tries  = 0;
+    m_peer_tx.at     = m_now + FAKE_NRF24_SETTLE_US + air_us(len);
+    m_peer_tx.active = true;
+}
@@ -0,0 +1,74 @@
+#ifndef FAKE_NRF24_H__
+#define FAKE_NRF24_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* nRF24L01+ model behind the SPI callback both radio layers take, with one peer on the air.
+ * Time is virtual: SPI bytes, CE pulses, settling, air time and retransmit delays move the
+ * clock, fake_nrf24_run() moves it for the main loop. The figures come from the datasheet
+ * timings, they are not measured on a real link. */
+
+#define FAKE_NRF24_SPI_BYTE_US  (8)         /* < SCK at F_CPU / 16. */
+#define FAKE_NRF24_SETTLE_US    (130)       /* < Tstby2a, also the PRX turnaround for the ACK. */
+#define FAKE_NRF24_CHANNELS     (126)
+#define FAKE_NRF24_ANY_CHANNEL  (0xFF)
+#define FAKE_NRF24_LOG_SIZE     (16)
+
+typedef void (*fake_nrf24_edge_t)(void);
+
+/* The other end of the link, a PRX for our sends and a PTX for fake_nrf24_peer_send(). */
+typedef struct
+{
+    bool        deaf;                       /* < Never ACKs, every send ends in MAX_RT. */
+    uint16_t    loss_every;                 /* < Every n-th frame of ours is lost, 0 for none. */
+    uint8_t     channel;                    /* < FAKE_NRF24_ANY_CHANNEL hears all of them. */
+    uint8_t     ack_pl[32];                 /* < Reply attached to the next ACK. */
+    uint8_t     ack_pl_len;                 /* < 0 for a plain ACK. */
+    uint8_t     ack_pl_cnt;                 /* < ACKs that carry ack_pl, it is used up after. */
+    uint32_t    frames;                     /* < Frames of ours it received. */
+    uint32_t    frames_no_ack;
+    uint8_t     last[32];
+    uint8_t     last_len;
+    uint64_t    heard_at;                   /* < End of the last received frame. */
+    uint8_t     channel_log[FAKE_NRF24_LOG_SIZE];   /* < Channel of each received frame. */
+    uint32_t    replies;                    /* < ACK payloads it got back from us. */
+    uint8_t     reply[32];
+    uint8_t     reply_len;
+    uint32_t    sends_failed;               /* < Own frames that ran out of retransmits. */
+} fake_nrf24_peer_t;
+
+typedef struct
+{
+    uint32_t    spi_transactions;
+    uint32_t    spi_bytes;
+    uint32_t    w_tx_payload;
+    uint32_t    w_tx_payload_no_ack;
+    uint32_t    w_ack_payload;
+    uint32_t    rf_ch_writes;
+    uint32_t    rf_ch_in_flight;            /* < RF_CH written under a packet still on air. */
+    uint32_t    frames_sent;                /* < Transmissions, retransmits included. */
+} fake_nrf24_stat_t;
+
+extern fake_nrf24_peer_t g_fake_peer;
+extern fake_nrf24_stat_t g_fake_stat;
+/* RPD reads 1 on channels with a non zero entry. */
+extern uint8_t           g_fake_noise[FAKE_NRF24_CHANNELS];
+
+/* Power-on reset values, empty FIFOs, time 0, silent peer on any channel. */
+void     fake_nrf24_reset(void);
+void     fake_nrf24_spi(uint8_t *p_tx, uint8_t *p_rx, uint8_t len);
+void     fake_nrf24_ce(bool high);
+/* Called when the IRQ line goes low, i.e. the falling edge the ISR sees. */
+void     fake_nrf24_edge_set(fake_nrf24_edge_t edge);
+bool     fake_nrf24_irq_active(void);
+void     fake_nrf24_run(uint32_t us);
+uint64_t fake_nrf24_now(void);
+uint8_t  fake_nrf24_reg(uint8_t reg);
+/* Raises STATUS flags by hand, e.g. a TX_DS that no send of the driver caused. */
+void     fake_nrf24_flags_set(uint8_t flags);
+void     fake_nrf24_addr(uint8_t reg, uint8_t *p_addr);
+/* Peer sends a frame to addr (5 bytes, LSB first). It retransmits while nobody ACKs it. */
+void     fake_nrf24_peer_send(const uint8_t *p_addr, const uint8_t *p_data, uint8_t len);
+
+#endif /* FAKE_NRF24_H__ */
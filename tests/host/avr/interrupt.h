@@ -0,0 +1,11 @@
+#ifndef HOST_AVR_INTERRUPT_H__
+#define HOST_AVR_INTERRUPT_H__
+
+#include <avr/io.h>
+
+/* Vectors become plain functions the test calls to deliver an interrupt. */
+#define ISR(_vector)    void _vector(void)
+#define cli()           (SREG &= (uint8_t)~(1 << SREG_I))
+#define sei()           (SREG |= (1 << SREG_I))
+
+#endif /* HOST_AVR_INTERRUPT_H__ */
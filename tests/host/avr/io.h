@@ -0,0 +1,70 @@
+#ifndef HOST_AVR_IO_H__
+#define HOST_AVR_IO_H__
+
+/* Host stand-in for avr/io.h, registers are plain variables from regs.c.
+ * A test can model a register by defining it as an expression before the
+ * first include. */
+
+#include <stdint.h>
+
+#define HOST_REG(_name)     extern volatile uint8_t _name;
+#define HOST_REG16(_name)   extern volatile uint16_t _name;
+
+HOST_REG(SREG)
+HOST_REG(TIMSK0) HOST_REG(OCR0A) HOST_REG(TCCR0A) HOST_REG(TCCR0B)
+#ifndef TCNT0
+HOST_REG(TCNT0)
+#endif
+#ifndef TIFR0
+HOST_REG(TIFR0)
+#endif
+HOST_REG(TIMSK1) HOST_REG(TIFR1) HOST_REG(TCCR1A) HOST_REG(TCCR1B)
+HOST_REG16(TCNT1) HOST_REG16(OCR1A)
+#ifndef TWCR
+HOST_REG(TWCR)
+#endif
+HOST_REG(TWSR) HOST_REG(TWDR) HOST_REG(TWBR)
+#ifndef UDR0
+HOST_REG(UDR0)
+#endif
+HOST_REG(UCSR0B) HOST_REG(UCSR0C) HOST_REG(UBRR0H) HOST_REG(UBRR0L)
+HOST_REG(DDRB) HOST_REG(PORTB) HOST_REG(DDRD) HOST_REG(PORTD)
+#ifndef PIND
+HOST_REG(PIND)
+#endif
+HOST_REG(EICRA) HOST_REG(EIFR) HOST_REG(EIMSK)
+
+#define SREG_I          7
+
+#define OCF0A           1
+#define OCIE0A          1
+#define WGM01           1
+#define CS00            0
+#define CS01            1
+
+#define TOV1            0
+#define TOIE1           0
+#define OCF1A           1
+#define OCIE1A          1
+#define CS10            0
+#define CS11            1
+
+#define TWINT           7
+#define TWEA            6
+#define TWSTA           5
+#define TWSTO           4
+#define TWEN            2
+#define TWIE            0
+
+#define RXCIE0          7
+#define UDRIE0          5
+#define RXEN0           4
+#define TXEN0           3
+#define UCSZ01          2
+#define UCSZ00          1
+
+#define ISC01           1
+#define INTF0           0
+#define INT0            0
+
+#endif /* HOST_AVR_IO_H__ */
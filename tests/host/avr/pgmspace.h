@@ -0,0 +1,14 @@
+#ifndef HOST_AVR_PGMSPACE_H__
+#define HOST_AVR_PGMSPACE_H__
+
+/* Host stand-in for avr/pgmspace.h, flash is ordinary memory. */
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(_s)                (_s)
+#define pgm_read_byte(_addr)    (*(const uint8_t*)(_addr))
+#define memcpy_P                memcpy
+
+#endif /* HOST_AVR_PGMSPACE_H__ */
@@ -0,0 +1,16 @@
+#ifndef HOST_AVR_SLEEP_H__
+#define HOST_AVR_SLEEP_H__
+
+/* Host stand-in for avr/sleep.h. sleep_cpu() calls into the test, which lets
+ * its model run until the next interrupt. */
+
+#define SLEEP_MODE_IDLE     (0)
+
+void host_sleep_cpu(void);
+
+#define set_sleep_mode(_mode)
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu()         host_sleep_cpu()
+
+#endif /* HOST_AVR_SLEEP_H__ */
@@ -0,0 +1,33 @@
+#include <avr/io.h>
+
+/* Interrupts start enabled, as after INTERRUPT_ENABLE() in the projects. */
+volatile uint8_t SREG = (1 << SREG_I);
+volatile uint8_t TIMSK0;
+volatile uint8_t OCR0A;
+volatile uint8_t TCCR0A;
+volatile uint8_t TCCR0B;
+volatile uint8_t TCNT0;
+volatile uint8_t TIFR0;
+volatile uint8_t TIMSK1;
+volatile uint8_t TIFR1;
+volatile uint8_t TCCR1A;
+volatile uint8_t TCCR1B;
+volatile uint16_t TCNT1;
+volatile uint16_t OCR1A;
+volatile uint8_t TWCR;
+volatile uint8_t TWSR;
+volatile uint8_t TWDR;
+volatile uint8_t TWBR;
+volatile uint8_t UDR0;
+volatile uint8_t UCSR0B;
+volatile uint8_t UCSR0C;
+volatile uint8_t UBRR0H;
+volatile uint8_t UBRR0L;
+volatile uint8_t DDRB;
+volatile uint8_t PORTB;
+volatile uint8_t DDRD;
+volatile uint8_t PORTD;
+volatile uint8_t PIND;
+volatile uint8_t EICRA;
+volatile uint8_t EIFR;
+volatile uint8_t EIMSK;
@@ -0,0 +1,14 @@
+#ifndef HOST_UTIL_DELAY_H__
+#define HOST_UTIL_DELAY_H__
+
+/* Host stand-in for util/delay.h, busy waits take no time.
+ * A test can route them into its model by defining them before the first include. */
+
+#ifndef _delay_ms
+#define _delay_ms(_ms)  ((void)(_ms))
+#endif
+#ifndef _delay_us
+#define _delay_us(_us)  ((void)(_us))
+#endif
+
+#endif /* HOST_UTIL_DELAY_H__ */
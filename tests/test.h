@@ -0,0 +1,78 @@
+#ifndef TEST_H__
+#define TEST_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+/* Minimal host test harness. Every test binary runs its checks and returns
+ * non-zero on failure, "bench" as the first argument runs the benchmarks too. */
+
+static unsigned g_test_checks;
+static unsigned g_test_failures;
+
+#define CHECK(_cond)                                                            \
+    do {                                                                        \
+        g_test_checks++;                                                        \
+        if (!(_cond))                                                           \
+        {                                                                       \
+            g_test_failures++;                                                  \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #_cond);    \
+        }                                                                       \
+    } while (0)
+
+#define CHECK_EQ(_actual, _expected)                                            \
+    do {                                                                        \
+        long long _a = (long long)(_actual);                                    \
+        long long _e = (long long)(_expected);                                  \
+        g_test_checks++;                                                        \
+        if (_a != _e)                                                           \
+        {                                                                       \
+            g_test_failures++;                                                  \
+            printf("%s:%d: %s is %lld, expected %lld\n",                        \
+                   __FILE__, __LINE__, #_actual, _a, _e);                       \
+        }                                                                       \
+    } while (0)
+
+#define TEST_RUN(_test)                                                         \
+    do {                                                                        \
+        printf("  %s\n", #_test);                                               \
+        _test();                                                                \
+    } while (0)
+
+static inline bool test_bench_requested(int argc, char **argv)
+{
+    return argc > 1 && strcmp(argv[1], "bench") == 0;
+}
+
+static inline int test_report(const char *p_name)
+{
+    printf("%s: %u checks, %u failed\n", p_name, g_test_checks, g_test_failures);
+    return g_test_failures ? 1 : 0;
+}
+
+/* Host clock for the benchmarks: TSC cycles on x86, nanoseconds elsewhere.
+ * The numbers compare algorithms against each other, they are not AVR cycles. */
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT      "cycles"
+static inline uint64_t bench_ticks(void)
+{
+    return __rdtsc();
+}
+#else
+#define BENCH_UNIT      "ns"
+static inline uint64_t bench_ticks(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#endif
+
+/* Keeps results of benchmarked code alive. */
+static volatile uint32_t g_bench_sink;
+
+#endif /* TEST_H__ */
@@ -0,0 +1,321 @@
+#include <stdlib.h>
+#include "test.h"
+#include "app_timer.h"
+#include "timer_timestamp.h"
+
+/* Built once per backend, see the Makefile. */
+#if APP_TIMER_BACKEND == APP_TIMER_BACKEND_WHEEL
+#define BACKEND_NAME        "app_timer wheel"
+#else
+#define BACKEND_NAME        "app_timer list"
+#endif
+
+#define TIMERS_MAX          (256)
+#define BENCH_ROUNDS        (20000UL)
+
+typedef struct
+{
+    uint32_t    fired_at;
+    uint16_t    fired_num;
+    uint32_t    period;             /* < Returned from the callback, APP_TIMER_STOP for one-shot. */
+} probe_t;
+
+static app_timer_t m_timers[TIMERS_MAX];
+static probe_t     m_probes[TIMERS_MAX];
+static uint32_t    m_now;
+
+/* The timestamp module is replaced by a clock the test advances. */
+void timer_timestamp_init(void)
+{
+}
+
+uint32_t timer_timestamp_ms_get(void)
+{
+    return m_now;
+}
+
+static uint32_t probe_cb(void *p_context)
+{
+    probe_t *p_probe = p_context;
+    p_probe->fired_at = m_now;
+    p_probe->fired_num++;
+    return p_probe->period;
+}
+
+static void setup(uint32_t now, uint16_t num)
+{
+    m_now = now;
+    app_timer_init();
+    memset(m_probes, 0, sizeof(m_probes));
+    for (uint16_t i = 0; i < num; ++i)
+    {
+        m_probes[i].period = APP_TIMER_STOP;
+        app_timer_create(&m_timers[i], probe_cb, &m_probes[i]);
+    }
+}
+
+static void advance(uint32_t ms)
+{
+    for (uint32_t i = 0; i < ms; ++i)
+    {
+        m_now++;
+        app_timer_process();
+    }
+}
+
+static void test_one_shot_fires_on_time(void)
+{
+    setup(1000, 1);
+    app_timer_process();
+    app_timer_add(&m_timers[0], 10);
+    advance(9);
+    CHECK_EQ(m_probes[0].fired_num, 0);
+    advance(1);
+    CHECK_EQ(m_probes[0].fired_num, 1);
+    CHECK_EQ(m_probes[0].fired_at, 1010);
+    advance(100);
+    CHECK_EQ(m_probes[0].fired_num, 1);
+}
+
+static void test_periodic_refires(void)
+{
+    setup(0, 1);
+    m_probes[0].period = 7;
+    app_timer_add(&m_timers[0], 7);
+    advance(70);
+    CHECK_EQ(m_probes[0].fired_num, 10);
+    CHECK_EQ(m_probes[0].fired_at, 70);
+}
+
+static void test_fires_in_deadline_order(void)
+{
+    static const uint32_t timeouts[] = {50, 3, 1000, 20, 3000, 40000, 7};
+    const uint8_t num = sizeof(timeouts) / sizeof(timeouts[0]);
+
+    setup(5, num);
+    for (uint8_t i = 0; i < num; ++i)
+    {
+        app_timer_add(&m_timers[i], timeouts[i]);
+    }
+    advance(50000);
+    for (uint8_t i = 0; i < num; ++i)
+    {
+        CHECK_EQ(m_probes[i].fired_num, 1);
+        CHECK_EQ(m_probes[i].fired_at, 5 + timeouts[i]);
+    }
+}
+
+static void test_remove_and_reschedule(void)
+{
+    setup(0, 3);
+    app_timer_add(&m_timers[0], 10);
+    app_timer_add(&m_timers[1], 10);
+    app_timer_add(&m_timers[2], 10);
+
+    app_timer_remove(&m_timers[1]);
+    app_timer_remove(&m_timers[1]);
+    app_timer_reschedule(&m_timers[2], 25);
+    advance(10);
+    CHECK_EQ(m_probes[0].fired_num, 1);
+    CHECK_EQ(m_probes[1].fired_num, 0);
+    CHECK_EQ(m_probes[2].fired_num, 0);
+    advance(15);
+    CHECK_EQ(m_probes[2].fired_num, 1);
+    CHECK_EQ(m_probes[2].fired_at, 25);
+
+    /* Removing a timer that was never added, or already fired, is harmless. */
+    app_timer_create(&m_timers[1], probe_cb, &m_probes[1]);
+    app_timer_remove(&m_timers[1]);
+    app_timer_remove(&m_timers[0]);
+    app_timer_add(&m_timers[1], 1);
+    advance(1);
+    CHECK_EQ(m_probes[1].fired_num, 1);
+}
+
+static void test_create_clears_stale_links(void)
+{
+    setup(0, 2);
+    app_timer_add(&m_timers[0], 5);
+
+    /* Stack or reused memory: the links hold garbage until app_timer_create(). */
+    memset(&m_timers[1], 0xA5, sizeof(m_timers[1]));
+    app_timer_create(&m_timers[1], probe_cb, &m_probes[1]);
+    CHECK(m_timers[1].p_next == NULL);
+    app_timer_add(&m_timers[1], 5);
+    advance(5);
+    CHECK_EQ(m_probes[0].fired_num, 1);
+    CHECK_EQ(m_probes[1].fired_num, 1);
+}
+
+static uint32_t restart_other_cb(void *p_context)
+{
+    app_timer_t *p_other = p_context;
+    app_timer_remove(p_other);
+    app_timer_add(p_other, 3);
+    return 10;
+}
+
+static void test_callback_modifies_timers(void)
+{
+    setup(0, 2);
+    app_timer_create(&m_timers[0], restart_other_cb, &m_timers[1]);
+    app_timer_add(&m_timers[0], 10);
+    app_timer_add(&m_timers[1], 10);
+
+    /* Both are due in the same ms, whichever runs first the other is pushed out by 3 ms
+     * at most once per period. */
+    advance(30);
+    CHECK(m_probes[1].fired_num <= 3);
+    app_timer_remove(&m_timers[0]);
+    uint16_t fired = m_probes[1].fired_num;
+    advance(3);
+    CHECK_EQ(m_probes[1].fired_num, fired + 1);
+}
+
+static void test_clock_wraparound(void)
+{
+    setup(0xFFFFFFF0UL, 2);
+    app_timer_process();
+    app_timer_add(&m_timers[0], 0x20);
+    app_timer_add(&m_timers[1], 0x08);
+    advance(0x08);
+    CHECK_EQ(m_probes[1].fired_num, 1);
+    CHECK_EQ(m_probes[0].fired_num, 0);
+    advance(0x18);
+    CHECK_EQ(m_probes[0].fired_num, 1);
+    CHECK_EQ(m_probes[0].fired_at, 0x10);
+}
+
+/* Random add, remove and reschedule: every armed timer fires exactly at its deadline. */
+static void test_random_against_model(void)
+{
+    uint32_t due[32];
+    bool     armed[32] = {false};
+
+    srand(5);
+    setup(12345, 32);
+    for (uint16_t round = 0; round < 3000; ++round)
+    {
+        uint8_t i = rand() % 32;
+        switch (rand() % 3)
+        {
+            case 0:
+            {
+                /* The list backend needs a remove or reschedule for an armed timer. */
+                if (armed[i])
+                {
+                    break;
+                }
+                uint32_t timeout = (rand() & 1) ? rand() % 64 : rand() % 70000;
+                app_timer_add(&m_timers[i], timeout);
+                due[i]   = m_now + timeout;
+                armed[i] = true;
+                break;
+            }
+            case 1:
+                app_timer_remove(&m_timers[i]);
+                armed[i] = false;
+                break;
+            default:
+            {
+                uint32_t timeout = rand() % 2000;
+                app_timer_reschedule(&m_timers[i], timeout);
+                due[i]   = m_now + timeout;
+                armed[i] = true;
+                break;
+            }
+        }
+
+        uint32_t step = rand() % 40;
+        for (uint32_t ms = 0; ms < step; ++ms)
+        {
+            m_now++;
+            for (uint8_t t = 0; t < 32; ++t)
+            {
+                m_probes[t].fired_num = 0;
+            }
+            app_timer_process();
+            for (uint8_t t = 0; t < 32; ++t)
+            {
+                /* A zero timeout is already due and fires on the next processed ms. */
+                bool expect = armed[t] && (due[t] == m_now || due[t] == m_now - 1);
+                CHECK_EQ(m_probes[t].fired_num, expect ? 1 : 0);
+                if (expect)
+                {
+                    armed[t] = false;
+                }
+            }
+        }
+    }
+}
+
+static uint32_t periodic_cb(void *p_context)
+{
+    return (uint32_t)(uintptr_t)p_context;
+}
+
+/* Cost per reschedule and per processed ms with num periodic timers armed. */
+static void bench_count(uint16_t num)
+{
+    setup(0, num);
+    srand(7);
+    for (uint16_t i = 0; i < num; ++i)
+    {
+        uint32_t period = 10 + rand() % 1000;
+        app_timer_create(&m_timers[i], periodic_cb, (void*)(uintptr_t)period);
+        app_timer_add(&m_timers[i], period);
+    }
+
+    uint64_t start = bench_ticks();
+    for (uint32_t i = 0; i < BENCH_ROUNDS; ++i)
+    {
+        app_timer_reschedule(&m_timers[i % num], 10 + (i * 37) % 1000);
+    }
+    uint64_t reschedule = bench_ticks() - start;
+
+    start = bench_ticks();
+    for (uint32_t i = 0; i < BENCH_ROUNDS; ++i)
+    {
+        m_now++;
+        app_timer_process();
+    }
+    uint64_t process = bench_ticks() - start;
+
+    start = bench_ticks();
+    for (uint16_t i = 0; i < num; ++i)
+    {
+        app_timer_remove(&m_timers[i]);
+    }
+    uint64_t remove = bench_ticks() - start;
+
+    printf("    %3u timers  %9.1f  %9.1f  %9.1f\n", num,
+           (double)reschedule / BENCH_ROUNDS, (double)remove / num,
+           (double)process / BENCH_ROUNDS);
+}
+
+static void bench(void)
+{
+    printf("  %s per operation, periodic timers of 10..1009 ms:\n", BENCH_UNIT);
+    printf("                reschedule     remove  process/ms\n");
+    bench_count(4);
+    bench_count(16);
+    bench_count(64);
+    bench_count(256);
+}
+
+int main(int argc, char **argv)
+{
+    TEST_RUN(test_one_shot_fires_on_time);
+    TEST_RUN(test_periodic_refires);
+    TEST_RUN(test_fires_in_deadline_order);
+    TEST_RUN(test_remove_and_reschedule);
+    TEST_RUN(test_create_clears_stale_links);
+    TEST_RUN(test_callback_modifies_timers);
+    TEST_RUN(test_clock_wraparound);
+    TEST_RUN(test_random_against_model);
+    if (test_bench_requested(argc, argv))
+    {
+        bench();
+    }
+    return test_report(BACKEND_NAME);
+}
@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include "test.h"
+#include "fifo.h"
+
+#define RING_SIZE       (128)
+#define BENCH_BYTES     (1000000UL)
+#define BENCH_SPAN      (16)
+
+FIFO_SPSC_INSTANCE_CREATE(m_ring, RING_SIZE);
+FIFO_INSTANCE_CREATE(m_legacy, 1, RING_SIZE);
+
+static void ring_reset(uint8_t index)
+{
+    m_ring.head = index;
+    m_ring.tail = index;
+}
+
+static void test_empty_and_full_at_capacity(void)
+{
+    uint8_t byte = 0;
+
+    ring_reset(0);
+    CHECK_EQ(fifo_spsc_count(&m_ring), 0);
+    CHECK_EQ(fifo_spsc_free(&m_ring), RING_SIZE);
+    CHECK(!fifo_spsc_get(&m_ring, &byte));
+
+    for (uint16_t i = 0; i < RING_SIZE; ++i)
+    {
+        CHECK(fifo_spsc_put(&m_ring, (uint8_t)i));
+    }
+    /* All 128 bytes are usable, no slot is sacrificed to tell full from empty. */
+    CHECK_EQ(fifo_spsc_count(&m_ring), RING_SIZE);
+    CHECK_EQ(fifo_spsc_free(&m_ring), 0);
+    CHECK(!fifo_spsc_put(&m_ring, 0xAA));
+
+    for (uint16_t i = 0; i < RING_SIZE; ++i)
+    {
+        CHECK(fifo_spsc_get(&m_ring, &byte));
+        CHECK_EQ(byte, (uint8_t)i);
+    }
+    CHECK_EQ(fifo_spsc_count(&m_ring), 0);
+    CHECK(!fifo_spsc_get(&m_ring, &byte));
+}
+
+static void test_span_truncated_to_space(void)
+{
+    uint8_t in[RING_SIZE + 8];
+    uint8_t out[RING_SIZE + 8];
+
+    for (uint16_t i = 0; i < sizeof(in); ++i)
+    {
+        in[i] = (uint8_t)(i * 7);
+    }
+
+    ring_reset(0);
+    CHECK_EQ(fifo_spsc_push(&m_ring, in, 100), 100);
+    CHECK_EQ(fifo_spsc_push(&m_ring, in + 100, 100), RING_SIZE - 100);
+    CHECK_EQ(fifo_spsc_push(&m_ring, in, 1), 0);
+
+    CHECK_EQ(fifo_spsc_pop(&m_ring, out, sizeof(out)), RING_SIZE);
+    CHECK(memcmp(in, out, RING_SIZE) == 0);
+    CHECK_EQ(fifo_spsc_pop(&m_ring, out, 1), 0);
+}
+
+static void test_span_wraparound(void)
+{
+    uint8_t in[40];
+    uint8_t out[40];
+
+    for (uint8_t start = RING_SIZE - 20; start != RING_SIZE + 20; ++start)
+    {
+        for (uint8_t i = 0; i < sizeof(in); ++i)
+        {
+            in[i] = start + i;
+        }
+
+        /* The 40 byte span is split across the end of the buffer at every offset. */
+        ring_reset(start);
+        CHECK_EQ(fifo_spsc_push(&m_ring, in, sizeof(in)), sizeof(in));
+        CHECK_EQ(fifo_spsc_count(&m_ring), sizeof(in));
+        memset(out, 0, sizeof(out));
+        CHECK_EQ(fifo_spsc_pop(&m_ring, out, sizeof(out)), sizeof(in));
+        CHECK(memcmp(in, out, sizeof(in)) == 0);
+    }
+}
+
+static void test_free_running_indices(void)
+{
+    uint8_t byte = 0;
+
+    /* Indices run past 255 and wrap, count is their difference modulo 256. */
+    ring_reset(250);
+    for (uint8_t i = 0; i < 10; ++i)
+    {
+        CHECK(fifo_spsc_put(&m_ring, i));
+    }
+    CHECK_EQ(m_ring.head, 4);
+    CHECK_EQ(m_ring.tail, 250);
+    CHECK_EQ(fifo_spsc_count(&m_ring), 10);
+    CHECK_EQ(fifo_spsc_free(&m_ring), RING_SIZE - 10);
+
+    for (uint8_t i = 0; i < 10; ++i)
+    {
+        CHECK(fifo_spsc_get(&m_ring, &byte));
+        CHECK_EQ(byte, i);
+    }
+    CHECK_EQ(m_ring.tail, 4);
+
+    /* Full with the indices straddling the wrap. */
+    ring_reset(200);
+    for (uint16_t i = 0; i < RING_SIZE; ++i)
+    {
+        CHECK(fifo_spsc_put(&m_ring, (uint8_t)i));
+    }
+    CHECK_EQ(m_ring.head, (uint8_t)(200 + RING_SIZE));
+    CHECK(!fifo_spsc_put(&m_ring, 0));
+}
+
+static void test_producer_owns_head_consumer_owns_tail(void)
+{
+    uint8_t data[8] = {0};
+    uint8_t byte = 0;
+
+    ring_reset(10);
+    fifo_spsc_push(&m_ring, data, sizeof(data));
+    CHECK_EQ(m_ring.tail, 10);
+    fifo_spsc_put(&m_ring, 0);
+    CHECK_EQ(m_ring.tail, 10);
+
+    fifo_spsc_pop(&m_ring, data, 4);
+    CHECK_EQ(m_ring.head, 19);
+    fifo_spsc_get(&m_ring, &byte);
+    CHECK_EQ(m_ring.head, 19);
+    CHECK_EQ(m_ring.tail, 15);
+}
+
+/* Random interleaving of both sides against a plain array model. */
+static void test_random_against_model(void)
+{
+    static uint8_t model[1 << 16];
+    uint32_t model_head = 0;
+    uint32_t model_tail = 0;
+    uint8_t  buff[RING_SIZE];
+    uint8_t  next = 0;
+
+    srand(1);
+    ring_reset(0);
+    for (uint16_t round = 0; round < 4000 && model_head < sizeof(model) - RING_SIZE; ++round)
+    {
+        uint8_t len = rand() % 48;
+        if (rand() & 1)
+        {
+            for (uint8_t i = 0; i < len; ++i)
+            {
+                buff[i] = next + i;
+            }
+            uint8_t pushed = fifo_spsc_push(&m_ring, buff, len);
+            uint32_t space = RING_SIZE - (model_head - model_tail);
+            CHECK_EQ(pushed, len < space ? len : space);
+            for (uint8_t i = 0; i < pushed; ++i)
+            {
+                model[model_head++] = next++;
+            }
+        }
+        else
+        {
+            uint8_t popped = fifo_spsc_pop(&m_ring, buff, len);
+            uint32_t count = model_head - model_tail;
+            CHECK_EQ(popped, len < count ? len : count);
+            CHECK(memcmp(buff, &model[model_tail], popped) == 0);
+            model_tail += popped;
+        }
+        CHECK_EQ(fifo_spsc_count(&m_ring), model_head - model_tail);
+    }
+}
+
+static void bench(void)
+{
+    uint8_t  span[BENCH_SPAN] = {0};
+    uint8_t  byte = 0;
+    uint32_t sum = 0;
+    uint64_t start;
+
+    /* Legacy fifo, one element per call with el_size 1. */
+    start = bench_ticks();
+    for (uint32_t i = 0; i < BENCH_BYTES; ++i)
+    {
+        byte = (uint8_t)i;
+        fifo_push(&m_legacy, &byte);
+        sum += *(uint8_t*)fifo_pop(&m_legacy);
+    }
+    uint64_t legacy = bench_ticks() - start;
+
+    ring_reset(0);
+    start = bench_ticks();
+    for (uint32_t i = 0; i < BENCH_BYTES; ++i)
+    {
+        fifo_spsc_put(&m_ring, (uint8_t)i);
+        fifo_spsc_get(&m_ring, &byte);
+        sum += byte;
+    }
+    uint64_t single = bench_ticks() - start;
+
+    ring_reset(0);
+    start = bench_ticks();
+    for (uint32_t i = 0; i < BENCH_BYTES / BENCH_SPAN; ++i)
+    {
+        span[0] = (uint8_t)i;
+        fifo_spsc_push(&m_ring, span, BENCH_SPAN);
+        fifo_spsc_pop(&m_ring, span, BENCH_SPAN);
+        sum += span[0];
+    }
+    uint64_t spans = bench_ticks() - start;
+    g_bench_sink = sum;
+
+    printf("  push+pop per byte, %s:\n", BENCH_UNIT);
+    printf("    fifo_push/fifo_pop            %6.1f\n", (double)legacy / BENCH_BYTES);
+    printf("    fifo_spsc_put/fifo_spsc_get   %6.1f\n", (double)single / BENCH_BYTES);
+    printf("    fifo_spsc_push/pop, %2u spans  %6.1f\n", BENCH_SPAN, (double)spans / BENCH_BYTES);
+}
+
+int main(int argc, char **argv)
+{
+    TEST_RUN(test_empty_and_full_at_capacity);
+    TEST_RUN(test_span_truncated_to_space);
+    TEST_RUN(test_span_wraparound);
+    TEST_RUN(test_free_running_indices);
+    TEST_RUN(test_producer_owns_head_consumer_owns_tail);
+    TEST_RUN(test_random_against_model);
+    if (test_bench_requested(argc, argv))
+    {
+        bench();
+    }
+    return test_report("fifo");
+}
@@ -0,0 +1,393 @@
+#include <stdlib.h>
+#include "test.h"
+#include "list.h"
+
+#define POOL_SIZE       (8)
+#define BENCH_ROUNDS    (200000UL)
+
+LIST_INSTANCE(m_list, sizeof(uint16_t), POOL_SIZE);
+LIST_INSTANCE(m_bench_8, sizeof(uint16_t), 8);
+LIST_INSTANCE(m_bench_32, sizeof(uint16_t), 32);
+LIST_INSTANCE(m_bench_128, sizeof(uint16_t), 128);
+
+static void list_reset(list_t *p_list)
+{
+    p_list->size      = 0;
+    p_list->pool_used = 0;
+    p_list->p_head    = NULL;
+    p_list->p_tail    = NULL;
+    p_list->p_free    = NULL;
+}
+
+static uint16_t value_of(list_node_t *p_node)
+{
+    return *(uint16_t*)list_item_data_get(p_node);
+}
+
+/* Walks the list both ways and compares it with the expected values. */
+static void check_links(list_t *p_list, const uint16_t *p_expected, uint8_t num)
+{
+    list_node_t *p_prev = NULL;
+    uint8_t     i       = 0;
+
+    CHECK_EQ(p_list->size, num);
+    FOREACH(p_list, p_iter)
+    {
+        CHECK(i < num);
+        if (i < num)
+        {
+            CHECK_EQ(value_of(p_iter), p_expected[i]);
+        }
+#ifdef LIST_DOUBLY_LINKED_ENABLE
+        CHECK(p_iter->p_prev == p_prev);
+#endif /* LIST_DOUBLY_LINKED_ENABLE */
+        p_prev = p_iter;
+        i++;
+    }
+    CHECK_EQ(i, num);
+    CHECK(p_list->p_tail == p_prev);
+    if (num)
+    {
+        CHECK_EQ(*(uint16_t*)list_back(p_list), p_expected[num - 1]);
+        CHECK_EQ(*(uint16_t*)list_front(p_list), p_expected[0]);
+    }
+    else
+    {
+        CHECK(list_back(p_list) == NULL);
+        CHECK(list_front(p_list) == NULL);
+    }
+}
+
+static void test_free_list_reuses_released_nodes(void)
+{
+    uint16_t value;
+
+    list_reset(&m_list);
+    for (value = 0; value < POOL_SIZE; ++value)
+    {
+        CHECK_EQ(list_push_back(&m_list, &value), ERROR_SUCCESS);
+    }
+    CHECK_EQ(m_list.pool_used, POOL_SIZE);
+    CHECK_EQ(list_push_back(&m_list, &value), ERROR_NO_MEM);
+    CHECK(m_list.p_free == NULL);
+
+    /* Released nodes are handed out again last in, first out. */
+    list_node_t *p_head = m_list.p_head;
+    list_node_t *p_tail = m_list.p_tail;
+    CHECK_EQ(list_pop_front(&m_list), ERROR_SUCCESS);
+    CHECK_EQ(list_pop_back(&m_list), ERROR_SUCCESS);
+    CHECK(m_list.p_free == p_tail);
+    CHECK(m_list.p_free->p_next == p_head);
+
+    value = 100;
+    CHECK_EQ(list_push_front(&m_list, &value), ERROR_SUCCESS);
+    CHECK(m_list.p_head == p_tail);
+    value = 101;
+    CHECK_EQ(list_push_front(&m_list, &value), ERROR_SUCCESS);
+    CHECK(m_list.p_head == p_head);
+    CHECK(m_list.p_free == NULL);
+    CHECK_EQ(m_list.pool_used, POOL_SIZE);
+    CHECK_EQ(list_push_front(&m_list, &value), ERROR_NO_MEM);
+}
+
+static void test_tail_pointer(void)
+{
+    uint16_t value;
+
+    list_reset(&m_list);
+    check_links(&m_list, NULL, 0);
+
+    value = 1;
+    list_push_front(&m_list, &value);
+    check_links(&m_list, (uint16_t[]){1}, 1);
+    value = 2;
+    list_push_back(&m_list, &value);
+    check_links(&m_list, (uint16_t[]){1, 2}, 2);
+    value = 0;
+    list_push_front(&m_list, &value);
+    check_links(&m_list, (uint16_t[]){0, 1, 2}, 3);
+
+    /* Inserting after the tail moves it, inserting in the middle does not. */
+    value = 3;
+    list_insert_after(&m_list, m_list.p_tail, &value);
+    check_links(&m_list, (uint16_t[]){0, 1, 2, 3}, 4);
+    value = 9;
+    list_insert_after(&m_list, m_list.p_head, &value);
+    check_links(&m_list, (uint16_t[]){0, 9, 1, 2, 3}, 5);
+    value = 8;
+    list_insert_after(&m_list, NULL, &value);
+    check_links(&m_list, (uint16_t[]){8, 0, 9, 1, 2, 3}, 6);
+
+    /* NULL list or data is refused whatever the position, the list is untouched. */
+    CHECK_EQ(list_insert_after(NULL, NULL, &value), ERROR_INVALID_PARAM);
+    CHECK_EQ(list_insert_after(NULL, m_list.p_head, &value), ERROR_INVALID_PARAM);
+    CHECK_EQ(list_insert_after(&m_list, NULL, NULL), ERROR_INVALID_PARAM);
+    CHECK_EQ(list_insert_after(&m_list, m_list.p_tail, NULL), ERROR_INVALID_PARAM);
+    CHECK_EQ(list_insert_after(&m_list, m_list.p_head, NULL), ERROR_INVALID_PARAM);
+    check_links(&m_list, (uint16_t[]){8, 0, 9, 1, 2, 3}, 6);
+
+    list_pop_back(&m_list);
+    check_links(&m_list, (uint16_t[]){8, 0, 9, 1, 2}, 5);
+    list_remove(&m_list, m_list.p_tail);
+    check_links(&m_list, (uint16_t[]){8, 0, 9, 1}, 4);
+    while (m_list.size)
+    {
+        list_pop_back(&m_list);
+    }
+    check_links(&m_list, NULL, 0);
+    CHECK(m_list.p_head == NULL);
+
+    value = 5;
+    list_push_back(&m_list, &value);
+    check_links(&m_list, (uint16_t[]){5}, 1);
+}
+
+static void test_remove_by_node(void)
+{
+    list_node_t *p_nodes[5];
+    uint16_t    value;
+
+    list_reset(&m_list);
+    for (value = 0; value < 5; ++value)
+    {
+        list_push_back(&m_list, &value);
+        p_nodes[value] = m_list.p_tail;
+    }
+
+    CHECK_EQ(list_remove(&m_list, p_nodes[2]), ERROR_SUCCESS);
+    check_links(&m_list, (uint16_t[]){0, 1, 3, 4}, 4);
+    CHECK_EQ(list_remove(&m_list, p_nodes[0]), ERROR_SUCCESS);
+    check_links(&m_list, (uint16_t[]){1, 3, 4}, 3);
+    CHECK_EQ(list_remove(&m_list, p_nodes[4]), ERROR_SUCCESS);
+    check_links(&m_list, (uint16_t[]){1, 3}, 2);
+
+    /* A released node and a node from another pool are rejected, the list is untouched. */
+    CHECK_EQ(list_remove(&m_list, p_nodes[2]), ERROR_NOT_FOUND);
+    value = 7;
+    list_reset(&m_bench_8);
+    list_push_back(&m_bench_8, &value);
+    CHECK_EQ(list_remove(&m_list, m_bench_8.p_head), ERROR_NOT_FOUND);
+    check_links(&m_list, (uint16_t[]){1, 3}, 2);
+
+    /* The task manager goes from element data back to its node. */
+    CHECK(list_item_node_get(list_item_data_get(p_nodes[3])) == p_nodes[3]);
+    CHECK_EQ(list_remove(&m_list, list_item_node_get(list_front(&m_list))), ERROR_SUCCESS);
+    check_links(&m_list, (uint16_t[]){3}, 1);
+    CHECK_EQ(list_remove(&m_list, p_nodes[3]), ERROR_SUCCESS);
+    check_links(&m_list, NULL, 0);
+}
+
+static void test_foreach_safe_removal(void)
+{
+    uint16_t value;
+    uint8_t  visited = 0;
+
+    list_reset(&m_list);
+    for (value = 0; value < POOL_SIZE; ++value)
+    {
+        list_push_back(&m_list, &value);
+    }
+
+    /* Removing the current node pushes it on the free list, the walk must not follow it. */
+    FOREACH_SAFE(&m_list, p_iter, p_next)
+    {
+        visited++;
+        if (value_of(p_iter) & 1)
+        {
+            list_remove(&m_list, p_iter);
+        }
+    }
+    CHECK_EQ(visited, POOL_SIZE);
+    check_links(&m_list, (uint16_t[]){0, 2, 4, 6}, 4);
+
+    visited = 0;
+    FOREACH_SAFE(&m_list, p_iter, p_next)
+    {
+        visited++;
+        list_remove(&m_list, p_iter);
+    }
+    CHECK_EQ(visited, 4);
+    check_links(&m_list, NULL, 0);
+    CHECK_EQ(m_list.pool_used, POOL_SIZE);
+}
+
+/* Random operations against an array model. */
+static void test_random_against_model(void)
+{
+    uint16_t model[POOL_SIZE];
+    uint8_t  num   = 0;
+    uint16_t value = 0;
+
+    srand(3);
+    list_reset(&m_list);
+    for (uint16_t round = 0; round < 20000; ++round)
+    {
+        uint8_t op = rand() % 5;
+        value++;
+        if (op == 0)
+        {
+            error_t err = list_push_front(&m_list, &value);
+            CHECK_EQ(err, num < POOL_SIZE ? ERROR_SUCCESS : ERROR_NO_MEM);
+            if (err == ERROR_SUCCESS)
+            {
+                memmove(&model[1], &model[0], num * sizeof(model[0]));
+                model[0] = value;
+                num++;
+            }
+        }
+        else if (op == 1)
+        {
+            error_t err = list_push_back(&m_list, &value);
+            CHECK_EQ(err, num < POOL_SIZE ? ERROR_SUCCESS : ERROR_NO_MEM);
+            if (err == ERROR_SUCCESS)
+            {
+                model[num++] = value;
+            }
+        }
+        else if (op == 2 && num)
+        {
+            list_pop_front(&m_list);
+            memmove(&model[0], &model[1], --num * sizeof(model[0]));
+        }
+        else if (op == 3 && num)
+        {
+            list_pop_back(&m_list);
+            num--;
+        }
+        else if (op == 4 && num)
+        {
+            uint8_t     index  = rand() % num;
+            list_node_t *p_node = m_list.p_head;
+            for (uint8_t i = 0; i < index; ++i)
+            {
+                p_node = p_node->p_next;
+            }
+            CHECK_EQ(list_remove(&m_list, p_node), ERROR_SUCCESS);
+            memmove(&model[index], &model[index + 1], (--num - index) * sizeof(model[0]));
+        }
+        check_links(&m_list, model, num);
+    }
+}
+
+/* The pool scan and list walks list_t did before, for comparison. */
+typedef struct ref_node_s
+{
+    uint8_t             used;
+    struct ref_node_s   *p_next;
+    uint16_t            value;
+} ref_node_t;
+
+typedef struct
+{
+    ref_node_t  pool[128];
+    uint8_t     pool_num;
+    ref_node_t  *p_head;
+} ref_list_t;
+
+static ref_list_t m_ref;
+
+static ref_node_t* ref_push_back(ref_list_t *p_list, uint16_t value)
+{
+    ref_node_t *p_new = NULL;
+    for (uint8_t i = 0; i < p_list->pool_num; ++i)
+    {
+        if (!p_list->pool[i].used)
+        {
+            p_new = &p_list->pool[i];
+            break;
+        }
+    }
+    if (!p_new)
+    {
+        return NULL;
+    }
+
+    p_new->used   = 1;
+    p_new->value  = value;
+    p_new->p_next = NULL;
+    ref_node_t **pp_link = &p_list->p_head;
+    while (*pp_link)
+    {
+        pp_link = &(*pp_link)->p_next;
+    }
+    *pp_link = p_new;
+    return p_new;
+}
+
+static void ref_remove(ref_list_t *p_list, ref_node_t *p_remove)
+{
+    for (ref_node_t **pp_link = &p_list->p_head; *pp_link; pp_link = &(*pp_link)->p_next)
+    {
+        if (*pp_link == p_remove)
+        {
+            *pp_link       = p_remove->p_next;
+            p_remove->used = 0;
+            return;
+        }
+    }
+}
+
+/* Keeps the list one short of full and cycles a node through it: push at the back,
+ * remove the oldest one, which sits in the middle of the pool after a few rounds. */
+static void bench_size(list_t *p_list, uint8_t num)
+{
+    uint16_t value = 0;
+    uint32_t sum   = 0;
+
+    list_reset(p_list);
+    for (uint8_t i = 0; i < num - 1; ++i)
+    {
+        list_push_back(p_list, &value);
+    }
+    uint64_t start = bench_ticks();
+    for (uint32_t i = 0; i < BENCH_ROUNDS; ++i)
+    {
+        value = (uint16_t)i;
+        list_push_back(p_list, &value);
+        sum += value_of(p_list->p_head);
+        list_remove(p_list, p_list->p_head);
+    }
+    uint64_t current = bench_ticks() - start;
+
+    memset(&m_ref, 0, sizeof(m_ref));
+    m_ref.pool_num = num;
+    for (uint8_t i = 0; i < num - 1; ++i)
+    {
+        ref_push_back(&m_ref, 0);
+    }
+    start = bench_ticks();
+    for (uint32_t i = 0; i < BENCH_ROUNDS; ++i)
+    {
+        ref_push_back(&m_ref, (uint16_t)i);
+        sum += m_ref.p_head->value;
+        ref_remove(&m_ref, m_ref.p_head);
+    }
+    uint64_t reference = bench_ticks() - start;
+    g_bench_sink = sum;
+
+    printf("    %3u nodes   %8.1f   %8.1f\n", num,
+           (double)current / BENCH_ROUNDS, (double)reference / BENCH_ROUNDS);
+}
+
+static void bench(void)
+{
+    printf("  push_back + remove on a full pool, %s per pair:\n", BENCH_UNIT);
+    printf("                 list_t   scan/walk\n");
+    bench_size(&m_bench_8, 8);
+    bench_size(&m_bench_32, 32);
+    bench_size(&m_bench_128, 128);
+}
+
+int main(int argc, char **argv)
+{
+    TEST_RUN(test_free_list_reuses_released_nodes);
+    TEST_RUN(test_tail_pointer);
+    TEST_RUN(test_remove_by_node);
+    TEST_RUN(test_foreach_safe_removal);
+    TEST_RUN(test_random_against_model);
+    if (test_bench_requested(argc, argv))
+    {
+        bench();
+    }
+    return test_report("list");
+}
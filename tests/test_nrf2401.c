@@ -0,0 +1,421 @@
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "test.h"
+#include "fake_nrf24.h"
+#include "radio.h"
+
+/* radio/nrf2401 on the fake nRF24: every call goes through the SPI callback the
+ * projects hand to radio_init(), CE and delays drive the model's clock. */
+
+#define CHANNEL             (40)
+#define LOOP_US             (20)            /* < One main loop pass besides radio_proccess(). */
+#define TIMEOUT_US          (200000)
+#define PKT_LEN             (8)
+#define BENCH_US            (1000000)
+
+static uint8_t m_own_addr[RADIO_ADDR_SIZE]  = {0x01, 0xAD, 0xBE, 0xEF, 0x01};
+static uint8_t m_peer_addr[RADIO_ADDR_SIZE] = {0x02, 0xAD, 0xBE, 0xEF, 0x01};
+
+static radio_proccess_t m_proc;
+static uint32_t         m_sent;
+static uint32_t         m_lost;
+static uint32_t         m_rx;
+static uint8_t          m_rx_pipe;
+static uint32_t         m_responses;
+static void            *m_response_ctx;
+static uint8_t          m_response[32];
+static uint8_t          m_response_len;
+
+void logger_serial_print(uint8_t log_level, const char *format, ...)
+{
+}
+
+void logger_serial_print_arr(uint8_t log_level, const char *p_str, uint8_t *p_data, uint8_t len)
+{
+}
+
+static void ce_high(void)
+{
+    fake_nrf24_ce(true);
+}
+
+static void ce_low(void)
+{
+    fake_nrf24_ce(false);
+}
+
+static void delay_us(uint16_t us)
+{
+    fake_nrf24_run(us);
+}
+
+static void tx_cb(radio_state_t result)
+{
+    if (result == RADIO_STATE_PKT_SENT)
+    {
+        m_sent++;
+    }
+    else
+    {
+        m_lost++;
+    }
+}
+
+static void rx_cb(uint8_t pipe, uint8_t *p_data, uint8_t len)
+{
+    m_rx++;
+    m_rx_pipe = pipe;
+}
+
+static void on_response(uint8_t *p_data, uint8_t len, void *p_context)
+{
+    m_responses++;
+    m_response_ctx = p_context;
+    memcpy(m_response, p_data, len);
+    m_response_len = len;
+}
+
+/* Falling edge ISR of the projects. */
+static void irq_edge(void)
+{
+    radio_irq_handle();
+}
+
+static void setup(radio_mode_t mode)
+{
+    fake_nrf24_reset();
+    fake_nrf24_edge_set(irq_edge);
+    CHECK_EQ(radio_setup(mode, CHANNEL), RADIO_E_SUCCESS);
+    radio_tx_cb_set(tx_cb);
+    radio_rx_cb_set(rx_cb);
+    CHECK_EQ(radio_tx_addr(m_peer_addr), RADIO_E_SUCCESS);
+    CHECK_EQ(radio_receive(), RADIO_E_SUCCESS);
+    CHECK_EQ(radio_irq_enable(), RADIO_E_SUCCESS);
+
+    m_sent      = 0;
+    m_lost      = 0;
+    m_rx        = 0;
+    m_responses = 0;
+}
+
+static void loop_step(void)
+{
+    radio_proccess(&m_proc);
+    fake_nrf24_run(LOOP_US);
+}
+
+/* Runs the main loop until the counter moves or the time is up. */
+static bool loop_until(volatile uint32_t *p_cnt, uint32_t target)
+{
+    uint64_t end = fake_nrf24_now() + TIMEOUT_US;
+    while (*p_cnt < target && fake_nrf24_now() < end)
+    {
+        loop_step();
+    }
+    return *p_cnt >= target;
+}
+
+static void loop_idle(uint32_t us)
+{
+    uint64_t end = fake_nrf24_now() + us;
+    while (fake_nrf24_now() < end)
+    {
+        loop_step();
+    }
+}
+
+/* Peer frame to our P0, i.e. addressed with the peer's own address as ACKs are. */
+static void peer_to_p0(void)
+{
+    uint8_t pkt[PKT_LEN] = {0x50};
+    fake_nrf24_peer_send(m_peer_addr, pkt, sizeof(pkt));
+}
+
+/*****************************************************************************/
+/*                         Tests                                             */
+/*****************************************************************************/
+static void test_hub_base_keeps_p1_lsb(void)
+{
+    uint8_t node2[RADIO_ADDR_SIZE] = {0x32, 0xAD, 0xBE, 0xEF, 0x01};
+    uint8_t node1[RADIO_ADDR_SIZE] = {0x31, 0xAD, 0xBE, 0xEF, 0x01};
+    uint8_t other[RADIO_ADDR_SIZE] = {0x33, 0xAD, 0xBE, 0xEF, 0x02};
+    uint8_t pkt[PKT_LEN] = {0};
+    uint8_t addr[RADIO_ADDR_SIZE];
+    int     ctx[2];
+    setup(RADIO_MODE_SHOCKBURST);
+
+    /* P0 belongs to the sends. */
+    CHECK_EQ(radio_hub_pipe_open(0, node1, on_response, NULL), RADIO_E_INVALID_PARAM);
+    CHECK_EQ(radio_hub_pipe_close(0), RADIO_E_INVALID_PARAM);
+
+    /* Pipe 2 first: only the shared bytes go to RX_ADDR_P1, its LSB stays the reset one. */
+    CHECK_EQ(radio_hub_pipe_open(2, node2, on_response, &ctx[1]), RADIO_E_SUCCESS);
+    fake_nrf24_addr(0x0B, addr);
+    CHECK_EQ(addr[0], 0xC2);
+    CHECK(memcmp(&addr[1], &node2[1], RADIO_ADDR_SIZE - 1) == 0);
+    CHECK_EQ(fake_nrf24_reg(0x0C), 0x32);
+    CHECK_EQ(radio_hub_pipe_open(3, other, on_response, NULL), RADIO_E_INVALID_PARAM);
+
+    CHECK_EQ(radio_hub_pipe_open(1, node1, on_response, &ctx[0]), RADIO_E_SUCCESS);
+    fake_nrf24_addr(0x0B, addr);
+    CHECK(memcmp(addr, node1, RADIO_ADDR_SIZE) == 0);
+
+    /* Each node reaches its own handler. */
+    fake_nrf24_peer_send(node2, pkt, sizeof(pkt));
+    CHECK(loop_until(&m_responses, 1));
+    CHECK(m_response_ctx == &ctx[1]);
+    fake_nrf24_peer_send(node1, pkt, sizeof(pkt));
+    CHECK(loop_until(&m_responses, 2));
+    CHECK(m_response_ctx == &ctx[0]);
+    CHECK_EQ(m_rx, 0);
+}
+
+static void test_ack_payload_blocks_own_send(void)
+{
+    uint8_t reply[4] = {0xA1, 0xA2, 0xA3, 0xA4};
+    uint8_t pkt[PKT_LEN] = {0};
+    setup(RADIO_MODE_SHOCKBURST);
+    CHECK_EQ(radio_hub_pipe_open(1, m_own_addr, on_response, NULL), RADIO_E_SUCCESS);
+
+    /* Two replies loaded: as PTX the chip would send them to TX_ADDR ahead of the payload. */
+    CHECK_EQ(radio_ack_payload_set(1, reply, sizeof(reply)), RADIO_E_SUCCESS);
+    CHECK_EQ(radio_ack_payload_set(1, reply, sizeof(reply)), RADIO_E_SUCCESS);
+    CHECK_EQ(radio_send(pkt, sizeof(pkt)), RADIO_E_BUSY);
+    CHECK(!radio_tx_busy());
+
+    /* Both go out on requests. The second one is not processed yet, its TX_DS is pending. */
+    fake_nrf24_peer_send(m_own_addr, pkt, sizeof(pkt));
+    CHECK(loop_until(&m_responses, 1));
+    fake_nrf24_peer_send(m_own_addr, pkt, sizeof(pkt));
+    fake_nrf24_run(2000);
+    CHECK_EQ(g_fake_peer.replies, 2);
+    CHECK(fake_nrf24_reg(0x07) & (1 << 5));
+    CHECK_EQ(g_fake_peer.frames, 0);
+
+    /* The FIFO is free, the TX_DS of the reply is not taken for the end of this send. */
+    CHECK_EQ(radio_send(pkt, sizeof(pkt)), RADIO_E_SUCCESS);
+    loop_step();
+    loop_step();
+    CHECK_EQ(m_responses, 2);
+    CHECK_EQ(m_sent, 0);
+    CHECK(loop_until(&m_sent, 1));
+    loop_idle(1000);
+    CHECK_EQ(m_sent, 1);
+    CHECK_EQ(g_fake_peer.frames, 1);
+    CHECK_EQ(m_lost, 0);
+}
+
+static void test_request_restores_pipe_0(void)
+{
+    uint8_t pkt[PKT_LEN] = {0x11};
+    int ctx;
+    setup(RADIO_MODE_SHOCKBURST);
+
+    /* Reply on the ACK: handed to on_response, before the send is reported. */
+    g_fake_peer.ack_pl_len = 6;
+    g_fake_peer.ack_pl_cnt = 1;
+    memset(g_fake_peer.ack_pl, 0x77, g_fake_peer.ack_pl_len);
+    CHECK_EQ(radio_request(pkt, sizeof(pkt), on_response, &ctx), RADIO_E_SUCCESS);
+    CHECK(loop_until(&m_sent, 1));
+    CHECK_EQ(m_responses, 1);
+    CHECK(m_response_ctx == &ctx);
+    CHECK_EQ(m_response_len, 6);
+    CHECK_EQ(m_response[5], 0x77);
+    CHECK_EQ(m_rx, 0);
+
+    /* Later P0 traffic goes back to the RX callback. */
+    peer_to_p0();
+    CHECK(loop_until(&m_rx, 1));
+    CHECK_EQ(m_rx_pipe, 0);
+    CHECK_EQ(m_responses, 1);
+
+    /* Plain ACK, no response: the route is given back when the send ends. */
+    CHECK_EQ(radio_request(pkt, sizeof(pkt), on_response, &ctx), RADIO_E_SUCCESS);
+    CHECK(loop_until(&m_sent, 2));
+    peer_to_p0();
+    CHECK(loop_until(&m_rx, 2));
+    CHECK_EQ(m_responses, 1);
+
+    /* Nobody answers: MAX_RT, the route is given back as well. */
+    g_fake_peer.deaf = true;
+    CHECK_EQ(radio_request(pkt, sizeof(pkt), on_response, &ctx), RADIO_E_SUCCESS);
+    CHECK(loop_until(&m_lost, 1));
+    CHECK(!radio_tx_busy());
+    g_fake_peer.deaf = false;
+    peer_to_p0();
+    CHECK(loop_until(&m_rx, 3));
+    CHECK_EQ(m_responses, 1);
+}
+
+/* Request until the reply is in the callback, µs of model time. */
+static uint64_t round_trip_ack_payload(void)
+{
+    uint8_t pkt[PKT_LEN] = {0x22};
+    setup(RADIO_MODE_SHOCKBURST);
+    g_fake_peer.ack_pl_len = PKT_LEN;
+    g_fake_peer.ack_pl_cnt = 1;
+
+    uint64_t start = fake_nrf24_now();
+    CHECK_EQ(radio_request(pkt, sizeof(pkt), on_response, NULL), RADIO_E_SUCCESS);
+    CHECK(loop_until(&m_responses, 1));
+    uint64_t us = fake_nrf24_now() - start;
+    CHECK(loop_until(&m_sent, 1));
+    return us;
+}
+
+/* Same exchange as two sends: the request, then the peer reads it, loads the
+ * reply, turns to PTX and sends it back to our P0. */
+static uint64_t round_trip_two_sends(void)
+{
+    uint8_t pkt[PKT_LEN] = {0x22};
+    /* Peer SPI: width, payload, STATUS clear, reply load, CONFIG read and write, CE pulse. */
+    const uint32_t turnaround_us = (2 + 1 + PKT_LEN + 2 + 1 + PKT_LEN + 2 + 2) * FAKE_NRF24_SPI_BYTE_US + 10;
+    setup(RADIO_MODE_SHOCKBURST);
+
+    uint64_t start = fake_nrf24_now();
+    CHECK_EQ(radio_send(pkt, sizeof(pkt)), RADIO_E_SUCCESS);
+    while (g_fake_peer.frames == 0 && fake_nrf24_now() < start + TIMEOUT_US)
+    {
+        loop_step();
+    }
+    while (fake_nrf24_now() < g_fake_peer.heard_at + turnaround_us)
+    {
+        loop_step();
+    }
+    peer_to_p0();
+    CHECK(loop_until(&m_rx, 1));
+    CHECK_EQ(m_sent, 1);
+    return fake_nrf24_now() - start;
+}
+
+static void test_ack_payload_round_trip(void)
+{
+    uint64_t ack_payload = round_trip_ack_payload();
+    uint64_t two_sends   = round_trip_two_sends();
+
+    printf("    %u byte request/response: %llu us on an ACK payload, %llu us as two sends\n",
+           PKT_LEN, (unsigned long long)ack_payload, (unsigned long long)two_sends);
+    CHECK(ack_payload < two_sends);
+}
+
+static void test_send_no_ack(void)
+{
+    uint8_t pkt[PKT_LEN] = {0x33};
+    setup(RADIO_MODE_SHOCKBURST);
+
+    /* One W_TX_PAYLOAD_NOACK, one frame and no retransmit even though nobody listens. */
+    g_fake_peer.deaf = true;
+    CHECK_EQ(radio_send_no_ack(pkt, sizeof(pkt)), RADIO_E_SUCCESS);
+    CHECK_EQ(radio_send_no_ack(pkt, sizeof(pkt)), RADIO_E_BUSY);
+    CHECK(loop_until(&m_sent, 1));
+    loop_idle(5000);
+    CHECK_EQ(m_sent, 1);
+    CHECK_EQ(m_lost, 0);
+    CHECK_EQ(g_fake_stat.w_tx_payload_no_ack, 1);
+    CHECK_EQ(g_fake_stat.w_tx_payload, 0);
+    CHECK_EQ(g_fake_stat.frames_sent, 1);
+
+    g_fake_peer.deaf = false;
+    CHECK_EQ(radio_send_no_ack(pkt, sizeof(pkt)), RADIO_E_SUCCESS);
+    CHECK(loop_until(&m_sent, 2));
+    CHECK_EQ(g_fake_peer.frames, 1);
+    CHECK_EQ(g_fake_peer.frames_no_ack, 1);
+    CHECK_EQ(g_fake_peer.last[0], 0x33);
+}
+
+static void test_advertiser_hops_and_returns(void)
+{
+    uint8_t channels[3]  = {5, 50, 95};
+    uint8_t pkt[PKT_LEN] = {0x44};
+    setup(RADIO_MODE_ADVERTISER);
+
+    CHECK_EQ(radio_adv_channels_set(channels, RADIO_ADV_CHANNELS_MAX + 1), RADIO_E_INVALID_PARAM);
+    CHECK_EQ(radio_adv_channels_set(channels, sizeof(channels)), RADIO_E_SUCCESS);
+    CHECK_EQ(fake_nrf24_reg(0x05), channels[0]);
+
+    /* Once per channel, all without ACK, one TX callback after the last. */
+    CHECK_EQ(radio_advertise(pkt, sizeof(pkt)), RADIO_E_SUCCESS);
+    CHECK_EQ(radio_advertise(pkt, sizeof(pkt)), RADIO_E_BUSY);
+    CHECK(loop_until(&m_sent, 1));
+    loop_idle(5000);
+    CHECK_EQ(m_sent, 1);
+    CHECK_EQ(g_fake_peer.frames, sizeof(channels));
+    CHECK_EQ(g_fake_peer.frames_no_ack, sizeof(channels));
+    CHECK_EQ(g_fake_stat.w_tx_payload_no_ack, sizeof(channels));
+    CHECK_EQ(g_fake_stat.w_tx_payload, 0);
+    for (uint8_t i = 0; i < sizeof(channels); ++i)
+    {
+        CHECK_EQ(g_fake_peer.channel_log[i], channels[i]);
+    }
+
+    /* Back on channels[0] and listening there. */
+    CHECK_EQ(fake_nrf24_reg(0x05), channels[0]);
+    CHECK(fake_nrf24_reg(0x00) & 0x01);
+    peer_to_p0();
+    CHECK(loop_until(&m_rx, 1));
+
+    /* A receiver parked on any one of them gets every broadcast. */
+    g_fake_peer.channel = channels[1];
+    CHECK_EQ(radio_advertise(pkt, sizeof(pkt)), RADIO_E_SUCCESS);
+    CHECK(loop_until(&m_sent, 2));
+    CHECK_EQ(g_fake_peer.frames, sizeof(channels) + 1);
+    CHECK_EQ(g_fake_peer.channel_log[sizeof(channels)], channels[1]);
+}
+
+/* Samples the peer got in a second of model time, the next one sent from the main loop. */
+static double samples_per_s(radio_mode_t mode, bool ack, uint16_t loss_every)
+{
+    uint8_t channels[3]  = {5, 50, 95};
+    uint8_t pkt[PKT_LEN] = {0};
+    setup(mode);
+    if (mode == RADIO_MODE_ADVERTISER)
+    {
+        CHECK_EQ(radio_adv_channels_set(channels, sizeof(channels)), RADIO_E_SUCCESS);
+        g_fake_peer.channel = channels[1];
+    }
+    g_fake_peer.loss_every = loss_every;
+
+    uint32_t errors = 0;
+    uint64_t end    = fake_nrf24_now() + BENCH_US;
+    while (fake_nrf24_now() < end)
+    {
+        if (!radio_tx_busy())
+        {
+            radio_error_t err = (mode == RADIO_MODE_ADVERTISER) ? radio_advertise(pkt, sizeof(pkt)) :
+                                ack ? radio_send(pkt, sizeof(pkt)) : radio_send_no_ack(pkt, sizeof(pkt));
+            errors += (err != RADIO_E_SUCCESS);
+        }
+        loop_step();
+    }
+    CHECK_EQ(errors, 0);
+    return g_fake_peer.frames * 1000000.0 / BENCH_US;
+}
+
+static void bench(void)
+{
+    printf("  %u byte samples delivered per s of model time:\n", PKT_LEN);
+    printf("    ACK                        %6.0f\n", samples_per_s(RADIO_MODE_SHOCKBURST, true, 0));
+    printf("    ACK, 1 in 10 lost          %6.0f\n", samples_per_s(RADIO_MODE_SHOCKBURST, true, 10));
+    printf("    NO_ACK                     %6.0f\n", samples_per_s(RADIO_MODE_SHOCKBURST, false, 0));
+    printf("    NO_ACK, 1 in 10 lost       %6.0f\n", samples_per_s(RADIO_MODE_SHOCKBURST, false, 10));
+    printf("    advertiser, 3 channels     %6.0f\n", samples_per_s(RADIO_MODE_ADVERTISER, false, 0));
+}
+
+int main(int argc, char **argv)
+{
+    fake_nrf24_reset();
+    CHECK_EQ(radio_init(fake_nrf24_spi, ce_high, ce_low, delay_us), RADIO_E_SUCCESS);
+
+    TEST_RUN(test_hub_base_keeps_p1_lsb);
+    TEST_RUN(test_ack_payload_blocks_own_send);
+    TEST_RUN(test_request_restores_pipe_0);
+    TEST_RUN(test_ack_payload_round_trip);
+    TEST_RUN(test_send_no_ack);
+    TEST_RUN(test_advertiser_hops_and_returns);
+    if (test_bench_requested(argc, argv))
+    {
+        bench();
+    }
+    return test_report("nrf2401");
+}
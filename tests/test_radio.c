@@ -0,0 +1,454 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+/* radio/src on the fake nRF24. The SPI queue is replaced by a synchronous transfer into
+ * the model, CE is sampled from PORTB on every transfer and delay, the INT0 pin follows
+ * the model's IRQ line and its falling edge calls INT0_vect. */
+volatile uint8_t* model_pind(void);
+void model_delay_us(uint16_t us);
+#define PIND            (*model_pind())
+#define _delay_us(_us)  model_delay_us(_us)
+
+#include "test.h"
+#include "fake_nrf24.h"
+/* Built into this file to reset the driver state between the tests. */
+#include "../radio/src/radio.c"
+
+#define LOOP_US             (20)            /* < One main loop pass besides radio_proccess(). */
+#define TIMEOUT_US          (200000)
+#define PKT_LEN             (16)
+#define THROUGHPUT_US       (1000000)
+
+static uint8_t m_own_addr[ADDR_SIZE]  = {0x01, 0xAD, 0xBE, 0xEF, 0x01};
+static uint8_t m_peer_addr[ADDR_SIZE] = {0x02, 0xAD, 0xBE, 0xEF, 0x01};
+
+static volatile uint8_t m_pind;
+static uint32_t         m_sent;
+static uint32_t         m_failed;
+static uint32_t         m_rx;
+
+void logger_serial_print(uint8_t log_level, const char *format, ...)
+{
+}
+
+void logger_serial_print_arr(uint8_t log_level, const char *p_str, uint8_t *p_data, uint8_t len)
+{
+}
+
+static void ce_sync(void)
+{
+    fake_nrf24_ce(CE_PORT & (1 << CE_PIN));
+}
+
+volatile uint8_t* model_pind(void)
+{
+    m_pind = fake_nrf24_irq_active() ? 0 : (1 << IRQ_PIN);
+    return &m_pind;
+}
+
+void model_delay_us(uint16_t us)
+{
+    ce_sync();
+    fake_nrf24_run(us);
+}
+
+/* spi.c stand-in: transactions run in push order and the queue is drained before the
+ * first push returns. A callback pushing the next one is chained like in SPI_STC_vect. */
+static spi_transaction_t *m_spi_head;
+static spi_transaction_t *m_spi_tail;
+static bool               m_spi_running;
+static uint32_t           m_spi_blocking_bytes;     /* < spi_rw(), the main loop waits for them. */
+static uint32_t           m_spi_chained_bytes;      /* < With a callback, nobody waits. */
+
+void spi_master_init(void)
+{
+}
+
+/* Out of line like spi.c, inlined into spi_rw() GCC takes the stack transaction for dangling. */
+__attribute__((noinline)) error_t spi_transaction_push(spi_transaction_t *p_transaction)
+{
+    p_transaction->p_next = NULL;
+    if (m_spi_tail)
+    {
+        m_spi_tail->p_next = p_transaction;
+    }
+    else
+    {
+        m_spi_head = p_transaction;
+    }
+    m_spi_tail = p_transaction;
+
+    if (m_spi_running)
+    {
+        return ERROR_SUCCESS;
+    }
+
+    m_spi_running = true;
+    while (m_spi_head)
+    {
+        spi_transaction_t *p_done = m_spi_head;
+        ce_sync();
+        fake_nrf24_spi((uint8_t *)p_done->p_tx, p_done->p_rx, p_done->len);
+        if (p_done->cb)
+        {
+            m_spi_chained_bytes += p_done->len;
+        }
+        else
+        {
+            m_spi_blocking_bytes += p_done->len;
+        }
+        m_spi_head = p_done->p_next;
+        if (!m_spi_head)
+        {
+            m_spi_tail = NULL;
+        }
+        p_done->p_next = NULL;
+        if (p_done->cb)
+        {
+            p_done->cb(p_done);
+        }
+    }
+    m_spi_running = false;
+    return ERROR_SUCCESS;
+}
+
+bool spi_transaction_busy(spi_transaction_t *p_transaction)
+{
+    return m_spi_head == p_transaction || p_transaction->p_next || m_spi_tail == p_transaction;
+}
+
+static void tx_cb(radio_error_t result)
+{
+    if (result == RADIO_E_SUCCESS)
+    {
+        m_sent++;
+    }
+    else
+    {
+        m_failed++;
+    }
+}
+
+static void rx_cb(uint8_t pipe, uint8_t *p_data, uint8_t len)
+{
+    m_rx++;
+}
+
+static void setup(void)
+{
+    fake_nrf24_reset();
+    fake_nrf24_edge_set(INT0_vect);
+    CE_PORT         = 0;
+    g_tx_state      = TX_STATE_IDLE;
+    g_tx_addr_valid = false;
+    g_channel       = RADIO_CHANNEL_DEFAULT;
+    memset(&g_hop, 0, sizeof(g_hop));
+    memset(&g_tx_queue, 0, sizeof(g_tx_queue));
+    memset(&g_rx_queue, 0, sizeof(g_rx_queue));
+
+    CHECK_EQ(radio_init(), RADIO_E_SUCCESS);
+    radio_tx_cb_set(tx_cb);
+    radio_rx_cb_set(rx_cb);
+    CHECK_EQ(radio_listen(m_own_addr), RADIO_E_SUCCESS);
+
+    m_sent   = 0;
+    m_failed = 0;
+    m_rx     = 0;
+}
+
+static void loop_step(void)
+{
+    radio_proccess();
+    ce_sync();
+    fake_nrf24_run(LOOP_US);
+}
+
+static bool loop_until(uint32_t *p_cnt, uint32_t target)
+{
+    uint64_t end = fake_nrf24_now() + TIMEOUT_US;
+    while (*p_cnt < target && fake_nrf24_now() < end)
+    {
+        loop_step();
+    }
+    return *p_cnt >= target;
+}
+
+static bool listening(void)
+{
+    return (fake_nrf24_reg(0x00) & 0x01) && (CE_PORT & (1 << CE_PIN));
+}
+
+/*****************************************************************************/
+/*                         Tests                                             */
+/*****************************************************************************/
+static void test_tx_ds_reports_success(void)
+{
+    uint8_t pkt[PKT_LEN] = {0x5A};
+    setup();
+
+    CHECK_EQ(radio_pkt_send(m_peer_addr, pkt, sizeof(pkt)), RADIO_E_SUCCESS);
+    CHECK(radio_tx_busy());
+    /* One send at a time, whatever the path. */
+    CHECK_EQ(radio_pkt_send(m_peer_addr, pkt, sizeof(pkt)), RADIO_E_BUSY);
+    CHECK_EQ(radio_pkt_send_no_ack(m_peer_addr, pkt, sizeof(pkt)), RADIO_E_BUSY);
+    CHECK_EQ(radio_stream_send(m_peer_addr, pkt, sizeof(pkt)), RADIO_E_BUSY);
+
+    CHECK(loop_until(&m_sent, 1));
+    CHECK_EQ(m_failed, 0);
+    CHECK(!radio_tx_busy());
+    CHECK(listening());
+    CHECK_EQ(g_fake_peer.frames, 1);
+    CHECK_EQ(g_fake_peer.last[0], 0x5A);
+}
+
+static void test_max_rt_flushes_and_reports(void)
+{
+    uint8_t pkt[PKT_LEN] = {0};
+    setup();
+
+    g_fake_peer.deaf = true;
+    CHECK_EQ(radio_pkt_send(m_peer_addr, pkt, sizeof(pkt)), RADIO_E_SUCCESS);
+    CHECK(loop_until(&m_failed, 1));
+    CHECK_EQ(m_sent, 0);
+    CHECK(!radio_tx_busy());
+    CHECK(listening());
+    /* The failed payload is gone, ten retransmits were made. */
+    CHECK(fake_nrf24_reg(0x17) & 0x10);
+    CHECK_EQ(g_fake_stat.frames_sent, 1 + NRF_AUTO_RETR_10);
+
+    g_fake_peer.deaf = false;
+    CHECK_EQ(radio_pkt_send(m_peer_addr, pkt, sizeof(pkt)), RADIO_E_SUCCESS);
+    CHECK(loop_until(&m_sent, 1));
+    CHECK_EQ(m_failed, 1);
+}
+
+static void test_stale_tx_ds_is_ignored(void)
+{
+    uint8_t pkt[PKT_LEN] = {0};
+    setup();
+
+    /* TX_DS along with a received packet, while no send of ours is in flight. */
+    fake_nrf24_peer_send(m_own_addr, pkt, sizeof(pkt));
+    fake_nrf24_run(1000);
+    fake_nrf24_flags_set(1 << 5);
+    for (uint8_t i = 0; i < 10; ++i)
+    {
+        loop_step();
+    }
+    CHECK_EQ(m_rx, 1);
+    CHECK_EQ(m_sent, 0);
+    CHECK(!(fake_nrf24_reg(0x07) & (1 << 5)));
+    CHECK(listening());
+}
+
+/* Sends back to back for a second of model time, the next one from the main loop. */
+static double packets_per_s(bool ack, uint16_t loss_every)
+{
+    uint8_t pkt[PKT_LEN] = {0};
+    setup();
+    g_fake_peer.loss_every = loss_every;
+
+    uint32_t errors = 0;
+    uint64_t end    = fake_nrf24_now() + THROUGHPUT_US;
+    while (fake_nrf24_now() < end)
+    {
+        if (!radio_tx_busy())
+        {
+            radio_error_t err = ack ? radio_pkt_send(m_peer_addr, pkt, sizeof(pkt)) :
+                                      radio_pkt_send_no_ack(m_peer_addr, pkt, sizeof(pkt));
+            errors += (err != RADIO_E_SUCCESS);
+        }
+        loop_step();
+    }
+    CHECK_EQ(errors, 0);
+    return m_sent * 1000000.0 / THROUGHPUT_US;
+}
+
+static void test_throughput(void)
+{
+    double ack     = packets_per_s(true, 0);
+    double lossy   = packets_per_s(true, 10);
+    double no_ack  = packets_per_s(false, 0);
+
+    /* The 100 ms CE pulse capped this at 10 packets/s. */
+    CHECK(ack > 1000);
+    CHECK(no_ack > ack);
+    printf("    %u byte packets/s: %.0f with ACK, %.0f with 1 in 10 lost, %.0f without ACK\n",
+           PKT_LEN, ack, lossy, no_ack);
+}
+
+static void test_stream_defers_plos_reset(void)
+{
+    uint8_t pkt[PKT_LEN]    = {0};
+    uint8_t channels[2]     = {10, 80};
+    setup();
+    CHECK_EQ(radio_hop_channels_set(channels, sizeof(channels), NULL), RADIO_E_SUCCESS);
+    uint32_t rf_ch_writes = g_fake_stat.rf_ch_writes;
+
+    /* Keeps the queue topped up past two PLOS windows, TX never goes idle meanwhile. */
+    uint32_t errors = 0;
+    uint64_t end    = fake_nrf24_now() + TIMEOUT_US;
+    while (m_sent < 2 * RADIO_HOP_WINDOW + 8 && fake_nrf24_now() < end)
+    {
+        radio_error_t err;
+        while ((err = radio_stream_send(m_peer_addr, pkt, sizeof(pkt))) == RADIO_E_SUCCESS);
+        errors += (err != RADIO_E_SUCCESS && err != RADIO_E_NO_MEM);
+        loop_step();
+    }
+    CHECK_EQ(errors, 0);
+    CHECK_EQ(m_failed, 0);
+    CHECK_EQ(g_fake_stat.rf_ch_writes, rf_ch_writes);
+    CHECK(g_hop.plos_reset);
+
+    /* Once the stream drains, the window restarts on the same channel. */
+    end = fake_nrf24_now() + TIMEOUT_US;
+    while (radio_tx_busy() && fake_nrf24_now() < end)
+    {
+        loop_step();
+    }
+    CHECK(!radio_tx_busy());
+    CHECK_EQ(g_fake_stat.rf_ch_writes, rf_ch_writes + 1);
+    CHECK_EQ(g_fake_stat.rf_ch_in_flight, 0);
+    CHECK_EQ(fake_nrf24_reg(0x05), channels[0]);
+    CHECK(listening());
+}
+
+/* SPI per received packet when the IRQ latch drives radio_proccess(), one and three at a time. */
+static void test_rx_spi_cost(void)
+{
+    uint8_t pkt[PKT_LEN] = {0};
+    setup();
+
+    /* Nothing on the air: past the STATUS read irq_init() asks for, no SPI at all. */
+    loop_step();
+    memset(&g_fake_stat, 0, sizeof(g_fake_stat));
+    for (uint16_t i = 0; i < 1000; ++i)
+    {
+        loop_step();
+    }
+    CHECK_EQ(g_fake_stat.spi_transactions, 0);
+    CHECK_EQ(g_fake_stat.spi_bytes, 0);
+
+    fake_nrf24_peer_send(m_own_addr, pkt, sizeof(pkt));
+    CHECK(loop_until(&m_rx, 1));
+    uint32_t single_trans = g_fake_stat.spi_transactions;
+    uint32_t single_bytes = g_fake_stat.spi_bytes;
+
+    /* Three land before the main loop gets to them, a single STATUS read covers all. */
+    memset(&g_fake_stat, 0, sizeof(g_fake_stat));
+    g_irq_pending = 0;
+    for (uint8_t i = 0; i < RADIO_RX_RING_SIZE; ++i)
+    {
+        fake_nrf24_peer_send(m_own_addr, pkt, sizeof(pkt));
+        fake_nrf24_run(1000);
+    }
+    CHECK_EQ(m_rx, 1);
+    CHECK(loop_until(&m_rx, 1 + RADIO_RX_RING_SIZE));
+    double batch_trans = (double)g_fake_stat.spi_transactions / RADIO_RX_RING_SIZE;
+    double batch_bytes = (double)g_fake_stat.spi_bytes / RADIO_RX_RING_SIZE;
+
+    /* STATUS, its clear, the width and payload, the width read that finds the FIFO empty. */
+    CHECK_EQ(single_trans, 5);
+    CHECK(batch_trans < single_trans);
+    CHECK(batch_bytes < single_bytes);
+
+    memset(&g_fake_stat, 0, sizeof(g_fake_stat));
+    for (uint16_t i = 0; i < 1000; ++i)
+    {
+        loop_step();
+    }
+    CHECK_EQ(g_fake_stat.spi_transactions, 0);
+    printf("    SPI per %u byte packet: %lu transactions and %lu bytes alone, "
+           "%.1f and %.1f in a batch of %u, 0 at idle\n", PKT_LEN, (unsigned long)single_trans,
+           (unsigned long)single_bytes, batch_trans, batch_bytes, RADIO_RX_RING_SIZE);
+}
+
+/* Writes the TX FIFO dropped go again, the peer gets every payload once and in order. */
+static void test_stream_keeps_order(void)
+{
+    uint8_t  pkt[PKT_LEN] = {0};
+    uint8_t  queued       = 0;
+    uint32_t out_of_order = 0;
+    uint32_t frames       = 0;
+    setup();
+
+    uint64_t end = fake_nrf24_now() + TIMEOUT_US;
+    while ((queued < 40 || radio_tx_busy()) && fake_nrf24_now() < end)
+    {
+        while (queued < 40 && radio_stream_send(m_peer_addr, pkt, sizeof(pkt)) == RADIO_E_SUCCESS)
+        {
+            pkt[0] = ++queued;
+        }
+        loop_step();
+        if (g_fake_peer.frames != frames)
+        {
+            frames = g_fake_peer.frames;
+            out_of_order += (g_fake_peer.last[0] != frames - 1);
+        }
+    }
+    CHECK(!radio_tx_busy());
+    CHECK_EQ(out_of_order, 0);
+    CHECK_EQ(g_fake_peer.frames, 40);
+    CHECK_EQ(m_failed, 0);
+    /* The queue ran ahead of the TX FIFO, some writes found it full. */
+    CHECK(g_fake_stat.w_tx_payload > 40);
+    CHECK(listening());
+}
+
+/* Payload bytes go through chained transactions, the main loop only waits for registers. */
+static void test_payloads_do_not_block(void)
+{
+    uint8_t pkt[PKT_LEN] = {0};
+    setup();
+    CHECK_EQ(radio_pkt_send(m_peer_addr, pkt, sizeof(pkt)), RADIO_E_SUCCESS);
+    CHECK(loop_until(&m_sent, 1));
+
+    /* Same destination, so only CONFIG and the status handling are left to wait for. */
+    m_spi_blocking_bytes = 0;
+    m_spi_chained_bytes  = 0;
+    CHECK_EQ(radio_pkt_send(m_peer_addr, pkt, sizeof(pkt)), RADIO_E_SUCCESS);
+    CHECK(loop_until(&m_sent, 2));
+    uint32_t tx_blocking = m_spi_blocking_bytes;
+    CHECK_EQ(m_spi_chained_bytes, 1 + PKT_LEN);
+    CHECK(tx_blocking < PKT_LEN);
+
+    m_spi_blocking_bytes = 0;
+    m_spi_chained_bytes  = 0;
+    fake_nrf24_peer_send(m_own_addr, pkt, sizeof(pkt));
+    CHECK(loop_until(&m_rx, 1));
+    CHECK_EQ(m_spi_chained_bytes, 2 + 1 + PKT_LEN + 2);
+    CHECK(m_spi_blocking_bytes < PKT_LEN);
+    printf("    %u byte packet: main loop waits for %lu SPI bytes to send, %lu to receive\n",
+           PKT_LEN, (unsigned long)tx_blocking, (unsigned long)m_spi_blocking_bytes);
+}
+
+/* Model time of one sweep, SPI included, against what radio.h promises. */
+static void test_scan_time(void)
+{
+    uint8_t best;
+    setup();
+    g_fake_noise[40] = 1;
+
+    uint64_t start = fake_nrf24_now();
+    CHECK_EQ(radio_channel_scan(1, NULL, &best), RADIO_E_SUCCESS);
+    uint32_t sweep_us = fake_nrf24_now() - start;
+    CHECK(best < 38 || best > 42);
+    CHECK(sweep_us <= RADIO_SCAN_SWEEP_US);
+    CHECK(listening());
+    printf("    %lu us per sweep, %lu us documented\n",
+           (unsigned long)sweep_us, RADIO_SCAN_SWEEP_US);
+}
+
+int main(int argc, char **argv)
+{
+    TEST_RUN(test_tx_ds_reports_success);
+    TEST_RUN(test_max_rt_flushes_and_reports);
+    TEST_RUN(test_stale_tx_ds_is_ignored);
+    TEST_RUN(test_throughput);
+    TEST_RUN(test_stream_defers_plos_reset);
+    TEST_RUN(test_scan_time);
+    TEST_RUN(test_rx_spi_cost);
+    TEST_RUN(test_stream_keeps_order);
+    TEST_RUN(test_payloads_do_not_block);
+    return test_report("radio");
+}
@@ -0,0 +1,220 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <signal.h>
+#include <sys/time.h>
+
+/* UART model: every UDR0 access is a byte the UDRE ISR hands to the shifter,
+ * it lands in the next slot of the line log. */
+volatile uint8_t* model_udr0(void);
+#define UDR0        (*model_udr0())
+
+#include "test.h"
+/* Built into this file to reach the TX ring and the ISR. */
+#include "../avr_drivers/serial/serial.c"
+
+#define LINE_SIZE           (4096)
+#define UART_PERIOD_US      (20)            /* < Host timer standing in for the byte time. */
+
+static volatile uint8_t     m_line[LINE_SIZE];
+static volatile uint16_t    m_line_len;
+static volatile uint16_t    m_udre_cnt;
+static volatile uint8_t     m_tx_complete_cnt;
+
+volatile uint8_t* model_udr0(void)
+{
+    if (m_line_len < LINE_SIZE)
+    {
+        return &m_line[m_line_len++];
+    }
+    return &m_line[LINE_SIZE - 1];
+}
+
+/* One UDRE interrupt, if it is enabled. */
+static bool model_udre(void)
+{
+    if (!(UCSR0B & (1 << UDRIE0)) || !(SREG & (1 << SREG_I)))
+    {
+        return false;
+    }
+
+    /* The vector runs with interrupts disabled. */
+    m_udre_cnt++;
+    cli();
+    USART_UDRE_vect();
+    sei();
+    return true;
+}
+
+static void model_drain(void)
+{
+    while (model_udre());
+}
+
+/* The timer signal interrupts the main flow at any instruction, like the UDRE interrupt. */
+static void uart_signal(int sig)
+{
+    model_udre();
+}
+
+static void uart_run(bool run)
+{
+    struct itimerval period = {0};
+    if (run)
+    {
+        period.it_interval.tv_usec = UART_PERIOD_US;
+        period.it_value.tv_usec    = UART_PERIOD_US;
+        signal(SIGALRM, uart_signal);
+    }
+    setitimer(ITIMER_REAL, &period, NULL);
+}
+
+static void tx_complete(void)
+{
+    m_tx_complete_cnt++;
+}
+
+static void setup(serial_overflow_t overflow)
+{
+    serial_init();
+    serial_set_overflow_policy(overflow);
+    serial_set_tx_complete_cb(tx_complete);
+    m_tx.head         = 0;
+    m_tx.tail         = 0;
+    m_line_len        = 0;
+    m_udre_cnt        = 0;
+    m_tx_complete_cnt = 0;
+}
+
+static void message_fill(uint8_t *p_msg, uint16_t len, uint8_t first)
+{
+    for (uint16_t i = 0; i < len; ++i)
+    {
+        p_msg[i] = (uint8_t)(first + i);
+    }
+}
+
+static bool line_matches(const uint8_t *p_expected, uint16_t len)
+{
+    if (m_line_len != len)
+    {
+        printf("    %u bytes on the line, expected %u\n", m_line_len, len);
+        return false;
+    }
+    return memcmp((const void*)m_line, p_expected, len) == 0;
+}
+
+/*****************************************************************************/
+/*                         Tests                                             */
+/*****************************************************************************/
+static void test_drain_reports_completion_once(void)
+{
+    uint8_t msg[10];
+    setup(SERIAL_OVERFLOW_DROP_NEWEST);
+    message_fill(msg, sizeof(msg), 0x30);
+
+    CHECK_EQ(serial_send_no_block(msg, sizeof(msg)), ERROR_SUCCESS);
+    CHECK(UCSR0B & (1 << UDRIE0));
+    CHECK(!serial_ready());
+    model_drain();
+
+    CHECK(line_matches(msg, sizeof(msg)));
+    CHECK(serial_ready());
+    /* One interrupt per byte, one more finds the ring empty and masks itself. */
+    CHECK_EQ(m_udre_cnt, sizeof(msg) + 1);
+    CHECK_EQ(m_tx_complete_cnt, 1);
+    CHECK(!(UCSR0B & (1 << UDRIE0)));
+
+    CHECK_EQ(serial_send_no_block(NULL, 1), ERROR_NULL_PTR);
+    CHECK_EQ(serial_send_no_block(msg, 0), ERROR_DATA_LENGTH);
+}
+
+static void test_drop_newest_keeps_messages_whole(void)
+{
+    uint8_t msg[50];
+    uint8_t expected[SERIAL_TX_BUFF_SIZE];
+    uint16_t expected_len = 0;
+    setup(SERIAL_OVERFLOW_DROP_NEWEST);
+
+    /* 50 + 50 fit into the 127 free bytes, the third message does not. */
+    for (uint8_t i = 0; i < 3; ++i)
+    {
+        message_fill(msg, sizeof(msg), i * 64);
+        error_t err = serial_send_no_block(msg, sizeof(msg));
+        CHECK_EQ(err, (i < 2) ? ERROR_SUCCESS : ERROR_NO_MEM);
+        if (err == ERROR_SUCCESS)
+        {
+            memcpy(&expected[expected_len], msg, sizeof(msg));
+            expected_len += sizeof(msg);
+        }
+    }
+    /* Exactly up to the last free byte still goes in. */
+    message_fill(msg, SERIAL_TX_BUFF_SIZE - 1 - expected_len, 0xE0);
+    CHECK_EQ(serial_send_no_block(msg, SERIAL_TX_BUFF_SIZE - 1 - expected_len), ERROR_SUCCESS);
+    memcpy(&expected[expected_len], msg, SERIAL_TX_BUFF_SIZE - 1 - expected_len);
+    expected_len = SERIAL_TX_BUFF_SIZE - 1;
+    CHECK_EQ(serial_send_no_block(msg, 1), ERROR_NO_MEM);
+
+    model_drain();
+    CHECK(line_matches(expected, expected_len));
+}
+
+static void test_drop_oldest_keeps_the_newest_bytes(void)
+{
+    uint8_t msg[300];
+    setup(SERIAL_OVERFLOW_DROP_OLDEST);
+    message_fill(msg, sizeof(msg), 0);
+
+    CHECK_EQ(serial_send_no_block(msg, sizeof(msg)), ERROR_SUCCESS);
+    /* Masked while the tail was moved, enabled again by the last push. */
+    CHECK(UCSR0B & (1 << UDRIE0));
+    model_drain();
+    CHECK(line_matches(&msg[sizeof(msg) - (SERIAL_TX_BUFF_SIZE - 1)], SERIAL_TX_BUFF_SIZE - 1));
+
+    /* With the UART taking bytes in between, only what it had not taken yet is lost. */
+    setup(SERIAL_OVERFLOW_DROP_OLDEST);
+    CHECK_EQ(serial_send_no_block(msg, 100), ERROR_SUCCESS);
+    for (uint8_t i = 0; i < 40; ++i)
+    {
+        model_udre();
+    }
+    CHECK_EQ(serial_send_no_block(&msg[100], 100), ERROR_SUCCESS);
+    model_drain();
+
+    /* 40 sent, then the ring holds 60 + 100 > 127: the 33 oldest pending are dropped. */
+    uint8_t expected[40 + SERIAL_TX_BUFF_SIZE - 1];
+    memcpy(expected, msg, 40);
+    memcpy(&expected[40], &msg[200 - (SERIAL_TX_BUFF_SIZE - 1)], SERIAL_TX_BUFF_SIZE - 1);
+    CHECK(line_matches(expected, sizeof(expected)));
+}
+
+static void test_block_waits_for_the_uart(void)
+{
+    static uint8_t msg[1000];
+    setup(SERIAL_OVERFLOW_BLOCK);
+    message_fill(msg, sizeof(msg), 7);
+
+    uart_run(true);
+    CHECK_EQ(serial_send_no_block(msg, sizeof(msg)), ERROR_SUCCESS);
+    /* Blocked until all but the last ring full went out. */
+    CHECK(m_line_len >= sizeof(msg) - (SERIAL_TX_BUFF_SIZE - 1));
+    while (!serial_ready());
+    uart_run(false);
+    CHECK(line_matches(msg, sizeof(msg)));
+
+    /* serial_send_block() returns once the ring is empty, whatever the policy. */
+    setup(SERIAL_OVERFLOW_DROP_NEWEST);
+    uart_run(true);
+    CHECK_EQ(serial_send_block(msg, sizeof(msg)), ERROR_SUCCESS);
+    CHECK(serial_ready());
+    uart_run(false);
+    CHECK(line_matches(msg, sizeof(msg)));
+}
+
+int main(int argc, char **argv)
+{
+    TEST_RUN(test_drain_reports_completion_once);
+    TEST_RUN(test_drop_newest_keeps_messages_whole);
+    TEST_RUN(test_drop_oldest_keeps_the_newest_bytes);
+    TEST_RUN(test_block_waits_for_the_uart);
+    return test_report("serial");
+}
@@ -0,0 +1,524 @@
+#include <stdlib.h>
+#include "test.h"
+#include "ssd1306.h"
+#include "twi.h"
+
+#define RANDOM_ROUNDS   (20000)
+#define BENCH_ROUNDS    (2000UL)
+
+#if defined(SSD1306_DOUBLE_BUFFER)
+#define TEST_NAME       "ssd1306 double buffer"
+#else /* SSD1306_DOUBLE_BUFFER */
+#define TEST_NAME       "ssd1306"
+#endif /* SSD1306_DOUBLE_BUFFER */
+
+static ssd1306_t m_display;
+
+/* Buffer drawn pixel by pixel with divide and modulo, as the library did before
+ * spans were rasterized a byte at a time. */
+static uint8_t m_ref[SSD1306_BUFF_SIZE];
+static uint8_t m_ref_dirty_min[SSD1306_PAGES];
+static uint8_t m_ref_dirty_max[SSD1306_PAGES];
+
+/* What the panel shows, rebuilt from the transactions on the fake bus. */
+static uint8_t m_panel[SSD1306_BUFF_SIZE];
+
+/* Two page glyphs with a partial last page, to cover straddling and the cell mask. */
+static const uint8_t m_tall_glyphs[] =
+{
+    0xA5, 0x3C, 0xFF, 0x81, 0x5A,   0x0F, 0x09, 0x06, 0x0C, 0x03,
+    0x01, 0x80, 0x7E, 0x42, 0x99,   0x05, 0x0A, 0x0F, 0x00, 0x08,
+};
+static const ssd1306_font_t m_tall_font =
+{
+    .p_glyphs = m_tall_glyphs,
+    .width    = 5,
+    .height   = 12,
+    .first    = 'a',
+    .last     = 'b',
+};
+
+/*****************************************************************************/
+/*                         Fake TWI                                          */
+/*****************************************************************************/
+#define TWI_QUEUE_SIZE  (8)
+
+static twi_transaction_t *m_twi_queue[TWI_QUEUE_SIZE];
+static uint8_t m_twi_count;
+static uint8_t m_twi_column_min;
+static uint8_t m_twi_column_max;
+static uint8_t m_twi_page;
+
+uint8_t twi_initialized(void)
+{
+    return ERROR_SUCCESS;
+}
+
+void twi_init(twi_scl_t f_scl, twi_tx_callback tx_cb, twi_rx_callback rx_cb)
+{
+}
+
+error_t twi_transaction_push(twi_transaction_t *p_transaction)
+{
+    CHECK(m_twi_count < TWI_QUEUE_SIZE);
+    m_twi_queue[m_twi_count++] = p_transaction;
+    return ERROR_SUCCESS;
+}
+
+/* Plays the queued transactions into m_panel the way the controller would,
+ * band address commands followed by data. */
+static void twi_run(void)
+{
+    while (m_twi_count)
+    {
+        twi_transaction_t *p_transaction = m_twi_queue[0];
+        memmove(m_twi_queue, m_twi_queue + 1, --m_twi_count * sizeof(m_twi_queue[0]));
+
+        const twi_segment_t *p_segment = p_transaction->p_segments;
+        if (p_segment->dir == TWI_SEGMENT_WRITE_P)
+        {
+            /* Init sequence. */
+        }
+        else if (p_transaction->segments_num == 1)
+        {
+            CHECK_EQ(p_segment->len, 7);
+            CHECK_EQ(p_segment->p_buff[1], 0x21);
+            CHECK_EQ(p_segment->p_buff[4], 0x22);
+            m_twi_column_min = p_segment->p_buff[2];
+            m_twi_column_max = p_segment->p_buff[3];
+            m_twi_page       = p_segment->p_buff[5];
+        }
+        else
+        {
+            CHECK_EQ(p_segment[0].p_buff[0], 0x40);
+            CHECK_EQ(p_segment[1].len, m_twi_column_max - m_twi_column_min + 1);
+            memcpy(&m_panel[m_twi_page * SSD1306_WIDTH + m_twi_column_min],
+                   p_segment[1].p_buff, p_segment[1].len);
+        }
+
+        if (p_transaction->cb)
+        {
+            p_transaction->cb(p_transaction, TWI_STATUS_OK);
+        }
+    }
+}
+
+/*****************************************************************************/
+/*                         Per-pixel reference                               */
+/*****************************************************************************/
+static void ref_pixel(ssd1306_mode_t mode, int x, int y)
+{
+    if (x < 0 || y < 0 || x >= SSD1306_WIDTH || y >= SSD1306_HEIGHT)
+    {
+        return;
+    }
+
+    uint8_t *p_byte = &m_ref[x + (y / 8) * SSD1306_WIDTH];
+    uint8_t mask    = 1 << (y % 8);
+    switch (mode)
+    {
+        case SSD1306_MODE_CLEAR: *p_byte &= ~mask; break;
+        case SSD1306_MODE_XOR:   *p_byte ^=  mask; break;
+        case SSD1306_MODE_SET:
+        default:                 *p_byte |=  mask; break;
+    }
+    if (x < m_ref_dirty_min[y / 8])
+    {
+        m_ref_dirty_min[y / 8] = x;
+    }
+    if (x > m_ref_dirty_max[y / 8])
+    {
+        m_ref_dirty_max[y / 8] = x;
+    }
+}
+
+static void ref_fill_rect(ssd1306_mode_t mode, int x, int y, int width, int height)
+{
+    for (int j = 0; j < height; ++j)
+    {
+        for (int i = 0; i < width; ++i)
+        {
+            ref_pixel(mode, x + i, y + j);
+        }
+    }
+}
+
+/* Every outline pixel once, so XOR corners stay set. */
+static void ref_rect(ssd1306_mode_t mode, int x, int y, int width, int height)
+{
+    for (int j = 0; j < height; ++j)
+    {
+        for (int i = 0; i < width; ++i)
+        {
+            if (i == 0 || j == 0 || i == width - 1 || j == height - 1)
+            {
+                ref_pixel(mode, x + i, y + j);
+            }
+        }
+    }
+}
+
+static void ref_line(ssd1306_mode_t mode, int x0, int y0, int x1, int y1)
+{
+    int dx    =  abs(x1 - x0);
+    int dy    = -abs(y1 - y0);
+    int sx    = (x0 < x1) ? 1 : -1;
+    int sy    = (y0 < y1) ? 1 : -1;
+    int error = dx + dy;
+
+    for (;;)
+    {
+        ref_pixel(mode, x0, y0);
+        if (x0 == x1 && y0 == y1)
+        {
+            break;
+        }
+        int error2 = error * 2;
+        if (error2 >= dy)
+        {
+            error += dy;
+            x0    += sx;
+        }
+        if (error2 <= dx)
+        {
+            error += dx;
+            y0    += sy;
+        }
+    }
+}
+
+/* SET draws the cell opaque, CLEAR inverted, XOR flips the glyph pixels only. */
+static int ref_putc(ssd1306_mode_t mode, const ssd1306_font_t *p_font, int x, int y, char c)
+{
+    if (c < p_font->first || c > p_font->last)
+    {
+        return x;
+    }
+
+    int pages = (p_font->height + 7) / 8;
+    const uint8_t *p_glyph = p_font->p_glyphs + (c - p_font->first) * p_font->width * pages;
+    for (int row = 0; row < p_font->height; ++row)
+    {
+        for (int column = 0; column < p_font->width; ++column)
+        {
+            bool bit = (p_glyph[(row / 8) * p_font->width + column] >> (row % 8)) & 1;
+            switch (mode)
+            {
+                case SSD1306_MODE_XOR:
+                    if (bit)
+                    {
+                        ref_pixel(SSD1306_MODE_XOR, x + column, y + row);
+                    }
+                    break;
+                case SSD1306_MODE_CLEAR:
+                    ref_pixel(bit ? SSD1306_MODE_CLEAR : SSD1306_MODE_SET, x + column, y + row);
+                    break;
+                case SSD1306_MODE_SET:
+                default:
+                    ref_pixel(bit ? SSD1306_MODE_SET : SSD1306_MODE_CLEAR, x + column, y + row);
+                    break;
+            }
+        }
+    }
+    return x + p_font->width;
+}
+
+/*****************************************************************************/
+/*                         Tests                                             */
+/*****************************************************************************/
+static void setup(void)
+{
+    ssd1306_init(&m_display, SSD1306_ADDRESS);
+    ssd1306_power_up(&m_display);
+    twi_run();
+    memset(m_ref, 0, sizeof(m_ref));
+    memset(m_ref_dirty_min, 0xFF, sizeof(m_ref_dirty_min));
+    memset(m_ref_dirty_max, 0, sizeof(m_ref_dirty_max));
+}
+
+static bool buff_matches(void)
+{
+    return memcmp(m_display.buff, m_ref, sizeof(m_ref)) == 0;
+}
+
+/* Every pixel the reference touched lies in the dirty spans, which may be wider. */
+static bool dirty_covers_reference(void)
+{
+    for (uint8_t page = 0; page < SSD1306_PAGES; ++page)
+    {
+        if (m_ref_dirty_min[page] <= m_ref_dirty_max[page] &&
+            (m_display.dirty_min[page] > m_ref_dirty_min[page] || m_display.dirty_max[page] < m_ref_dirty_max[page]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Partial updates must bring the panel to what was drawn. */
+static bool panel_matches(void)
+{
+    CHECK(dirty_covers_reference());
+    memset(m_ref_dirty_min, 0xFF, sizeof(m_ref_dirty_min));
+    memset(m_ref_dirty_max, 0, sizeof(m_ref_dirty_max));
+    CHECK_EQ(ssd1306_update_partial(&m_display), ERROR_SUCCESS);
+    twi_run();
+    CHECK(!ssd1306_busy(&m_display));
+    return memcmp(m_panel, m_display.buff, sizeof(m_panel)) == 0;
+}
+
+static void test_power_up_sends_the_frame(void)
+{
+    memset(m_panel, 0xAA, sizeof(m_panel));
+    ssd1306_init(&m_display, SSD1306_ADDRESS);
+    CHECK(!ssd1306_ready(&m_display));
+    ssd1306_fill_rect(&m_display, 3, 5, 20, 9);
+    /* Held back until the panel is powered, as if an update was on the bus. */
+    CHECK_EQ(ssd1306_update(&m_display), ERROR_SUCCESS);
+    twi_run();
+    CHECK_EQ(m_panel[0], 0xAA);
+
+    ssd1306_power_up(&m_display);
+    twi_run();
+    CHECK(ssd1306_ready(&m_display));
+    CHECK(memcmp(m_panel, m_display.buff, sizeof(m_panel)) == 0);
+}
+
+static void test_update_while_busy_is_latched(void)
+{
+    setup();
+    ssd1306_fill_rect(&m_display, 0, 0, 40, 8);
+    CHECK_EQ(ssd1306_update_partial(&m_display), ERROR_SUCCESS);
+    CHECK(ssd1306_busy(&m_display));
+
+    /* Drawn and asked for while the first update is on the bus. */
+    ssd1306_fill_rect(&m_display, 60, 20, 30, 10);
+    CHECK_EQ(ssd1306_update_partial(&m_display), ERROR_SUCCESS);
+    CHECK_EQ(ssd1306_update_partial(&m_display), ERROR_SUCCESS);
+#if defined(SSD1306_DOUBLE_BUFFER)
+    /* The frame on the bus is left alone until it is out. */
+    CHECK_EQ(m_display.front_buff[3 * SSD1306_WIDTH + 60], 0);
+#endif /* SSD1306_DOUBLE_BUFFER */
+
+    twi_run();
+    CHECK(!ssd1306_busy(&m_display));
+    CHECK(memcmp(m_panel, m_display.buff, sizeof(m_panel)) == 0);
+}
+
+static void test_primitives_match_per_pixel(void)
+{
+    for (uint8_t mode = SSD1306_MODE_SET; mode <= SSD1306_MODE_XOR; ++mode)
+    {
+        setup();
+        /* XOR and CLEAR need something underneath. */
+        ssd1306_draw_mode_set(&m_display, SSD1306_MODE_SET);
+        ssd1306_fill_rect(&m_display, 10, 3, 60, 20);
+        ref_fill_rect(SSD1306_MODE_SET, 10, 3, 60, 20);
+
+        ssd1306_draw_mode_set(&m_display, mode);
+        ssd1306_line_h(&m_display, 0, 7, 200);
+        ref_fill_rect(mode, 0, 7, 200, 1);
+        ssd1306_line_v(&m_display, 40, 1, 30);
+        ref_fill_rect(mode, 40, 1, 1, 30);
+        ssd1306_rect(&m_display, 20, 2, 50, 20);
+        ref_rect(mode, 20, 2, 50, 20);
+        ssd1306_rect(&m_display, 120, 28, 20, 20);
+        ref_rect(mode, 120, 28, 20, 20);
+        ssd1306_line(&m_display, 0, 0, 127, 31);
+        ref_line(mode, 0, 0, 127, 31);
+        ssd1306_line(&m_display, 100, 2, 90, 30);
+        ref_line(mode, 100, 2, 90, 30);
+        ssd1306_draw_pixel(&m_display, 127, 31);
+        ref_pixel(mode, 127, 31);
+        CHECK(buff_matches());
+        CHECK(panel_matches());
+    }
+}
+
+static void test_glyphs_match_per_pixel(void)
+{
+    for (uint8_t mode = SSD1306_MODE_SET; mode <= SSD1306_MODE_XOR; ++mode)
+    {
+        setup();
+        ssd1306_fill_rect(&m_display, 0, 8, 128, 8);
+        ref_fill_rect(SSD1306_MODE_SET, 0, 8, 128, 8);
+
+        ssd1306_draw_mode_set(&m_display, mode);
+        const char *p_text = "Hello, 0x7A!";
+        int x_ref = 3;
+        CHECK_EQ(ssd1306_puts(&m_display, 3, 5, p_text), 3 + 6 * strlen(p_text));
+        for (const char *p_c = p_text; *p_c; ++p_c)
+        {
+            x_ref = ref_putc(mode, &ssd1306_font_6x8, x_ref, 5, *p_c);
+        }
+        /* Clipped on the right and at the bottom. */
+        ssd1306_putc(&m_display, 124, 28, 'W');
+        ref_putc(mode, &ssd1306_font_6x8, 124, 28, 'W');
+
+        ssd1306_font_set(&m_display, &m_tall_font);
+        ssd1306_puts(&m_display, 60, 13, "ab");
+        ref_putc(mode, &m_tall_font, 60, 13, 'a');
+        ref_putc(mode, &m_tall_font, 65, 13, 'b');
+        ssd1306_putc(&m_display, 90, 24, 'b');
+        ref_putc(mode, &m_tall_font, 90, 24, 'b');
+        ssd1306_font_set(&m_display, NULL);
+
+        CHECK(buff_matches());
+        CHECK(panel_matches());
+    }
+}
+
+/* Random primitives and glyphs, clipped anywhere, in every mode. */
+static void test_random_against_reference(void)
+{
+    setup();
+    srand(14);
+    for (uint32_t round = 0; round < RANDOM_ROUNDS; ++round)
+    {
+        ssd1306_mode_t mode = rand() % 3;
+        uint8_t x = rand() % (SSD1306_WIDTH + 16);
+        uint8_t y = rand() % (SSD1306_HEIGHT + 16);
+        uint8_t a = rand() % (SSD1306_WIDTH + 16);
+        uint8_t b = rand() % (SSD1306_HEIGHT + 16);
+
+        ssd1306_draw_mode_set(&m_display, mode);
+        switch (rand() % 5)
+        {
+            case 0:
+                ssd1306_fill_rect(&m_display, x, y, a, b);
+                ref_fill_rect(mode, x, y, a, b);
+                break;
+            case 1:
+                ssd1306_rect(&m_display, x, y, a, b);
+                ref_rect(mode, x, y, a, b);
+                break;
+            case 2:
+                ssd1306_line(&m_display, x, y, a, b);
+                ref_line(mode, x, y, a, b);
+                break;
+            case 3:
+            {
+                char c = ' ' + rand() % 96;
+                ssd1306_putc(&m_display, x, y, c);
+                ref_putc(mode, &ssd1306_font_6x8, x, y, c);
+                break;
+            }
+            default:
+            {
+                char c = 'a' + rand() % 2;
+                ssd1306_font_set(&m_display, &m_tall_font);
+                ssd1306_putc(&m_display, x, y, c);
+                ssd1306_font_set(&m_display, NULL);
+                ref_putc(mode, &m_tall_font, x, y, c);
+                break;
+            }
+        }
+
+        if (!buff_matches() || !dirty_covers_reference())
+        {
+            CHECK(buff_matches());
+            CHECK(dirty_covers_reference());
+            printf("    round %u differs\n", round);
+            return;
+        }
+        /* Spans build up over a few primitives before they go out. */
+        if (round % 8 == 0)
+        {
+            CHECK(panel_matches());
+        }
+    }
+    CHECK(panel_matches());
+}
+
+/*****************************************************************************/
+/*                         Benchmark                                         */
+/*****************************************************************************/
+typedef struct
+{
+    const char  *p_name;
+    uint32_t    pixels;
+    void        (*rasterized)(void);
+    void        (*per_pixel)(void);
+} bench_case_t;
+
+static void bench_fill_rasterized(void)   { ssd1306_fill_rect(&m_display, 0, 0, 128, 32); }
+static void bench_fill_per_pixel(void)    { ref_fill_rect(SSD1306_MODE_XOR, 0, 0, 128, 32); }
+static void bench_line_h_rasterized(void) { for (uint8_t y = 0; y < 32; ++y) ssd1306_line_h(&m_display, 0, y, 128); }
+static void bench_line_h_per_pixel(void)  { for (uint8_t y = 0; y < 32; ++y) ref_fill_rect(SSD1306_MODE_XOR, 0, y, 128, 1); }
+static void bench_line_v_rasterized(void) { for (uint8_t x = 0; x < 128; ++x) ssd1306_line_v(&m_display, x, 0, 32); }
+static void bench_line_v_per_pixel(void)  { for (uint8_t x = 0; x < 128; ++x) ref_fill_rect(SSD1306_MODE_XOR, x, 0, 1, 32); }
+static void bench_line_rasterized(void)   { for (uint8_t x = 0; x < 128; ++x) ssd1306_line(&m_display, x, 0, 127 - x, 31); }
+static void bench_line_per_pixel(void)    { for (uint8_t x = 0; x < 128; ++x) ref_line(SSD1306_MODE_XOR, x, 0, 127 - x, 31); }
+static void bench_text_rasterized(void)
+{
+    for (uint8_t y = 0; y < 32; y += 5)
+    {
+        ssd1306_puts(&m_display, 1, y, "0123456789ABCDEFGHIJK");
+    }
+}
+static void bench_text_per_pixel(void)
+{
+    for (uint8_t y = 0; y < 32; y += 5)
+    {
+        int x = 1;
+        for (const char *p_c = "0123456789ABCDEFGHIJK"; *p_c; ++p_c)
+        {
+            x = ref_putc(SSD1306_MODE_XOR, &ssd1306_font_6x8, x, y, *p_c);
+        }
+    }
+}
+
+static double bench_run(void (*draw)(void), uint32_t pixels)
+{
+    uint64_t start = bench_ticks();
+    for (uint32_t i = 0; i < BENCH_ROUNDS; ++i)
+    {
+        draw();
+    }
+    uint64_t ticks = bench_ticks() - start;
+    g_bench_sink = m_display.buff[0] ^ m_ref[0];
+    return (double)ticks / ((double)BENCH_ROUNDS * pixels);
+}
+
+static void bench(void)
+{
+    /* Glyph rows 5 apart, the last one clipped to 2 of 8 pixel rows. */
+    bench_case_t cases[] =
+    {
+        {"fill_rect 128x32", 128 * 32,             bench_fill_rasterized,   bench_fill_per_pixel},
+        {"line_h x32",       128 * 32,             bench_line_h_rasterized, bench_line_h_per_pixel},
+        {"line_v x128",      128 * 32,             bench_line_v_rasterized, bench_line_v_per_pixel},
+        {"line diag x128",   0,                    bench_line_rasterized,   bench_line_per_pixel},
+        {"text 6x8",         21 * 6 * (6 * 8 + 2), bench_text_rasterized,   bench_text_per_pixel},
+    };
+    for (int x = 0; x < 128; ++x)
+    {
+        int dx = abs(127 - 2 * x);
+        cases[3].pixels += ((dx > 31) ? dx : 31) + 1;
+    }
+
+    setup();
+    ssd1306_draw_mode_set(&m_display, SSD1306_MODE_XOR);
+    printf("  %s per pixel, XOR mode:\n", BENCH_UNIT);
+    printf("                     rasterized  per-pixel\n");
+    for (uint8_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+    {
+        double rasterized = bench_run(cases[i].rasterized, cases[i].pixels);
+        double per_pixel  = bench_run(cases[i].per_pixel, cases[i].pixels);
+        printf("    %-16s  %9.2f  %9.2f\n", cases[i].p_name, rasterized, per_pixel);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    TEST_RUN(test_power_up_sends_the_frame);
+    TEST_RUN(test_update_while_busy_is_latched);
+    TEST_RUN(test_primitives_match_per_pixel);
+    TEST_RUN(test_glyphs_match_per_pixel);
+    TEST_RUN(test_random_against_reference);
+    if (test_bench_requested(argc, argv))
+    {
+        bench();
+    }
+    return test_report(TEST_NAME);
+}
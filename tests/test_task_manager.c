@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "test.h"
+#include "task_manager.h"
+
+/* Runs the task set the Sofia_wardrobe and z80_bus_monitor builds ship with
+ * and counts the scheduler interrupts, in tick and in tickless mode. Tasks
+ * take no time, so the counts are what the scheduler itself costs. */
+
+#define TICKS_PER_MS        (250)           /* < Timer0 and Timer1 run at F_CPU/64. */
+#define RUN_MS              (60000UL)
+
+#if defined(TASK_MANAGER_TICKLESS)
+#define TEST_NAME           "task_manager tickless"
+void TIMER1_OVF_vect(void);
+void TIMER1_COMPA_vect(void);
+#else /* TASK_MANAGER_TICKLESS */
+#define TEST_NAME           "task_manager tick"
+void TIMER0_COMPA_vect(void);
+#endif /* TASK_MANAGER_TICKLESS */
+
+typedef struct
+{
+    const char      *p_name;
+    uint16_t        delay;
+    uint16_t        period;
+    task_priority_t priority;
+    uint16_t        busy_ms;                /* < Time the task itself takes. */
+    uint32_t        runs;
+    uint64_t        last_ms;
+    bool            late;
+} shipped_task_t;
+
+/* main.c of both projects: display power-up, two LED tasks and the pixel task,
+ * which waits for the frame to go out over TWI. */
+static shipped_task_t m_tasks[] =
+{
+    {"display_power_up", 100,  0,    TASK_PRIORITY_HIGH},
+    {"sys_led_on",       0,    2000, TASK_PRIORITY_NORMAL},
+    {"sys_led_off",      1000, 2000, TASK_PRIORITY_NORMAL},
+    {"draw_pixel",       0,    5000, TASK_PRIORITY_LOW, 3},
+};
+
+static uint64_t m_ticks;                    /* < True time in Timer1 counts. */
+static uint32_t m_overflows;
+static uint32_t m_compares;
+#if defined(TASK_MANAGER_TICKLESS)
+static uint32_t m_wakeups;
+static bool     m_slept;
+#endif /* TASK_MANAGER_TICKLESS */
+
+static void model_busy(uint16_t ms);
+
+static void task_run(void *p_param)
+{
+    shipped_task_t *p_task = p_param;
+    uint64_t now_ms = m_ticks / TICKS_PER_MS;
+
+#if defined(TASK_MANAGER_TICKLESS)
+    /* Due a period after the previous deadline, whatever the task took. */
+    uint64_t expected = p_task->runs ? p_task->last_ms + p_task->period : p_task->delay;
+    uint64_t slack    = 0;
+#else /* TASK_MANAGER_TICKLESS */
+    /* The tick mode counts a period from the tick after the run. */
+    uint64_t expected = p_task->runs ? p_task->last_ms + p_task->busy_ms + p_task->period : p_task->delay;
+    uint64_t slack    = 1;
+#endif /* TASK_MANAGER_TICKLESS */
+    if (now_ms < expected || now_ms > expected + slack)
+    {
+        p_task->late = true;
+        printf("    %s ran at %llu ms, expected %llu\n", p_task->p_name,
+               (unsigned long long)now_ms, (unsigned long long)expected);
+    }
+    p_task->runs++;
+    p_task->last_ms = now_ms;
+    model_busy(p_task->busy_ms);
+}
+
+static void shipped_tasks_create(void)
+{
+    for (uint8_t i = 0; i < sizeof(m_tasks) / sizeof(m_tasks[0]); ++i)
+    {
+        CHECK_EQ(task_create(task_run, &m_tasks[i], m_tasks[i].delay, m_tasks[i].period,
+                             m_tasks[i].priority), ERROR_SUCCESS);
+    }
+}
+
+#if defined(TASK_MANAGER_TICKLESS)
+/* Timer1 in normal mode: lets it run up to the next overflow or compare match,
+ * but not past the given time, and delivers that interrupt. */
+static void model_step(uint64_t limit)
+{
+    uint64_t overflow = (m_ticks | 0xFFFF) + 1;
+    uint64_t compare  = (m_ticks & ~(uint64_t)0xFFFF) | OCR1A;
+    if (compare <= m_ticks)
+    {
+        compare += 0x10000;
+    }
+    bool compare_armed = TIMSK1 & (1 << OCIE1A);
+
+    uint64_t next = (overflow < limit) ? overflow : limit;
+    if (compare_armed && compare < next)
+    {
+        next = compare;
+    }
+    m_ticks = next;
+    TCNT1   = (uint16_t)m_ticks;
+    /* Flags are cleared by writing ones and every interrupt is delivered at once,
+     * so none is ever left pending. */
+    TIFR1   = 0;
+
+    /* Interrupts are always enabled where time passes, in sleep and between tasks. */
+    CHECK(SREG & (1 << SREG_I));
+    if (m_ticks == overflow)
+    {
+        m_overflows++;
+        TIMER1_OVF_vect();
+    }
+    if (compare_armed && m_ticks == compare)
+    {
+        m_compares++;
+        TIMER1_COMPA_vect();
+    }
+}
+
+static void model_busy(uint16_t ms)
+{
+    uint64_t end = m_ticks + (uint64_t)ms * TICKS_PER_MS;
+    while (m_ticks < end)
+    {
+        model_step(end);
+    }
+}
+
+void host_sleep_cpu(void)
+{
+    m_wakeups++;
+    m_slept = true;
+    model_step(UINT64_MAX);
+}
+
+static void model_run(uint64_t end_ms)
+{
+    while (m_ticks < end_ms * TICKS_PER_MS)
+    {
+        m_slept = false;
+        task_proccess();
+        /* Returned without sleeping, a deadline is too close to arm. */
+        if (!m_slept)
+        {
+            model_step(m_ticks + 1);
+        }
+    }
+}
+#else /* TASK_MANAGER_TICKLESS */
+static void model_tick(void)
+{
+    m_ticks += TICKS_PER_MS;
+    m_compares++;
+    TIMER0_COMPA_vect();
+}
+
+static void model_busy(uint16_t ms)
+{
+    while (ms--)
+    {
+        model_tick();
+    }
+}
+
+static void model_run(uint64_t end_ms)
+{
+    /* The CPU spins in task_proccess() and takes every 1 ms tick. */
+    while (m_ticks < end_ms * TICKS_PER_MS)
+    {
+        model_tick();
+        task_proccess();
+    }
+}
+#endif /* TASK_MANAGER_TICKLESS */
+
+static void test_shipped_tasks_run_on_time(void)
+{
+    task_manager_init();
+#if defined(TASK_MANAGER_TICKLESS)
+    TIFR1 = 0;
+#endif /* TASK_MANAGER_TICKLESS */
+    shipped_tasks_create();
+    model_run(RUN_MS);
+
+    CHECK_EQ(m_tasks[0].runs, 1);
+    for (uint8_t i = 1; i < sizeof(m_tasks) / sizeof(m_tasks[0]); ++i)
+    {
+        /* Runs that fit into the window, up to one lost to the tick mode's drift. */
+        uint32_t runs = (RUN_MS - 1 - m_tasks[i].delay) / m_tasks[i].period + 1;
+        CHECK(m_tasks[i].runs <= runs && m_tasks[i].runs + 1 >= runs);
+    }
+    for (uint8_t i = 0; i < sizeof(m_tasks) / sizeof(m_tasks[0]); ++i)
+    {
+        CHECK(!m_tasks[i].late);
+    }
+}
+
+static void test_isr_rate(void)
+{
+    uint32_t isr = task_manager_isr_cnt_get();
+    double seconds = RUN_MS / 1000.0;
+
+    CHECK_EQ(isr, m_overflows + m_compares);
+#if defined(TASK_MANAGER_TICKLESS)
+    /* 250000 / 65536 overflows per second, plus a compare match per deadline. */
+    CHECK(isr / seconds < 6.0);
+    printf("    %.2f scheduler ISRs/s (%.2f overflow, %.2f compare), %.2f wakeups/s\n",
+           isr / seconds, m_overflows / seconds, m_compares / seconds, m_wakeups / seconds);
+#else /* TASK_MANAGER_TICKLESS */
+    CHECK_EQ(isr, RUN_MS);
+    printf("    %.2f scheduler ISRs/s, the CPU never sleeps\n", isr / seconds);
+#endif /* TASK_MANAGER_TICKLESS */
+}
+
+int main(int argc, char **argv)
+{
+    TEST_RUN(test_shipped_tasks_run_on_time);
+    TEST_RUN(test_isr_rate);
+    return test_report(TEST_NAME);
+}
@@ -0,0 +1,200 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+/* Timer0 model: CTC at 250 counts per ms, 4 us per count. Every TCNT0 and TIFR0
+ * read lets the timer run on by a few counts, so the compare match can land
+ * between any two reads, including inside the cli() section of the reads. */
+volatile uint8_t* model_tcnt0(void);
+volatile uint8_t* model_tifr0(void);
+#define TCNT0       (*model_tcnt0())
+#define TIFR0       (*model_tifr0())
+
+#include "test.h"
+/* Built into this file to reach the counters and the ISR. */
+#include "../components/timer_timestamp/src/timer_timestamp.c"
+
+#define COUNTS_PER_MS       (250)
+#define US_PER_COUNT        (4)
+
+typedef struct
+{
+    uint64_t            counts;         /* < Counts since init, the true time. */
+    uint8_t             tcnt;
+    volatile uint8_t    tifr;
+    volatile uint8_t    read_value;
+    uint8_t             step_max;       /* < Counts a register read may take. */
+    uint8_t             tifr_delay;     /* < Counts the next TIFR0 read takes, on top. */
+    uint32_t            raced;          /* < Match pending while the ms counter was read. */
+} timer_model_t;
+
+static timer_model_t m_timer;
+
+static void model_run(uint32_t counts)
+{
+    for (uint32_t i = 0; i <= counts; ++i)
+    {
+        /* The ISR runs between instructions while interrupts are enabled. */
+        if ((SREG & (1 << SREG_I)) && (m_timer.tifr & (1 << OCF0A)))
+        {
+            m_timer.tifr &= ~(1 << OCF0A);
+            TIMER0_COMPA_vect();
+        }
+        if (i == counts)
+        {
+            break;
+        }
+        m_timer.counts++;
+        if (++m_timer.tcnt == COUNTS_PER_MS)
+        {
+            m_timer.tcnt  = 0;
+            m_timer.tifr |= (1 << OCF0A);
+        }
+    }
+}
+
+/* A pending match is taken as soon as SREG is restored, right after each API call. */
+static void model_irq(void)
+{
+    model_run(0);
+}
+
+static void model_step(void)
+{
+    model_run(m_timer.step_max ? rand() % (m_timer.step_max + 1) : 0);
+}
+
+volatile uint8_t* model_tcnt0(void)
+{
+    model_step();
+    if (m_timer.tifr & (1 << OCF0A))
+    {
+        m_timer.raced++;
+    }
+    m_timer.read_value = m_timer.tcnt;
+    return &m_timer.read_value;
+}
+
+volatile uint8_t* model_tifr0(void)
+{
+    model_step();
+    model_run(m_timer.tifr_delay);
+    m_timer.tifr_delay = 0;
+    return &m_timer.tifr;
+}
+
+static void model_reset(uint32_t ms)
+{
+    memset(&m_timer, 0, sizeof(m_timer));
+    m_timer.counts    = (uint64_t)ms * COUNTS_PER_MS;
+    g_timestamp       = ms;
+    g_timestamp_epoch = 0;
+    SREG              = (1 << SREG_I);
+}
+
+static uint64_t model_us(void)
+{
+    return m_timer.counts * US_PER_COUNT;
+}
+
+static void test_reads_in_step_with_the_timer(void)
+{
+    model_reset(0);
+    model_run(COUNTS_PER_MS * 3 + 10);
+    CHECK_EQ(timer_timestamp_ms_get(), 3);
+    CHECK_EQ(timer_timestamp_us_get(), 3040);
+    CHECK_EQ(timer_timestamp_us64_get(), 3040);
+}
+
+/* Every result must lie between the true time at the call and after it, and never go back.
+ * The 32-bit clocks are compared modulo their wrap. */
+static void check_window(uint8_t step_max, uint32_t start_ms, uint32_t calls)
+{
+    uint64_t last_us64 = 0;
+    uint32_t last_us   = 0;
+    uint32_t last_ms   = 0;
+    uint32_t bad       = 0;
+
+    model_reset(start_ms);
+    m_timer.step_max = step_max;
+    for (uint32_t i = 0; i < calls; ++i)
+    {
+        model_run(rand() % 300);
+
+        uint64_t before = model_us();
+        uint64_t us64   = timer_timestamp_us64_get();
+        model_irq();
+        uint32_t us     = timer_timestamp_us_get();
+        model_irq();
+        uint32_t ms     = timer_timestamp_ms_get();
+        model_irq();
+        uint64_t after  = model_us();
+
+        bool ok = us64 >= before && us64 <= after &&
+                  (uint32_t)(us - (uint32_t)before) <= (uint32_t)(after - before) &&
+                  (uint32_t)(ms - (uint32_t)(before / 1000)) <= (uint32_t)(after / 1000 - before / 1000);
+        if (i > 0)
+        {
+            ok = ok && us64 >= last_us64 && (int32_t)(us - last_us) >= 0 && (int32_t)(ms - last_ms) >= 0;
+        }
+        if (!ok && bad++ < 5)
+        {
+            printf("    call %u: us64 %llu us %u ms %u, true %llu..%llu\n", i,
+                   (unsigned long long)us64, us, ms,
+                   (unsigned long long)before, (unsigned long long)after);
+        }
+        last_us64 = us64;
+        last_us   = us;
+        last_ms   = ms;
+    }
+    CHECK_EQ(bad, 0);
+}
+
+static void test_overflow_race(void)
+{
+    srand(11);
+    /* A few counts per register read: the match often lands inside the capture. */
+    check_window(2, 0, 200000);
+    CHECK(m_timer.raced > 1000);
+}
+
+static void test_no_double_count_near_the_top(void)
+{
+    uint16_t epoch;
+    uint32_t ms;
+
+    model_reset(7);
+    model_run(COUNTS_PER_MS - 1);
+    cli();
+    /* Match after the TCNT0 read but before the TIFR0 read: the count was taken
+     * at the top of ms 7, the pending flag belongs to ms 8 and must not be added. */
+    m_timer.tifr_delay = 1;
+    uint8_t cnt = timestamp_capture(&epoch, &ms);
+    CHECK_EQ(cnt, COUNTS_PER_MS - 1);
+    CHECK_EQ(ms, 7);
+
+    /* Still pending on the next read, now TCNT0 has restarted and the ms is added. */
+    cnt = timestamp_capture(&epoch, &ms);
+    CHECK_EQ(cnt, 0);
+    CHECK_EQ(ms, 8);
+    sei();
+    model_irq();
+    CHECK_EQ(timer_timestamp_ms_get(), 8);
+}
+
+static void test_32bit_wrap_extends_into_epoch(void)
+{
+    srand(13);
+    /* Start right before the ms counter wraps, the 64-bit clock must carry on. */
+    check_window(2, 0xFFFFFFF0UL, 20000);
+    CHECK_EQ(g_timestamp_epoch, 1);
+    CHECK(timer_timestamp_us64_get() > 0xFFFFFFFFULL * 1000);
+}
+
+int main(int argc, char **argv)
+{
+    TEST_RUN(test_reads_in_step_with_the_timer);
+    TEST_RUN(test_overflow_race);
+    TEST_RUN(test_no_double_count_near_the_top);
+    TEST_RUN(test_32bit_wrap_extends_into_epoch);
+    return test_report("timer_timestamp");
+}
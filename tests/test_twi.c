@@ -0,0 +1,439 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+/* TWI model: the driver's TWCR writes are commands, model_run() carries them out
+ * on a bus with one slave and calls TWI_vect for every status. A STOP keeps
+ * TWSTO set for a few TWCR accesses, as the hardware does while it is on the bus. */
+volatile uint8_t* model_twcr(void);
+#define TWCR        (*model_twcr())
+
+#include "test.h"
+/* Built into this file to reach the queue and the ISR. */
+#include "../avr_drivers/twi/twi.c"
+
+#define SLAVE_ADDR          (0x78)
+#define STOP_ACCESSES       (3)             /* < TWCR accesses a STOP stays on the bus for. */
+#define BENCH_ROUNDS        (100)
+
+typedef struct
+{
+    uint16_t    scl_khz;
+    double      start_us;                   /* < tHD;STA */
+    double      restart_us;                 /* < tSU;STA + tHD;STA */
+    double      stop_us;                    /* < tSU;STO + tBUF before the next START */
+} bus_timing_t;
+
+/* I2C minimum timings for standard and fast mode. */
+static const bus_timing_t m_timings[] =
+{
+    {100, 4.0, 8.7, 8.7},
+    {400, 0.6, 1.2, 1.9},
+};
+
+typedef struct
+{
+    uint8_t     twcr;
+    bool        owned;                      /* < START sent, no STOP yet. */
+    bool        addr_next;                  /* < Next byte is SLA+R/W. */
+    bool        reading;
+    bool        reg_next;                   /* < First written byte sets the register pointer. */
+    uint8_t     stop_accesses;              /* < TWSTO clears after this many TWCR accesses. */
+    uint8_t     reg;
+    uint8_t     mem[256];                   /* < Slave registers. */
+    uint32_t    starts;
+    uint32_t    restarts;
+    uint32_t    stops;
+    uint32_t    bytes;                      /* < Bytes on the bus, SLA included. */
+    uint32_t    stop_spins_locked;          /* < TWSTO polled with interrupts disabled. */
+    uint32_t    start_over_stop;            /* < START written while a STOP was on the bus. */
+    const bus_timing_t *p_timing;
+    double      bus_us;
+} twi_model_t;
+
+static twi_model_t m_twi;
+
+volatile uint8_t* model_twcr(void)
+{
+    if (m_twi.stop_accesses)
+    {
+        if (!(SREG & (1 << SREG_I)))
+        {
+            m_twi.stop_spins_locked++;
+        }
+        if (--m_twi.stop_accesses == 0)
+        {
+            m_twi.twcr &= ~(1 << TWSTO);
+        }
+    }
+    return &m_twi.twcr;
+}
+
+static void model_reset(const bus_timing_t *p_timing)
+{
+    memset(&m_twi, 0, sizeof(m_twi));
+    m_twi.p_timing = p_timing;
+    for (uint16_t i = 0; i < sizeof(m_twi.mem); ++i)
+    {
+        m_twi.mem[i] = (uint8_t)(i * 7 + 3);
+    }
+}
+
+static void model_byte(void)
+{
+    m_twi.bytes++;
+    m_twi.bus_us += 9 * 1000.0 / m_twi.p_timing->scl_khz;
+}
+
+/* Carries out TWCR commands until the driver leaves the bus alone. */
+static void model_run(void)
+{
+    while (m_twi.twcr & (1 << TWINT))
+    {
+        uint8_t cmd = m_twi.twcr;
+        m_twi.twcr &= ~(1 << TWINT);
+
+        if (cmd & (1 << TWSTO))
+        {
+            m_twi.stops++;
+            m_twi.owned   = false;
+            m_twi.bus_us += m_twi.p_timing->stop_us;
+            if (!(cmd & (1 << TWSTA)))
+            {
+                /* No interrupt follows a STOP. */
+                m_twi.stop_accesses = STOP_ACCESSES;
+                continue;
+            }
+            m_twi.twcr &= ~(1 << TWSTO);
+        }
+
+        if (cmd & (1 << TWSTA))
+        {
+            if (m_twi.stop_accesses)
+            {
+                m_twi.start_over_stop++;
+                m_twi.stop_accesses = 0;
+            }
+            TWSR = m_twi.owned ? TWI_R_START_TRANSMITTED : TWI_START_TRANSMITTED;
+            m_twi.bus_us += m_twi.owned ? m_twi.p_timing->restart_us : m_twi.p_timing->start_us;
+            m_twi.restarts  += m_twi.owned;
+            m_twi.starts    += !m_twi.owned;
+            m_twi.owned      = true;
+            m_twi.addr_next  = true;
+        }
+        else if (m_twi.addr_next)
+        {
+            bool ack = (TWDR & 0xFE) == SLAVE_ADDR;
+            model_byte();
+            m_twi.addr_next = false;
+            m_twi.reading   = TWDR & 1;
+            m_twi.reg_next  = !m_twi.reading;
+            if (m_twi.reading)
+            {
+                TWSR = ack ? TWI_SLA_R_TRANSMITTED_ACK : TWI_SLA_R_TRANSMITTED_NACK;
+            }
+            else
+            {
+                TWSR = ack ? TWI_SLA_W_TRANSMITTED_ACK : TWI_SLA_W_TRANSMITTED_NACK;
+            }
+        }
+        else if (m_twi.reading)
+        {
+            model_byte();
+            TWDR = m_twi.mem[m_twi.reg++];
+            TWSR = (cmd & (1 << TWEA)) ? TWI_DATA_RECEIVED_ACK : TWI_DATA_RECEIVED_NACK;
+        }
+        else
+        {
+            model_byte();
+            if (m_twi.reg_next)
+            {
+                m_twi.reg      = TWDR;
+                m_twi.reg_next = false;
+            }
+            else
+            {
+                m_twi.mem[m_twi.reg++] = TWDR;
+            }
+            TWSR = TWI_DATA_TRANSMITTED_ACK;
+        }
+
+        /* The vector runs with interrupts disabled. */
+        uint8_t sreg = SREG;
+        cli();
+        TWI_vect();
+        SREG = sreg;
+    }
+}
+
+/*****************************************************************************/
+/*                         Transactions                                      */
+/*****************************************************************************/
+typedef struct
+{
+    twi_transaction_t   transaction;
+    twi_segment_t       segments[2];
+    uint8_t             buff[2][32];
+    uint8_t             status;
+    uint8_t             done;
+    uint8_t             order;
+} test_transaction_t;
+
+static uint8_t              m_done_cnt;
+static test_transaction_t   *mp_chained;    /* < Pushed from the callback of the next transaction to finish. */
+
+static void transaction_cb(twi_transaction_t *p_transaction, uint8_t status)
+{
+    test_transaction_t *p_test = p_transaction->p_context;
+    p_test->status = status;
+    p_test->done++;
+    p_test->order  = m_done_cnt++;
+
+    if (mp_chained)
+    {
+        test_transaction_t *p_next = mp_chained;
+        mp_chained = NULL;
+        CHECK_EQ(twi_transaction_push(&p_next->transaction), ERROR_SUCCESS);
+    }
+}
+
+/* Write of a register number and len bytes, or a repeated start read of len bytes from it. */
+static void transaction_setup(test_transaction_t *p_test, uint8_t addr, uint8_t reg, bool read, uint8_t len)
+{
+    memset(p_test, 0, sizeof(*p_test));
+    p_test->buff[0][0] = reg;
+    for (uint8_t i = 0; i < len; ++i)
+    {
+        p_test->buff[1][i] = (uint8_t)(0xA0 + reg + i);
+    }
+    p_test->segments[0].dir    = TWI_SEGMENT_WRITE;
+    p_test->segments[0].p_buff = p_test->buff[0];
+    p_test->segments[0].len    = 1;
+    p_test->segments[1].dir    = read ? TWI_SEGMENT_READ : TWI_SEGMENT_WRITE;
+    p_test->segments[1].p_buff = p_test->buff[1];
+    p_test->segments[1].len    = len;
+
+    p_test->transaction.slave_addr   = addr;
+    p_test->transaction.p_segments   = p_test->segments;
+    p_test->transaction.segments_num = len ? 2 : 1;
+    p_test->transaction.cb           = transaction_cb;
+    p_test->transaction.p_context    = p_test;
+}
+
+static void setup(void)
+{
+    model_reset(&m_timings[0]);
+    memset((void*)&g_queue, 0, sizeof(g_queue));
+    m_done_cnt = 0;
+    mp_chained = NULL;
+    twi_init(TWI_SCL_100KHZ, NULL, NULL);
+}
+
+/*****************************************************************************/
+/*                         Tests                                             */
+/*****************************************************************************/
+static void test_write_segments_share_one_frame(void)
+{
+    test_transaction_t write;
+    setup();
+    transaction_setup(&write, SLAVE_ADDR, 0x10, false, 8);
+    CHECK_EQ(twi_transaction_push(&write.transaction), ERROR_SUCCESS);
+    CHECK(twi_transaction_busy(&write.transaction));
+    model_run();
+
+    CHECK_EQ(write.done, 1);
+    CHECK_EQ(write.status, TWI_STATUS_OK);
+    CHECK(!twi_transaction_busy(&write.transaction));
+    CHECK_EQ(m_twi.starts, 1);
+    CHECK_EQ(m_twi.restarts, 0);
+    CHECK_EQ(m_twi.stops, 1);
+    CHECK_EQ(m_twi.bytes, 1 + 1 + 8);
+    CHECK(memcmp(&m_twi.mem[0x10], write.buff[1], 8) == 0);
+}
+
+static void test_read_uses_repeated_start(void)
+{
+    test_transaction_t read;
+    setup();
+    transaction_setup(&read, SLAVE_ADDR, 0x20, true, 6);
+    CHECK_EQ(twi_transaction_push(&read.transaction), ERROR_SUCCESS);
+    model_run();
+
+    CHECK_EQ(read.done, 1);
+    CHECK_EQ(read.status, TWI_STATUS_OK);
+    CHECK_EQ(m_twi.starts, 1);
+    CHECK_EQ(m_twi.restarts, 1);
+    CHECK_EQ(m_twi.stops, 1);
+    CHECK(memcmp(read.buff[1], &m_twi.mem[0x20], 6) == 0);
+}
+
+static void test_queue_runs_back_to_back(void)
+{
+    test_transaction_t transactions[3];
+    setup();
+    transaction_setup(&transactions[0], SLAVE_ADDR, 0x30, false, 4);
+    transaction_setup(&transactions[1], SLAVE_ADDR, 0x30, true, 4);
+    transaction_setup(&transactions[2], SLAVE_ADDR, 0x40, false, 2);
+    for (uint8_t i = 0; i < 3; ++i)
+    {
+        CHECK_EQ(twi_transaction_push(&transactions[i].transaction), ERROR_SUCCESS);
+    }
+    /* Pushed again while queued, the driver owns it. */
+    CHECK(twi_transaction_busy(&transactions[1].transaction));
+    model_run();
+
+    for (uint8_t i = 0; i < 3; ++i)
+    {
+        CHECK_EQ(transactions[i].done, 1);
+        CHECK_EQ(transactions[i].order, i);
+        CHECK_EQ(transactions[i].status, TWI_STATUS_OK);
+    }
+    /* Written, then read back over a repeated start. */
+    CHECK(memcmp(transactions[1].buff[1], transactions[0].buff[1], 4) == 0);
+    /* STOP-START between them, without a trip through the main loop. */
+    CHECK_EQ(m_twi.starts, 3);
+    CHECK_EQ(m_twi.restarts, 1);
+    CHECK_EQ(m_twi.stops, 3);
+    CHECK_EQ(m_twi.start_over_stop, 0);
+}
+
+static void test_push_from_callback_goes_out_with_stop_start(void)
+{
+    test_transaction_t first;
+    test_transaction_t second;
+    setup();
+    transaction_setup(&first, SLAVE_ADDR, 0x50, false, 3);
+    transaction_setup(&second, SLAVE_ADDR, 0x50, true, 3);
+    mp_chained = &second;
+    CHECK_EQ(twi_transaction_push(&first.transaction), ERROR_SUCCESS);
+    model_run();
+
+    CHECK_EQ(first.done, 1);
+    CHECK_EQ(second.done, 1);
+    CHECK(memcmp(second.buff[1], first.buff[1], 3) == 0);
+    CHECK_EQ(m_twi.starts, 2);
+    CHECK_EQ(m_twi.stops, 2);
+    CHECK_EQ(m_twi.start_over_stop, 0);
+}
+
+static void test_nack_is_reported_and_the_queue_goes_on(void)
+{
+    test_transaction_t missing;
+    test_transaction_t present;
+    setup();
+    transaction_setup(&missing, SLAVE_ADDR + 2, 0x00, false, 2);
+    transaction_setup(&present, SLAVE_ADDR, 0x60, false, 2);
+    CHECK_EQ(twi_transaction_push(&missing.transaction), ERROR_SUCCESS);
+    CHECK_EQ(twi_transaction_push(&present.transaction), ERROR_SUCCESS);
+    model_run();
+
+    CHECK_EQ(missing.status, TWI_SLA_W_TRANSMITTED_NACK);
+    CHECK_EQ(present.status, TWI_STATUS_OK);
+    CHECK(memcmp(&m_twi.mem[0x60], present.buff[1], 2) == 0);
+}
+
+static void test_stop_is_awaited_with_interrupts_enabled(void)
+{
+    test_transaction_t first;
+    test_transaction_t second;
+    setup();
+    transaction_setup(&first, SLAVE_ADDR, 0x70, false, 2);
+    transaction_setup(&second, SLAVE_ADDR, 0x72, false, 2);
+    CHECK_EQ(twi_transaction_push(&first.transaction), ERROR_SUCCESS);
+    model_run();
+    /* The STOP is still on the bus when the next transaction comes from the main loop. */
+    CHECK(m_twi.stop_accesses != 0);
+
+    CHECK_EQ(twi_transaction_push(&second.transaction), ERROR_SUCCESS);
+    CHECK_EQ(m_twi.stop_spins_locked, 0);
+    CHECK_EQ(m_twi.start_over_stop, 0);
+    CHECK(SREG & (1 << SREG_I));
+    model_run();
+    CHECK_EQ(second.done, 1);
+    CHECK_EQ(m_twi.starts, 2);
+}
+
+/*****************************************************************************/
+/*                         Benchmark                                         */
+/*****************************************************************************/
+/* Bus time only: the AVR stretches SCL while TWI_vect runs, which is not counted. */
+static double bench_bytes_per_s(const bus_timing_t *p_timing, bool queued, bool read, uint8_t len)
+{
+    static test_transaction_t transactions[32];
+
+    model_reset(p_timing);
+    uint32_t payload = 0;
+    for (uint32_t round = 0; round < BENCH_ROUNDS; ++round)
+    {
+        uint8_t num = 0;
+        if (queued)
+        {
+            /* One frame, or one repeated start for the read. */
+            transaction_setup(&transactions[num++], SLAVE_ADDR, 0x80, read, len);
+        }
+        else if (read)
+        {
+            /* Register write, STOP, then a read of its own. */
+            transaction_setup(&transactions[num++], SLAVE_ADDR, 0x80, false, 0);
+            transaction_setup(&transactions[num], SLAVE_ADDR, 0x80, true, len);
+            transactions[num].segments[0] = transactions[num].segments[1];
+            transactions[num++].transaction.segments_num = 1;
+        }
+        else
+        {
+            /* A transaction per payload byte, each with its control byte. */
+            for (uint8_t i = 0; i < len; ++i)
+            {
+                transaction_setup(&transactions[num++], SLAVE_ADDR, 0x80, false, 1);
+            }
+        }
+
+        for (uint8_t i = 0; i < num; ++i)
+        {
+            CHECK_EQ(twi_transaction_push(&transactions[i].transaction), ERROR_SUCCESS);
+        }
+        model_run();
+        payload += len;
+    }
+    return payload / (m_twi.bus_us / 1e6);
+}
+
+static void bench(void)
+{
+    printf("  payload bytes/s, back to back, bus time only:\n");
+    printf("                              100 kHz  400 kHz\n");
+    for (uint8_t read = 0; read <= 1; ++read)
+    {
+        uint8_t len = read ? 6 : 26;
+        double result[2][2];
+        for (uint8_t t = 0; t < 2; ++t)
+        {
+            result[t][0] = bench_bytes_per_s(&m_timings[t], true, read, len);
+            result[t][1] = bench_bytes_per_s(&m_timings[t], false, read, len);
+        }
+        if (read)
+        {
+            printf("    read 6, repeated start     %6.0f   %6.0f\n", result[0][0], result[1][0]);
+            printf("    read 6, write STOP read    %6.0f   %6.0f\n", result[0][1], result[1][1]);
+        }
+        else
+        {
+            printf("    write 26, one frame        %6.0f   %6.0f\n", result[0][0], result[1][0]);
+            printf("    write 26, one per byte     %6.0f   %6.0f\n", result[0][1], result[1][1]);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    TEST_RUN(test_write_segments_share_one_frame);
+    TEST_RUN(test_read_uses_repeated_start);
+    TEST_RUN(test_queue_runs_back_to_back);
+    TEST_RUN(test_push_from_callback_goes_out_with_stop_start);
+    TEST_RUN(test_nack_is_reported_and_the_queue_goes_on);
+    TEST_RUN(test_stop_is_awaited_with_interrupts_enabled);
+    if (test_bench_requested(argc, argv))
+    {
+        bench();
+    }
+    return test_report("twi");
+}